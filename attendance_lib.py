@@ -0,0 +1,247 @@
+"""ctypes bindings for libattendance (see executable/cpp/attendance_api.h).
+
+The library keeps the face matcher, the name trie, the attendance store and
+the event log open as in-process handles, so requests no longer pay for a
+process start and a full deserialization each.
+"""
+import ctypes
+import os
+import sys
+
+ATT_API_VERSION = 5
+ATT_OK = 0
+ATT_NOT_FOUND = 1
+ATT_METRICS_JSON = 1
+ATT_METRICS_PROMETHEUS = 2
+
+
+class AttendanceError(Exception):
+    pass
+
+
+def _library_path(folder):
+    name = 'attendance.dll' if sys.platform == 'win32' else 'libattendance.so'
+    return os.path.join(folder, name)
+
+
+class AttendanceLib:
+    def __init__(self, folder='./executable'):
+        self.lib = ctypes.CDLL(os.path.abspath(_library_path(folder)))
+        lib = self.lib
+        c_int, c_ll, c_size, c_char_p, c_void_p = ctypes.c_int, ctypes.c_longlong, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_void_p
+        c_int_p, c_double_p = ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_double)
+
+        signatures = {
+            'att_api_version': (c_int, []),
+            'att_matcher_open': (c_void_p, [c_char_p]),
+            'att_matcher_close': (None, [c_void_p]),
+            'att_matcher_match': (c_ll, [c_void_p, c_double_p, c_size, ctypes.c_double]),
+            'att_matcher_add': (c_int, [c_void_p, c_ll, c_double_p, c_size]),
+            'att_matcher_register': (c_int, [c_void_p, c_ll, c_char_p, c_char_p, c_double_p, c_size, c_size]),
+            'att_matcher_remove': (c_int, [c_void_p, c_ll, ctypes.c_double]),
+            'att_trie_open': (c_void_p, [c_char_p]),
+            'att_trie_close': (None, [c_void_p]),
+            'att_trie_insert': (c_int, [c_void_p, c_char_p, c_char_p]),
+            'att_trie_remove': (c_int, [c_void_p, c_char_p, c_char_p]),
+            'att_trie_search': (c_ll, [c_void_p, c_char_p, ctypes.c_char_p, c_size]),
+            'att_trie_flush': (c_int, [c_void_p]),
+            'att_store_open': (c_void_p, [c_char_p]),
+            'att_store_close': (None, [c_void_p]),
+            'att_store_add_student': (c_int, [c_void_p, c_int]),
+            'att_store_remove_student': (c_int, [c_void_p, c_int]),
+            'att_store_update': (c_int, [c_void_p, c_char_p, c_int, c_int, c_int_p, c_int_p]),
+            'att_store_threshold': (c_ll, [c_void_p, c_char_p, c_int, c_int, c_size, c_int_p, c_size]),
+            'att_store_flush': (c_int, [c_void_p]),
+            'att_events_open': (c_void_p, [c_char_p]),
+            'att_events_close': (None, [c_void_p]),
+            'att_events_record': (c_int, [c_void_p, c_char_p, c_int, c_ll]),
+            'att_metrics': (c_ll, [c_int, ctypes.c_char_p, c_size]),
+        }
+        for name, (restype, argtypes) in signatures.items():
+            function = getattr(lib, name)
+            function.restype = restype
+            function.argtypes = argtypes
+
+        if lib.att_api_version() != ATT_API_VERSION:
+            raise AttendanceError('libattendance ABI version mismatch')
+
+    def open_matcher(self, students_csv):
+        return Matcher(self.lib, students_csv)
+
+    def open_trie(self, trie_file):
+        return NameTrie(self.lib, trie_file)
+
+    def open_store(self, store_file):
+        return Store(self.lib, store_file)
+
+    def open_events(self, event_dir):
+        return EventLog(self.lib, event_dir)
+
+    def metrics(self, format='prometheus'):
+        """Per-call latency and counters of the library, as Prometheus text or a JSON line"""
+        code = ATT_METRICS_JSON if format == 'json' else ATT_METRICS_PROMETHEUS
+        capacity = 4096
+        while True:
+            buffer = ctypes.create_string_buffer(capacity)
+            needed = self.lib.att_metrics(code, buffer, capacity)
+            if needed < 0:
+                raise AttendanceError('Failed to read metrics')
+            if needed < capacity:
+                return buffer.value.decode()
+            capacity = needed + 1
+
+
+def _open(function, path, what):
+    handle = function(path.encode())
+    if not handle:
+        raise AttendanceError(f'Failed to open {what} {path}')
+    return handle
+
+
+def _doubles(values):
+    values = [float(v) for v in values]
+    return (ctypes.c_double * len(values))(*values), len(values)
+
+
+class Matcher:
+    def __init__(self, lib, students_csv):
+        self.lib = lib
+        self.handle = _open(lib.att_matcher_open, students_csv, 'students file')
+
+    def match(self, face_vector, max_distance=0.6):
+        """Student ID of the nearest registered face, or -1"""
+        array, dimension = _doubles(face_vector)
+        return self.lib.att_matcher_match(self.handle, array, dimension, max_distance)
+
+    def add(self, student_id, face_vector):
+        array, dimension = _doubles(face_vector)
+        if self.lib.att_matcher_add(self.handle, int(student_id), array, dimension) != ATT_OK:
+            raise AttendanceError('Failed to add face vector')
+
+    def register(self, student_id, name, rn, face_vectors):
+        """Append a student's templates to students.csv, under the lock its
+        compaction takes, and start matching them"""
+        dimension = len(face_vectors[0])
+        array, _ = _doubles([value for vector in face_vectors for value in vector])
+        if self.lib.att_matcher_register(self.handle, int(student_id), name.encode(), str(rn).encode(),
+                                         array, len(face_vectors), dimension) != ATT_OK:
+            raise AttendanceError('Failed to register face vectors')
+
+    def remove(self, student_id, compact_ratio=0.25):
+        """Tombstone a student's faces; False if the student was not registered"""
+        status = self.lib.att_matcher_remove(self.handle, int(student_id), float(compact_ratio))
+        if status < 0:
+            raise AttendanceError('Failed to remove face vectors')
+        return status == ATT_OK
+
+    def close(self):
+        if self.handle:
+            self.lib.att_matcher_close(self.handle)
+            self.handle = None
+
+
+class NameTrie:
+    def __init__(self, lib, trie_file):
+        self.lib = lib
+        self.handle = _open(lib.att_trie_open, trie_file, 'trie')
+
+    def insert(self, name, student_id):
+        if self.lib.att_trie_insert(self.handle, name.encode(), str(student_id).encode()) != ATT_OK:
+            raise AttendanceError('Failed to insert into trie')
+
+    def remove(self, name, student_id):
+        """False if the name does not hold the student ID"""
+        status = self.lib.att_trie_remove(self.handle, name.encode(), str(student_id).encode())
+        if status < 0:
+            raise AttendanceError('Failed to remove from trie')
+        return status == ATT_OK
+
+    def search(self, prefix):
+        """Student IDs of every name starting with prefix"""
+        capacity = 4096
+        while True:
+            buffer = ctypes.create_string_buffer(capacity)
+            needed = self.lib.att_trie_search(self.handle, prefix.encode(), buffer, capacity)
+            if needed < 0:
+                raise AttendanceError('Trie search failed')
+            if needed < capacity:
+                text = buffer.value.decode()
+                return [int(i) for i in text.split('\n')] if text else []
+            capacity = needed + 1
+
+    def flush(self):
+        if self.lib.att_trie_flush(self.handle) != ATT_OK:
+            raise AttendanceError('Failed to write trie')
+
+    def close(self):
+        if self.handle:
+            self.lib.att_trie_close(self.handle)
+            self.handle = None
+
+
+class Store:
+    def __init__(self, lib, store_file):
+        self.lib = lib
+        self.handle = _open(lib.att_store_open, store_file, 'attendance store')
+
+    def add_student(self, student_id):
+        """False if the student already exists"""
+        status = self.lib.att_store_add_student(self.handle, int(student_id))
+        if status < 0:
+            raise AttendanceError('Failed to add student to the attendance store')
+        return status == ATT_OK
+
+    def remove_student(self, student_id):
+        """False if the student does not exist"""
+        status = self.lib.att_store_remove_student(self.handle, int(student_id))
+        if status < 0:
+            raise AttendanceError('Failed to remove student from the attendance store')
+        return status == ATT_OK
+
+    def update(self, subject, student_id, delta=1):
+        """New (subject, total) counts, or None for an unknown student or subject"""
+        subject_value, total_value = ctypes.c_int(), ctypes.c_int()
+        status = self.lib.att_store_update(self.handle, subject.encode(), int(student_id), int(delta),
+                                           ctypes.byref(subject_value), ctypes.byref(total_value))
+        if status < 0:
+            raise AttendanceError('Failed to update the attendance store')
+        if status == ATT_NOT_FOUND:
+            return None
+        return subject_value.value, total_value.value
+
+    def threshold(self, subject, threshold, direction, limit=0):
+        """Student IDs above (direction 1) or below (-1) a threshold, highest first"""
+        capacity = limit if limit > 0 else 1024
+        while True:
+            ids = (ctypes.c_int * capacity)()
+            needed = self.lib.att_store_threshold(self.handle, subject.encode(), int(threshold), int(direction),
+                                                  max(int(limit), 0), ids, capacity)
+            if needed < 0:
+                raise AttendanceError('Threshold query failed')
+            if needed <= capacity or limit > 0:
+                return list(ids[:min(needed, capacity)])
+            capacity = needed
+
+    def flush(self):
+        if self.lib.att_store_flush(self.handle) != ATT_OK:
+            raise AttendanceError('Failed to checkpoint the attendance store')
+
+    def close(self):
+        if self.handle:
+            self.lib.att_store_close(self.handle)
+            self.handle = None
+
+
+class EventLog:
+    def __init__(self, lib, event_dir):
+        self.lib = lib
+        self.handle = _open(lib.att_events_open, event_dir, 'event log')
+
+    def record(self, subject, student_id, time=0):
+        if self.lib.att_events_record(self.handle, subject.encode(), int(student_id), int(time)) != ATT_OK:
+            raise AttendanceError('Failed to record attendance event')
+
+    def close(self):
+        if self.handle:
+            self.lib.att_events_close(self.handle)
+            self.handle = None
@@ -0,0 +1,337 @@
+// Adaptive child sets for the name trie, after the adaptive radix tree (ART)
+// of Leis et al.: a node's children live in the smallest of four node kinds
+// that holds them, instead of a hash table per node.
+//
+//   Node4    up to 4 children, keys and children in sorted parallel arrays
+//   Node16   up to 16, the same layout; the key is found with one SSE2
+//            compare of all 16 keys when the build has SSE2
+//   Node48   up to 48, a 256-byte index from key to child slot
+//   Node256  a direct array of 256 children indexed by the key
+//
+// A set grows to the next kind when an insert finds it full, and shrinks
+// when an erase leaves it well below capacity (Node256 at 37 children,
+// Node48 at 12, Node16 at 3), so that a node hovering around a boundary does
+// not switch kinds on every edit. Since the kind depends on that history,
+// the trie files record it per node (see kind() and reserve()). A node
+// without children allocates nothing. Children are visited in key order,
+// keys taken as unsigned bytes.
+
+#ifndef ART_CHILDREN_H
+#define ART_CHILDREN_H
+
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+enum class ArtKind : uint8_t { Node4 = 0, Node16 = 1, Node48 = 2, Node256 = 3 };
+
+// Trie files that record node kinds start with this magic; older files
+// start directly with the root node
+const char ART_TRIE_MAGIC[4] = {'A', 'R', 'T', '1'};
+
+template <typename Child>
+class ArtChildren {
+private:
+    // Node4 and Node16: keys sorted, children[i] under keys[i]
+    template <size_t N>
+    struct Sorted {
+        uint8_t count = 0;
+        unsigned char keys[N] = {};
+        Child children[N];
+    };
+    struct Indexed {
+        uint8_t count = 0;
+        uint8_t slots[256] = {};  // Key -> slot + 1, 0 for no child
+        Child children[48];
+    };
+    struct Direct {
+        uint16_t count = 0;
+        Child children[256];
+    };
+
+    ArtKind kindTag;
+    void* node;  // Sorted<4>, Sorted<16>, Indexed or Direct as kindTag says; null while empty
+
+    static constexpr size_t SHRINK_NODE256 = 37;
+    static constexpr size_t SHRINK_NODE48 = 12;
+    static constexpr size_t SHRINK_NODE16 = 3;
+
+    Sorted<4>* node4() const { return static_cast<Sorted<4>*>(node); }
+    Sorted<16>* node16() const { return static_cast<Sorted<16>*>(node); }
+    Indexed* node48() const { return static_cast<Indexed*>(node); }
+    Direct* node256() const { return static_cast<Direct*>(node); }
+
+    static int lowestBit(unsigned mask) {
+#if defined(__GNUC__)
+        return __builtin_ctz(mask);
+#else
+        int bit = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    template <size_t N>
+    static int findSorted(const Sorted<N>* sorted, unsigned char key) {
+#if defined(__SSE2__) || defined(_M_X64)
+        if constexpr (N == 16) {
+            __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sorted->keys));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_cmpeq_epi8(keys, _mm_set1_epi8(static_cast<char>(key)))));
+            mask &= (1u << sorted->count) - 1;
+            return mask ? lowestBit(mask) : -1;
+        }
+#endif
+        for (int i = 0; i < sorted->count; ++i) {
+            if (sorted->keys[i] == key) return i;
+        }
+        return -1;
+    }
+
+    template <size_t N>
+    static void insertSorted(Sorted<N>* sorted, unsigned char key, Child child) {
+        int at = sorted->count;
+        while (at > 0 && sorted->keys[at - 1] > key) {
+            sorted->keys[at] = sorted->keys[at - 1];
+            sorted->children[at] = move(sorted->children[at - 1]);
+            --at;
+        }
+        sorted->keys[at] = key;
+        sorted->children[at] = move(child);
+        ++sorted->count;
+    }
+
+    void release() {
+        switch (kindTag) {
+            case ArtKind::Node4: delete node4(); break;
+            case ArtKind::Node16: delete node16(); break;
+            case ArtKind::Node48: delete node48(); break;
+            case ArtKind::Node256: delete node256(); break;
+        }
+        node = nullptr;
+        kindTag = ArtKind::Node4;
+    }
+
+    // Move every child into an empty node of another kind
+    void switchKind(ArtKind to) {
+        ArtChildren next;
+        next.reserve(to);
+        forEachMutable([&](unsigned char key, Child& child) { next.add(key, move(child)); });
+        *this = move(next);
+    }
+
+    // Add a child under a key that is not present; the node has room
+    void add(unsigned char key, Child child) {
+        switch (kindTag) {
+            case ArtKind::Node4: insertSorted(node4(), key, move(child)); break;
+            case ArtKind::Node16: insertSorted(node16(), key, move(child)); break;
+            case ArtKind::Node48: {
+                Indexed* indexed = node48();
+                uint8_t slot = 0;
+                while (indexed->children[slot]) ++slot;
+                indexed->children[slot] = move(child);
+                indexed->slots[key] = static_cast<uint8_t>(slot + 1);
+                ++indexed->count;
+                break;
+            }
+            case ArtKind::Node256:
+                node256()->children[key] = move(child);
+                ++node256()->count;
+                break;
+        }
+    }
+
+    template <typename F>
+    void forEachMutable(F&& visit) {
+        if (!node) return;
+        switch (kindTag) {
+            case ArtKind::Node4:
+                for (int i = 0; i < node4()->count; ++i) visit(node4()->keys[i], node4()->children[i]);
+                break;
+            case ArtKind::Node16:
+                for (int i = 0; i < node16()->count; ++i) visit(node16()->keys[i], node16()->children[i]);
+                break;
+            case ArtKind::Node48:
+                for (int key = 0; key < 256; ++key) {
+                    if (uint8_t slot = node48()->slots[key]) {
+                        visit(static_cast<unsigned char>(key), node48()->children[slot - 1]);
+                    }
+                }
+                break;
+            case ArtKind::Node256:
+                for (int key = 0; key < 256; ++key) {
+                    if (node256()->children[key]) visit(static_cast<unsigned char>(key), node256()->children[key]);
+                }
+                break;
+        }
+    }
+
+public:
+    ArtChildren() : kindTag(ArtKind::Node4), node(nullptr) {}
+
+    ArtChildren(const ArtChildren& other) : kindTag(ArtKind::Node4), node(nullptr) {
+        if (!other.node) return;
+        reserve(other.kindTag);
+        other.forEach([&](char key, const Child& child) { add(static_cast<unsigned char>(key), child); });
+    }
+
+    ArtChildren(ArtChildren&& other) noexcept : kindTag(other.kindTag), node(other.node) {
+        other.kindTag = ArtKind::Node4;
+        other.node = nullptr;
+    }
+
+    ArtChildren& operator=(ArtChildren other) {
+        swap(kindTag, other.kindTag);
+        swap(node, other.node);
+        return *this;
+    }
+
+    ~ArtChildren() {
+        release();
+    }
+
+    ArtKind kind() const {
+        return kindTag;
+    }
+
+    // Start an empty set as the given kind, as recorded in a trie file
+    void reserve(ArtKind kind) {
+        release();
+        kindTag = kind;
+        switch (kind) {
+            case ArtKind::Node4: node = new Sorted<4>(); break;
+            case ArtKind::Node16: node = new Sorted<16>(); break;
+            case ArtKind::Node48: node = new Indexed(); break;
+            case ArtKind::Node256: node = new Direct(); break;
+        }
+    }
+
+    size_t size() const {
+        if (!node) return 0;
+        switch (kindTag) {
+            case ArtKind::Node4: return node4()->count;
+            case ArtKind::Node16: return node16()->count;
+            case ArtKind::Node48: return node48()->count;
+            case ArtKind::Node256: return node256()->count;
+        }
+        return 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // The child under a key, or null
+    const Child* find(char c) const {
+        if (!node) return nullptr;
+        unsigned char key = static_cast<unsigned char>(c);
+        switch (kindTag) {
+            case ArtKind::Node256: {
+                const Child& child = node256()->children[key];
+                return child ? &child : nullptr;
+            }
+            case ArtKind::Node48: {
+                uint8_t slot = node48()->slots[key];
+                return slot ? &node48()->children[slot - 1] : nullptr;
+            }
+            case ArtKind::Node16: {
+                int i = findSorted(node16(), key);
+                return i < 0 ? nullptr : &node16()->children[i];
+            }
+            case ArtKind::Node4: {
+                int i = findSorted(node4(), key);
+                return i < 0 ? nullptr : &node4()->children[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // The 256 children of a Node256, indexed by key (null where absent), or
+    // null for the other kinds: a walk down dense nodes needs no search
+    const Child* dense() const {
+        return node && kindTag == ArtKind::Node256 ? node256()->children : nullptr;
+    }
+
+    // Set the child under a key, growing to the next kind if full; a null
+    // child erases the key
+    void set(char c, Child child) {
+        if (!child) {
+            erase(c);
+            return;
+        }
+        unsigned char key = static_cast<unsigned char>(c);
+        if (Child* existing = const_cast<Child*>(find(c))) {
+            *existing = move(child);
+            return;
+        }
+        if (!node) reserve(ArtKind::Node4);
+        size_t count = size();
+        if (kindTag == ArtKind::Node4 && count == 4) switchKind(ArtKind::Node16);
+        else if (kindTag == ArtKind::Node16 && count == 16) switchKind(ArtKind::Node48);
+        else if (kindTag == ArtKind::Node48 && count == 48) switchKind(ArtKind::Node256);
+        add(key, move(child));
+    }
+
+    // Drop the child under a key, shrinking to a smaller kind once sparse;
+    // returns whether there was one
+    bool erase(char c) {
+        if (!node) return false;
+        unsigned char key = static_cast<unsigned char>(c);
+        switch (kindTag) {
+            case ArtKind::Node4:
+            case ArtKind::Node16: {
+                bool small = kindTag == ArtKind::Node4;
+                uint8_t& count = small ? node4()->count : node16()->count;
+                unsigned char* keys = small ? node4()->keys : node16()->keys;
+                Child* children = small ? node4()->children : node16()->children;
+                int i = small ? findSorted(node4(), key) : findSorted(node16(), key);
+                if (i < 0) return false;
+                for (int j = i; j + 1 < count; ++j) {
+                    keys[j] = keys[j + 1];
+                    children[j] = move(children[j + 1]);
+                }
+                children[--count] = Child();
+                break;
+            }
+            case ArtKind::Node48: {
+                uint8_t slot = node48()->slots[key];
+                if (!slot) return false;
+                node48()->children[slot - 1] = Child();
+                node48()->slots[key] = 0;
+                --node48()->count;
+                break;
+            }
+            case ArtKind::Node256:
+                if (!node256()->children[key]) return false;
+                node256()->children[key] = Child();
+                --node256()->count;
+                break;
+        }
+        size_t count = size();
+        if (count == 0) release();
+        else if (kindTag == ArtKind::Node256 && count <= SHRINK_NODE256) switchKind(ArtKind::Node48);
+        else if (kindTag == ArtKind::Node48 && count <= SHRINK_NODE48) switchKind(ArtKind::Node16);
+        else if (kindTag == ArtKind::Node16 && count <= SHRINK_NODE16) switchKind(ArtKind::Node4);
+        return true;
+    }
+
+    // Visit (key, child) in key order
+    template <typename F>
+    void forEach(F&& visit) const {
+        const_cast<ArtChildren*>(this)->forEachMutable(
+            [&](unsigned char key, Child& child) { visit(static_cast<char>(key), static_cast<const Child&>(child)); });
+    }
+};
+
+#endif // ART_CHILDREN_H
@@ -0,0 +1,110 @@
+/*
+ * C ABI of libattendance: the face matcher, the name trie, the attendance
+ * store and the attendance event log as long-lived in-process handles, so a
+ * server can load everything once instead of spawning a tool per request.
+ *
+ * Build:  g++ -std=c++17 -O2 -shared -fPIC -pthread -o executable/libattendance.so executable/cpp/libattendance.cpp
+ *
+ * Every handle is safe to use from several threads. Lookups (match, search,
+ * threshold) read an immutable version of the data without taking a lock and
+ * never wait for an insert or update. Functions returning int
+ * use the ATT_* status codes; functions filling a caller buffer return the
+ * number of items (or bytes) the full answer needs, which may exceed the
+ * capacity given, or ATT_ERROR.
+ */
+
+#ifndef ATTENDANCE_API_H
+#define ATTENDANCE_API_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#define ATT_API __declspec(dllexport)
+#else
+#define ATT_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ATT_API_VERSION 5
+
+#define ATT_OK 0
+#define ATT_NOT_FOUND 1
+#define ATT_ERROR (-1)
+
+ATT_API int att_api_version(void);
+
+/* Face matcher over the facial vectors in students.csv; a student may have several
+ * templates (rows) */
+typedef struct att_matcher att_matcher;
+
+ATT_API att_matcher* att_matcher_open(const char* students_csv);
+ATT_API void att_matcher_close(att_matcher* matcher);
+/* Student ID of the nearest face closer than max_distance, or -1. The scan stops
+ * early at a student within max_distance / 2 of the probe. */
+ATT_API long long att_matcher_match(att_matcher* matcher, const double* vector, size_t dimension, double max_distance);
+/* Add a template to a student (registering the student if new), in memory only */
+ATT_API int att_matcher_add(att_matcher* matcher, long long student_id, const double* vector, size_t dimension);
+/* Register a student: append count templates (vectors holds them back to back,
+ * dimension values each) to students.csv under its lock, then match them. The
+ * name and roll number may not contain commas, quotes or line breaks. */
+ATT_API int att_matcher_register(att_matcher* matcher, long long student_id, const char* name,
+                                 const char* roll_number, const double* vectors, size_t count, size_t dimension);
+/* Tombstone a student's faces in students.csv, which is compacted once tombstoned
+ * rows reach compact_ratio of it, and stop matching them */
+ATT_API int att_matcher_remove(att_matcher* matcher, long long student_id, double compact_ratio);
+
+/* Name trie (name.dat) */
+typedef struct att_trie att_trie;
+
+ATT_API att_trie* att_trie_open(const char* trie_file);
+ATT_API void att_trie_close(att_trie* trie);
+ATT_API int att_trie_insert(att_trie* trie, const char* name, const char* student_id);
+/* Remove a student ID from a name, pruning branches left empty */
+ATT_API int att_trie_remove(att_trie* trie, const char* name, const char* student_id);
+/* Student IDs of every name with the prefix, newline separated and NUL terminated */
+ATT_API long long att_trie_search(att_trie* trie, const char* prefix, char* buffer, size_t capacity);
+/* Write pending inserts and removals back to the trie file */
+ATT_API int att_trie_flush(att_trie* trie);
+
+/* Attendance store (attendance.store and its write-ahead log) */
+typedef struct att_store att_store;
+
+ATT_API att_store* att_store_open(const char* store_file);
+ATT_API void att_store_close(att_store* store);
+ATT_API int att_store_add_student(att_store* store, int student_id);
+/* Drop a student's row from every subject */
+ATT_API int att_store_remove_student(att_store* store, int student_id);
+/* Add delta to a subject and the total; reports the new values */
+ATT_API int att_store_update(att_store* store, const char* subject, int student_id, int delta,
+                             int* subject_value, int* total_value);
+/* Student IDs at or above (direction 1) or at or below (direction -1) a threshold,
+   highest first. With limit 0 returns how many match (copying up to capacity);
+   otherwise only the first limit are looked up and returns how many were found */
+ATT_API long long att_store_threshold(att_store* store, const char* subject, int threshold, int direction,
+                                      size_t limit, int* student_ids, size_t capacity);
+/* Fold the write-ahead log into a new snapshot */
+ATT_API int att_store_flush(att_store* store);
+
+/* Attendance event log directory */
+typedef struct att_events att_events;
+
+ATT_API att_events* att_events_open(const char* event_dir);
+ATT_API void att_events_close(att_events* events);
+/* Record one mark; time is Unix seconds, or 0 for now */
+ATT_API int att_events_record(att_events* events, const char* subject, int student_id, long long time);
+
+/* Per-call latency and counters of every handle in the process */
+#define ATT_METRICS_JSON 1
+#define ATT_METRICS_PROMETHEUS 2
+
+/* Current metrics as one JSON line or Prometheus text, NUL terminated */
+ATT_API long long att_metrics(int format, char* buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ATTENDANCE_API_H */
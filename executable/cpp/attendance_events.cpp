@@ -0,0 +1,242 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <tuple>
+#include <filesystem>
+
+#include "attendance_events.h"
+#include "metrics.h"
+
+using namespace std;
+
+metrics::Phase parsePhase("parse");
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Phase outputPhase("output");
+metrics::Counter eventsWritten("events_written");
+
+const string TOTAL_SUBJECT = "total_attendance";
+
+// Resolve a subject argument: a subject name, or total_attendance / all for every subject.
+// Returns -2 if the subject has never been marked.
+int resolveSubject(EventLog& log, const string& subject) {
+    if (subject == TOTAL_SUBJECT || subject == "all") return -1;
+    int index = log.subjectIndex(subject, false);
+    return index < 0 ? -2 : index;
+}
+
+// Subject names become CSV columns and dictionary lines, so only accept plain identifiers
+bool isValidSubject(const string& subject) {
+    if (subject.empty() || subject == TOTAL_SUBJECT || subject == "all") return false;
+    for (char c : subject) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+    }
+    return true;
+}
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " record <event_dir> <subject> <student_id> [time]" << endl;
+    cerr << "       " << program << " batch <event_dir>  (reads '<subject> <student_id> [time]' lines from stdin)" << endl;
+    cerr << "       " << program << " count <event_dir> <subject> <from> <to>" << endl;
+    cerr << "       " << program << " threshold <event_dir> <subject> <from> <to> <threshold> <direction> [limit]" << endl;
+    cerr << "       " << program << " export <event_dir> [<from> <to>]" << endl;
+    cerr << "  time, from, to: Unix seconds or YYYY-MM-DD (UTC midnight); windows are [from, to)" << endl;
+    cerr << "  subject: a subject name, or total_attendance for every subject" << endl;
+    cerr << "  direction: 1 for at least threshold marks, -1 for at most threshold marks" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const string command = argv[1];
+    const string eventDir = argv[2];
+    bool writer = command == "record" || command == "batch";
+    if ((command == "record" && argc != 5 && argc != 6) || (command == "batch" && argc != 3) ||
+        (command == "count" && argc != 6) || (command == "threshold" && argc != 8 && argc != 9) ||
+        (command == "export" && argc != 3 && argc != 5) ||
+        (!writer && command != "count" && command != "threshold" && command != "export")) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    EventLog log(eventDir);
+    if (writer) {
+        error_code ec;
+        filesystem::create_directories(eventDir, ec);
+    } else if (!filesystem::is_directory(eventDir)) {
+        cerr << "Event log not found: " << eventDir << endl;
+        return 1;
+    }
+
+    FileLock lock(log.lockFilename(), writer);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << log.lockFilename() << endl;
+        return 1;
+    }
+    {
+        metrics::ScopedTimer loadTimer(loadPhase);
+        log.load();
+    }
+
+    if (writer) {
+        // Read (subject, student_id, time) records from the arguments or stdin
+        metrics::ScopedTimer parseTimer(parsePhase);
+        vector<tuple<string, string, string>> records;
+        if (command == "record") {
+            records.emplace_back(argv[3], argv[4], argc == 6 ? argv[5] : "");
+        } else {
+            string line;
+            while (getline(cin, line)) {
+                istringstream ss(line);
+                string subject, studentId, time;
+                if (!(ss >> subject >> studentId)) continue;
+                ss >> time;
+                records.emplace_back(subject, studentId, time);
+            }
+        }
+
+        int64_t now = static_cast<int64_t>(std::time(nullptr));
+        vector<Event> events;
+        for (const auto& [subject, studentIdText, timeText] : records) {
+            Event event;
+            int subjectIdx = isValidSubject(subject) ? log.subjectIndex(subject, true) : -1;
+            try {
+                event.studentId = stoi(studentIdText);
+            } catch (const exception&) {
+                subjectIdx = -1;
+            }
+            event.time = now;
+            if (subjectIdx < 0 || (!timeText.empty() && !parseTime(timeText, event.time))) {
+                cerr << "Invalid event: " << subject << " " << studentIdText << " " << timeText << endl;
+                return 1;
+            }
+            event.subject = static_cast<uint8_t>(subjectIdx);
+            events.push_back(event);
+        }
+        parseTimer.stop();
+
+        metrics::ScopedTimer serializeTimer(serializePhase);
+        if (!events.empty() && !log.append(events)) {
+            return 1;
+        }
+        serializeTimer.stop();
+        eventsWritten.add(events.size());
+        cout << events.size() << endl;
+        return 0;
+    }
+
+    int64_t from = INT64_MIN / 2, to = INT64_MAX / 2;
+    int subject = -1;
+    if (command == "count" || command == "threshold") {
+        subject = resolveSubject(log, argv[3]);
+        if (!parseTime(argv[4], from) || !parseTime(argv[5], to)) {
+            cerr << "Invalid time window: " << argv[4] << " " << argv[5] << endl;
+            return 1;
+        }
+    } else if (argc == 5 && (!parseTime(argv[3], from) || !parseTime(argv[4], to))) {
+        cerr << "Invalid time window: " << argv[3] << " " << argv[4] << endl;
+        return 1;
+    }
+
+    if (command == "count") {
+        metrics::ScopedTimer computeTimer(computePhase);
+        unordered_map<int, int> counts;
+        if (subject != -2) counts = log.countEvents(from, to, subject);
+        vector<pair<int, int>> rows(counts.begin(), counts.end());
+        sort(rows.begin(), rows.end());
+        computeTimer.stop();
+        metrics::ScopedTimer outputTimer(outputPhase);
+        for (const auto& [id, count] : rows) {
+            cout << id << " " << count << '\n';
+        }
+        return 0;
+    }
+
+    if (command == "threshold") {
+        int threshold, direction;
+        long long limit = 0;
+        try {
+            threshold = stoi(argv[6]);
+            direction = stoi(argv[7]);
+            if (argc == 9) limit = stoll(argv[8]);
+        } catch (const exception& e) {
+            cerr << "Error parsing arguments: " << e.what() << endl;
+            return 1;
+        }
+        if ((direction != 1 && direction != -1) || limit < 0) {
+            cerr << "Direction must be 1 (above) or -1 (below) and limit must not be negative" << endl;
+            return 1;
+        }
+
+        metrics::ScopedTimer computeTimer(computePhase);
+        unordered_map<int, int> counts;
+        if (subject != -2) counts = log.countEvents(from, to, subject);
+        if (direction < 0 && threshold >= 0) {
+            // Students seen anywhere in the log but not in the window have zero marks
+            for (const auto& entry : log.countEvents(INT64_MIN / 2, INT64_MAX / 2, -1)) {
+                counts.emplace(entry.first, 0);
+            }
+        }
+
+        // Output: student IDs in descending order of marks within the window
+        vector<pair<int, int>> matches;
+        for (const auto& [id, count] : counts) {
+            if (direction > 0 ? count >= threshold : count <= threshold) {
+                matches.push_back({-count, id});
+            }
+        }
+        sort(matches.begin(), matches.end());
+        if (limit > 0 && matches.size() > static_cast<size_t>(limit)) {
+            matches.resize(static_cast<size_t>(limit));
+        }
+        computeTimer.stop();
+        metrics::ScopedTimer outputTimer(outputPhase);
+        if (matches.empty()) {
+            cout << "0" << endl; // No students meet the criteria
+        }
+        for (const auto& match : matches) {
+            cout << match.second << '\n';
+        }
+        return 0;
+    }
+
+    // export: per-subject totals in the attendance.csv layout, so
+    // 'create_avl --csv' can rebuild the subject indexes from the log
+    metrics::ScopedTimer computeTimer(computePhase);
+    const vector<string>& subjects = log.getSubjects();
+    vector<unordered_map<int, int>> perSubject;
+    map<int, int> totals;
+    for (size_t s = 0; s < subjects.size(); ++s) {
+        perSubject.push_back(log.countEvents(from, to, static_cast<int>(s)));
+        for (const auto& [id, count] : perSubject.back()) {
+            totals[id] += count;
+        }
+    }
+    computeTimer.stop();
+    metrics::ScopedTimer outputTimer(outputPhase);
+    cout << "student_id,name";
+    for (const auto& name : subjects) {
+        cout << "," << name;
+    }
+    cout << "," << TOTAL_SUBJECT << '\n';
+    for (const auto& [id, total] : totals) {
+        cout << id << ",";
+        for (const auto& counts : perSubject) {
+            auto it = counts.find(id);
+            cout << "," << (it == counts.end() ? 0 : it->second);
+        }
+        cout << "," << total << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+#ifndef ATTENDANCE_EVENTS_H
+#define ATTENDANCE_EVENTS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "write_ahead_log.h"
+
+using namespace std;
+
+// Time-partitioned, append-only attendance event log.
+//
+// Every mark is one event (student_id, subject, time). Events live in one
+// partition file per UTC day, <dir>/<YYYY-MM-DD>.evt, as a sequence of blocks:
+//   header:  char magic[4] = "AEVB", uint32 count,
+//            uint32 minOffset, uint32 maxOffset, uint32 crc32(columns)
+//   columns: int32 studentIds[count], uint32 offsets[count], uint8 subjects[count]
+// where offsets are seconds since the partition's midnight and subjects index
+// the names listed one per line in <dir>/subjects. One event costs 9 bytes of
+// columns plus its share of the block's 20-byte header: a batch of marks is
+// appended as a single block, while a single mark costs 29 bytes.
+//
+// Queries take a [from, to) time window and only open the partitions whose
+// day overlaps it, skip blocks whose [minOffset, maxOffset] falls outside it,
+// and scan the remaining partitions on parallel threads.
+//
+// Appends hold an exclusive lock on <dir>/events.lock and queries a shared
+// one. A block cut short by a crash ends its partition for readers; the next
+// append truncates it before writing. An EventLog remembers where the blocks
+// it has checked end, so an append only reads and checks what other writers
+// added since, and a partition is not re-read on every mark.
+
+const char BLOCK_MAGIC[4] = {'A', 'E', 'V', 'B'};
+const int64_t SECONDS_PER_DAY = 86400;
+const size_t MAX_SUBJECTS = 256;
+
+struct BlockHeader {
+    char magic[4];
+    uint32_t count;
+    uint32_t minOffset;
+    uint32_t maxOffset;
+    uint32_t checksum;
+};
+
+// A single attendance event
+struct Event {
+    int studentId;
+    uint8_t subject;
+    int64_t time;  // Unix seconds
+};
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+inline int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// Date string YYYY-MM-DD for days since 1970-01-01
+inline string civilFromDays(int64_t z) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    const int64_t y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%04lld-%02u-%02u", static_cast<long long>(y), m, d);
+    return buffer;
+}
+
+inline int64_t floorDiv(int64_t a, int64_t b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+// Parse a time given as Unix seconds or as a YYYY-MM-DD date (midnight UTC)
+inline bool parseTime(const string& text, int64_t& time) {
+    unsigned y, m, d;
+    char tail;
+    if (text.size() == 10 && sscanf(text.c_str(), "%4u-%2u-%2u%c", &y, &m, &d, &tail) == 3) {
+        if (m < 1 || m > 12 || d < 1 || d > 31) return false;
+        time = daysFromCivil(y, m, d) * SECONDS_PER_DAY;
+        return true;
+    }
+    try {
+        size_t used = 0;
+        time = stoll(text, &used);
+        return used == text.size();
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+// Parse a partition file name back to its day; returns false for other files
+inline bool partitionDay(const filesystem::path& path, int64_t& day) {
+    if (path.extension() != ".evt") return false;
+    int64_t time;
+    if (!parseTime(path.stem().string(), time)) return false;
+    day = floorDiv(time, SECONDS_PER_DAY);
+    return true;
+}
+
+class EventLog {
+private:
+    string dir;
+    vector<string> subjects;  // Subject dictionary; events store the index
+    map<int64_t, pair<long long, long long>> validEnds;  // Day -> (file size, end of its checked blocks)
+
+    string subjectsFilename() const { return dir + "/subjects"; }
+    string partitionFilename(int64_t day) const { return dir + "/" + civilFromDays(day) + ".evt"; }
+
+    bool saveSubjects() {
+        ofstream outFile(subjectsFilename(), ios::trunc);
+        for (const auto& subject : subjects) {
+            outFile << subject << '\n';
+        }
+        outFile.close();
+        return static_cast<bool>(outFile);
+    }
+
+    // Offset just past the last complete block of a partition
+    static long long validLength(const string& contents) {
+        size_t offset = 0;
+        while (offset + sizeof(BlockHeader) <= contents.size()) {
+            BlockHeader header;
+            memcpy(&header, contents.data() + offset, sizeof(BlockHeader));
+            size_t columnsSize = static_cast<size_t>(header.count) * 9;
+            if (memcmp(header.magic, BLOCK_MAGIC, 4) != 0 ||
+                offset + sizeof(BlockHeader) + columnsSize > contents.size() ||
+                wal_detail::crc32(contents.data() + offset + sizeof(BlockHeader), columnsSize) != header.checksum) {
+                break;
+            }
+            offset += sizeof(BlockHeader) + columnsSize;
+        }
+        return static_cast<long long>(offset);
+    }
+
+    // Offset just past the last complete block of an open partition. Blocks
+    // before the end remembered for the day are not checked again unless the
+    // file has shrunk; if its size is unchanged nothing is read at all.
+    bool validEnd(int64_t day, int fd, long long& end) {
+        long long size = wal_detail::fileSize(fd);
+        if (size < 0) return false;
+        long long from = 0;
+        auto known = validEnds.find(day);
+        if (known != validEnds.end() && known->second.first <= size) {
+            if (known->second.first == size) {
+                end = known->second.second;
+                return true;
+            }
+            from = known->second.second;
+        }
+        string tail;
+        if (!wal_detail::readRange(fd, from, size, tail)) return false;
+        end = from + validLength(tail);
+        validEnds[day] = {size, end};
+        return true;
+    }
+
+    // Append events of one day as a single block
+    bool appendBlock(int64_t day, vector<Event>& events) {
+        const string filename = partitionFilename(day);
+        int fd = wal_detail::openFile(filename, true);
+        if (fd < 0) {
+            cerr << "Error opening partition: " << filename << endl;
+            return false;
+        }
+
+        long long end = 0;
+        bool ok = validEnd(day, fd, end);
+        if (ok && end < validEnds[day].first) {
+            cerr << "Warning: dropping a torn block at the end of " << filename << endl;
+            ok = wal_detail::truncateFd(fd, end) == 0;
+        }
+
+        // Keep blocks in time order so partition scans read sequentially
+        stable_sort(events.begin(), events.end(),
+                    [](const Event& a, const Event& b) { return a.time < b.time; });
+        uint32_t count = static_cast<uint32_t>(events.size());
+        string block(sizeof(BlockHeader) + static_cast<size_t>(count) * 9, '\0');
+        char* studentIds = &block[sizeof(BlockHeader)];
+        char* offsets = studentIds + count * sizeof(int32_t);
+        char* subjectColumn = offsets + count * sizeof(uint32_t);
+        for (uint32_t i = 0; i < count; ++i) {
+            int32_t id = events[i].studentId;
+            uint32_t offset = static_cast<uint32_t>(events[i].time - day * SECONDS_PER_DAY);
+            memcpy(studentIds + i * sizeof(int32_t), &id, sizeof(int32_t));
+            memcpy(offsets + i * sizeof(uint32_t), &offset, sizeof(uint32_t));
+            subjectColumn[i] = static_cast<char>(events[i].subject);
+        }
+
+        BlockHeader header;
+        memcpy(header.magic, BLOCK_MAGIC, 4);
+        header.count = count;
+        header.minOffset = static_cast<uint32_t>(events.front().time - day * SECONDS_PER_DAY);
+        header.maxOffset = static_cast<uint32_t>(events.back().time - day * SECONDS_PER_DAY);
+        header.checksum = wal_detail::crc32(studentIds, static_cast<size_t>(count) * 9);
+        memcpy(&block[0], &header, sizeof(BlockHeader));
+
+        ok = ok && wal_detail::writeAll(fd, block.data(), block.size(), end) && wal_detail::syncFd(fd) == 0;
+        wal_detail::closeFile(fd);
+        if (ok) {
+            long long size = end + static_cast<long long>(block.size());
+            validEnds[day] = {size, size};
+        } else {
+            validEnds.erase(day);  // Check the partition again on the next append
+        }
+        if (!ok) {
+            cerr << "Error appending to partition: " << filename << endl;
+        }
+        return ok;
+    }
+
+    // Add a partition's events in [from, to) matching a subject (-1 for all) to counts
+    static void scanPartition(const string& filename, int64_t day, int64_t from, int64_t to, int subject,
+                              unordered_map<int, int>& counts) {
+        int fd = wal_detail::openReadOnly(filename);
+        if (fd < 0) return;
+        string contents;
+        bool ok = wal_detail::readAll(fd, contents);
+        wal_detail::closeFile(fd);
+        if (!ok) return;
+
+        int64_t base = day * SECONDS_PER_DAY;
+        int64_t lo = max<int64_t>(from - base, 0);
+        int64_t hi = min<int64_t>(to - base, SECONDS_PER_DAY);  // Exclusive
+        long long end = validLength(contents);
+        size_t offset = 0;
+        while (static_cast<long long>(offset) < end) {
+            BlockHeader header;
+            memcpy(&header, contents.data() + offset, sizeof(BlockHeader));
+            const char* columns = contents.data() + offset + sizeof(BlockHeader);
+            offset += sizeof(BlockHeader) + static_cast<size_t>(header.count) * 9;
+            if (header.maxOffset < lo || header.minOffset >= hi) continue;  // Block outside the window
+
+            const char* offsets = columns + header.count * sizeof(int32_t);
+            const char* subjectColumn = offsets + header.count * sizeof(uint32_t);
+            bool wholeBlock = header.minOffset >= lo && header.maxOffset < hi;
+            for (uint32_t i = 0; i < header.count; ++i) {
+                if (subject >= 0 && static_cast<uint8_t>(subjectColumn[i]) != subject) continue;
+                if (!wholeBlock) {
+                    uint32_t t;
+                    memcpy(&t, offsets + i * sizeof(uint32_t), sizeof(uint32_t));
+                    if (t < lo || t >= hi) continue;
+                }
+                int32_t id;
+                memcpy(&id, columns + i * sizeof(int32_t), sizeof(int32_t));
+                ++counts[id];
+            }
+        }
+    }
+
+public:
+    explicit EventLog(const string& directory) : dir(directory) {}
+
+    string lockFilename() const { return dir + "/events.lock"; }
+
+    // Load the subject dictionary (a missing file means an empty log)
+    void load() {
+        subjects.clear();
+        ifstream inFile(subjectsFilename());
+        string line;
+        while (getline(inFile, line)) {
+            if (!line.empty()) subjects.push_back(line);
+        }
+    }
+
+    const vector<string>& getSubjects() const {
+        return subjects;
+    }
+
+    // Index of a subject in the dictionary, optionally adding it; -1 if absent or full
+    int subjectIndex(const string& subject, bool create) {
+        auto it = find(subjects.begin(), subjects.end(), subject);
+        if (it != subjects.end()) return static_cast<int>(it - subjects.begin());
+        if (!create || subjects.size() >= MAX_SUBJECTS) return -1;
+        subjects.push_back(subject);
+        if (!saveSubjects()) {
+            subjects.pop_back();
+            return -1;
+        }
+        return static_cast<int>(subjects.size()) - 1;
+    }
+
+    // Append events, one block per day touched
+    bool append(vector<Event>& events) {
+        map<int64_t, vector<Event>> byDay;
+        for (const auto& event : events) {
+            byDay[floorDiv(event.time, SECONDS_PER_DAY)].push_back(event);
+        }
+        bool ok = true;
+        for (auto& [day, dayEvents] : byDay) {
+            ok = appendBlock(day, dayEvents) && ok;
+        }
+        return ok;
+    }
+
+    // Per-student event counts in [from, to) for a subject (-1 for every subject)
+    unordered_map<int, int> countEvents(int64_t from, int64_t to, int subject) const {
+        vector<pair<int64_t, string>> partitions;
+        if (filesystem::is_directory(dir)) {
+            for (const auto& entry : filesystem::directory_iterator(dir)) {
+                int64_t day;
+                if (!partitionDay(entry.path(), day)) continue;
+                // Partition pruning: the day [day, day + 1) must overlap [from, to)
+                if (day * SECONDS_PER_DAY >= to || (day + 1) * SECONDS_PER_DAY <= from) continue;
+                partitions.push_back({day, entry.path().string()});
+            }
+        }
+
+        // The CRC table is filled lazily; fill it before the scan threads share it
+        wal_detail::crc32(nullptr, 0);
+
+        size_t numThreads = min<size_t>(partitions.size(), max(1u, thread::hardware_concurrency()));
+        vector<unordered_map<int, int>> partial(numThreads);
+        atomic<size_t> next(0);
+        vector<thread> workers;
+        for (size_t t = 0; t < numThreads; ++t) {
+            workers.emplace_back([&, t]() {
+                for (size_t p = next++; p < partitions.size(); p = next++) {
+                    scanPartition(partitions[p].second, partitions[p].first, from, to, subject, partial[t]);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        unordered_map<int, int> counts;
+        for (auto& part : partial) {
+            if (counts.empty()) {
+                counts.swap(part);
+                continue;
+            }
+            for (const auto& [id, count] : part) {
+                counts[id] += count;
+            }
+        }
+        return counts;
+    }
+};
+
+#endif // ATTENDANCE_EVENTS_H
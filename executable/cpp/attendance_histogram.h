@@ -0,0 +1,309 @@
+// Dense histogram backend for the attendance index.
+//
+// Attendance values are small bounded integers, so instead of a balanced
+// pointer tree this keeps one bucket of student IDs per attendance value.
+// On disk the buckets are stored as prefix counts (offsets) plus one
+// contiguous ID array, which doubles as the prefix-count table used by the
+// count / k-th / rank queries.
+//
+// Selected at build time with -DATTENDANCE_HISTOGRAM; create_avl, update_avl
+// and threshold must all be built with the same backend. Include after
+// defining MAX_ATTENDANCE.
+
+#ifndef ATTENDANCE_HISTOGRAM_H
+#define ATTENDANCE_HISTOGRAM_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+using namespace std;
+
+class AttendanceHistogram {
+private:
+    static constexpr uint32_t MAGIC = 0x54534841;  // "AHST"
+
+    vector<vector<int>> buckets;              // buckets[a] = student IDs with attendance a
+    vector<uint32_t> offsets;                 // offsets[a] = number of IDs with attendance < a
+    vector<int> ids;                          // IDs in ascending attendance order (read-only loads)
+    unordered_map<int, pair<int, size_t>> slotOf;  // Student ID -> (attendance, position in bucket)
+    bool bucketsLoaded;                       // buckets/slotOf are valid
+    bool offsetsValid;                        // offsets/ids reflect the buckets
+
+    int numBuckets() const {
+        return static_cast<int>(offsets.size()) - 1;
+    }
+
+    // Expand the contiguous ID array into per-value buckets for updates
+    void loadBuckets() {
+        if (bucketsLoaded) return;
+        buckets.assign(numBuckets(), {});
+        slotOf.clear();
+        for (int a = 0; a < numBuckets(); ++a) {
+            for (uint32_t i = offsets[a]; i < offsets[a + 1]; ++i) {
+                slotOf[ids[i]] = {a, buckets[a].size()};
+                buckets[a].push_back(ids[i]);
+            }
+        }
+        bucketsLoaded = true;
+    }
+
+    // Recompute prefix counts and the contiguous ID array from the buckets
+    void rebuildOffsets() {
+        if (offsetsValid) return;
+        ids.clear();
+        for (int a = 0; a < numBuckets(); ++a) {
+            offsets[a] = static_cast<uint32_t>(ids.size());
+            ids.insert(ids.end(), buckets[a].begin(), buckets[a].end());
+        }
+        offsets[numBuckets()] = static_cast<uint32_t>(ids.size());
+        offsetsValid = true;
+    }
+
+    // Remove a student from its bucket in O(1) by swapping in the last ID
+    void removeFromBucket(int attendance, size_t slot) {
+        vector<int>& bucket = buckets[attendance];
+        int moved = bucket.back();
+        bucket[slot] = moved;
+        slotOf[moved].second = slot;
+        bucket.pop_back();
+    }
+
+    // Bytes between the read position and the end of the file
+    static size_t bytesLeft(ifstream& inFile) {
+        streampos here = inFile.tellg();
+        inFile.seekg(0, ios::end);
+        streampos end = inFile.tellg();
+        inFile.seekg(here);
+        return end > here ? static_cast<size_t>(end - here) : 0;
+    }
+
+    // Clamp a query range to the bucket range
+    bool clampRange(int& lo, int& hi) const {
+        lo = max(lo, 0);
+        hi = min(hi, numBuckets() - 1);
+        return lo <= hi;
+    }
+
+public:
+    AttendanceHistogram()
+        : buckets(MAX_ATTENDANCE + 1), offsets(MAX_ATTENDANCE + 2, 0),
+          bucketsLoaded(true), offsetsValid(true) {}
+
+    // Insert a student ID (ignores duplicates with the same attendance)
+    void insert(int attendance, int studentId) {
+        updateAttendance(studentId, attendance);
+    }
+
+    // Insert (attendance, student ID) entries in order, as create_avl --csv
+    // builds every backend
+    void build(const vector<pair<int, int>>& entries) {
+        for (const auto& [attendance, studentId] : entries) {
+            insert(attendance, studentId);
+        }
+    }
+
+    // Move a student to a new attendance bucket; returns whether it already existed
+    bool updateAttendance(int studentId, int newAttendance) {
+        loadBuckets();
+        auto it = slotOf.find(studentId);
+        bool studentFound = it != slotOf.end();
+
+        if (studentFound) {
+            if (it->second.first == newAttendance) {
+                return true;
+            }
+            removeFromBucket(it->second.first, it->second.second);
+        }
+
+        slotOf[studentId] = {newAttendance, buckets[newAttendance].size()};
+        buckets[newAttendance].push_back(studentId);
+        offsetsValid = false;
+
+        return studentFound;
+    }
+
+    // Remove a student from its bucket; returns whether it was there
+    bool removeStudent(int studentId) {
+        loadBuckets();
+        auto it = slotOf.find(studentId);
+        if (it == slotOf.end()) {
+            return false;
+        }
+
+        removeFromBucket(it->second.first, it->second.second);
+        slotOf.erase(studentId);
+        offsetsValid = false;
+        return true;
+    }
+
+    // Deserialize the histogram from a binary file
+    bool deserialize(const string& filename, bool withIndex = false) {
+        (void)withIndex;  // IDs are always loaded contiguously
+        ifstream inFile(filename, ios::binary);
+        if (!inFile) {
+            cerr << "Error opening file for reading: " << filename << endl;
+            return false;
+        }
+
+        uint32_t magic, fileBuckets;
+        inFile.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+        inFile.read(reinterpret_cast<char*>(&fileBuckets), sizeof(uint32_t));
+        if (!inFile || magic != MAGIC || fileBuckets == 0) {
+            cerr << "Not a histogram attendance index: " << filename << endl;
+            return false;
+        }
+
+        // Reject sizes the file cannot hold before allocating for them
+        size_t numOffsets = static_cast<size_t>(fileBuckets) + 1;
+        if (numOffsets > bytesLeft(inFile) / sizeof(uint32_t)) {
+            cerr << "Truncated histogram attendance index: " << filename << endl;
+            return false;
+        }
+        offsets.assign(max<size_t>(numOffsets, static_cast<size_t>(MAX_ATTENDANCE) + 2), 0);
+        inFile.read(reinterpret_cast<char*>(offsets.data()), numOffsets * sizeof(uint32_t));
+        for (size_t a = numOffsets; a < offsets.size(); ++a) {
+            offsets[a] = offsets[numOffsets - 1];
+        }
+
+        // Offsets are prefix counts: they start at zero and never decrease
+        bool ordered = static_cast<bool>(inFile) && offsets[0] == 0;
+        for (size_t a = 1; ordered && a < numOffsets; ++a) {
+            ordered = offsets[a - 1] <= offsets[a];
+        }
+        if (!ordered || offsets.back() > bytesLeft(inFile) / sizeof(int)) {
+            cerr << "Corrupt histogram attendance index: " << filename << endl;
+            return false;
+        }
+
+        ids.resize(offsets.back());
+        if (!ids.empty()) {
+            inFile.read(reinterpret_cast<char*>(ids.data()), ids.size() * sizeof(int));
+        }
+        if (!inFile) {
+            cerr << "Truncated histogram attendance index: " << filename << endl;
+            return false;
+        }
+
+        bucketsLoaded = false;
+        offsetsValid = true;
+        return true;
+    }
+
+    // Serialize the histogram as prefix counts followed by the ID array
+    bool serialize(const string& filename) {
+        rebuildOffsets();
+        ofstream outFile(filename, ios::binary);
+        if (!outFile) {
+            cerr << "Error opening file for writing: " << filename << endl;
+            return false;
+        }
+
+        uint32_t fileBuckets = static_cast<uint32_t>(numBuckets());
+        outFile.write(reinterpret_cast<const char*>(&MAGIC), sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(&fileBuckets), sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+        if (!ids.empty()) {
+            outFile.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(int));
+        }
+        outFile.close();
+        if (!outFile) {
+            cerr << "Error writing " << filename << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Get student IDs with attendance in [lo, hi] in descending order of attendance
+    vector<int> getStudentIdsInRange(int lo, int hi, size_t limit = 0) {
+        rebuildOffsets();
+        vector<int> result;
+        if (!clampRange(lo, hi)) return result;
+
+        for (int a = hi; a >= lo; --a) {
+            for (uint32_t i = offsets[a]; i < offsets[a + 1]; ++i) {
+                if (limit > 0 && result.size() >= limit) return result;
+                result.push_back(ids[i]);
+            }
+        }
+        return result;
+    }
+
+    // Total number of student IDs
+    int size() {
+        rebuildOffsets();
+        return static_cast<int>(ids.size());
+    }
+
+    // Number of student IDs with attendance in [lo, hi]
+    int countInRange(int lo, int hi) {
+        rebuildOffsets();
+        if (!clampRange(lo, hi)) return 0;
+        return static_cast<int>(offsets[hi + 1] - offsets[lo]);
+    }
+
+    // Find the k-th smallest (direction -1) or k-th largest (direction 1) entry, 1-based
+    bool kthStudent(int k, int direction, int& studentId, int& attendance) {
+        rebuildOffsets();
+        if (k < 1 || k > size()) return false;
+        uint32_t position = direction > 0 ? static_cast<uint32_t>(size() - k) : static_cast<uint32_t>(k - 1);
+
+        studentId = ids[position];
+        attendance = static_cast<int>(upper_bound(offsets.begin(), offsets.end(), position) - offsets.begin()) - 1;
+        return true;
+    }
+
+    // Look up a student's attendance
+    bool findAttendance(int studentId, int& attendance) {
+        if (bucketsLoaded) {
+            auto it = slotOf.find(studentId);
+            if (it == slotOf.end()) return false;
+            attendance = it->second.first;
+            return true;
+        }
+
+        // Read-only loads skip the ID map; one pass over the contiguous array suffices
+        auto it = find(ids.begin(), ids.end(), studentId);
+        if (it == ids.end()) return false;
+        uint32_t position = static_cast<uint32_t>(it - ids.begin());
+        attendance = static_cast<int>(upper_bound(offsets.begin(), offsets.end(), position) - offsets.begin()) - 1;
+        return true;
+    }
+
+    // (attendance, student ID) pairs in ascending attendance order, for the read snapshot
+    vector<pair<int, int>> getEntries() {
+        rebuildOffsets();
+        vector<pair<int, int>> entries;
+        entries.reserve(ids.size());
+        for (int a = 0; a < numBuckets(); ++a) {
+            for (uint32_t i = offsets[a]; i < offsets[a + 1]; ++i) {
+                entries.push_back({a, ids[i]});
+            }
+        }
+        return entries;
+    }
+
+    // Print the histogram in ascending attendance order - for debugging purposes
+    void printTree() {
+        rebuildOffsets();
+        cout << "Attendance histogram:" << endl;
+        for (int a = 0; a < numBuckets(); ++a) {
+            if (offsets[a] == offsets[a + 1]) continue;
+            cout << "Attendance: " << a << ", Student IDs: ";
+            for (uint32_t i = offsets[a]; i < offsets[a + 1]; ++i) {
+                cout << ids[i];
+                if (i + 1 < offsets[a + 1]) {
+                    cout << ", ";
+                }
+            }
+            cout << endl;
+        }
+    }
+};
+
+#endif // ATTENDANCE_HISTOGRAM_H
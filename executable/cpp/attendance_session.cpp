@@ -0,0 +1,573 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+#include <thread>
+#include <ctime>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+
+#include "bounded_queue.h"
+#include "face_gallery.h"
+#include "gallery_index.h"
+#include "face_tracks.h"
+#include "attendance_store.h"
+#include "attendance_events.h"
+#include "metrics.h"
+
+using namespace std;
+
+// Streaming lecture sessions: probe descriptors tagged with a session id go
+// in on stdin, and every session comes out with its attendance marked once
+// per student and its absentees listed.
+//
+//   capture (main thread)  reads lines, tags probes with their session
+//        | capture queue (bounded, lock-free)      only with --track-window
+//   track (one thread)     groups each session's probes into face tracks
+//                          and passes on one centroid per track
+//        | probe queue (bounded, lock-free)
+//   match (worker pool)    parses the descriptor and searches the gallery
+//        | result queue (bounded, lock-free)
+//   collect (one thread)   keeps the set of students present per session; on
+//                          close, applies all marks to the attendance store
+//                          in one batch and prints roster minus present
+//
+// Capture only splits off the session id, so a burst of faces at the start of
+// class fills the probe queue instead of waiting for matches. Opens and closes
+// travel through the result queue behind the probes submitted before them; a
+// close carries its probe count, and the collector finishes the session once
+// that many results have arrived. With tracking, closes go through the track
+// stage instead, which ends the session's tracks before passing the close on.
+
+metrics::Phase parsePhase("parse");
+metrics::Phase trackPhase("track");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Phase syncPhase("sync");
+metrics::Phase outputPhase("output");
+metrics::Counter probesCaptured("probes_captured");
+metrics::Counter tracksFormed("tracks_formed");
+metrics::Counter probesMatched("probes_matched");
+metrics::Counter duplicateProbes("duplicate_probes");
+metrics::Counter rowsScanned("rows_scanned");
+metrics::Counter dimensionsEvaluated("dimensions_evaluated");  // Over rows_scanned: the average per row
+metrics::Counter marksWritten("marks_written");
+
+const size_t QUEUE_CAPACITY = 4096;
+
+struct Probe {
+    enum Kind { Face, Close } kind = Face;  // Close only travels the capture queue
+    uint32_t session = 0;
+    int64_t time = 0;        // Unix seconds of capture
+    double frameTime = 0;    // Seconds, from t=<seconds> or the arrival time
+    string descriptor;       // The comma or space separated values after the session id
+    vector<double> values;   // A track centroid, already parsed
+};
+
+struct Message {
+    enum Kind { Open, Result, Close } kind = Result;
+    uint32_t session = 0;
+    int studentId = -1;       // Result: matched student, or -1
+    int64_t time = 0;         // Result: capture time
+    string name;              // Open: session id
+    string subject;           // Open: subject
+    size_t expectedResults = 0;  // Close: probes submitted to the session
+};
+
+struct SessionState {
+    string name;
+    string subject;
+    unordered_map<int, int64_t> present;  // Student ID -> first capture time
+    size_t results = 0;
+    size_t unmatched = 0;
+    bool closing = false;
+    size_t expectedResults = 0;
+};
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " <students_csv> <store_file> [--events <event_dir>] [--workers <n>]" << endl;
+    cerr << "       [--track-window <seconds> [--track-distance <d>]] [--index <index_file>]" << endl;
+    cerr << "  stdin:  open <session_id> <subject>" << endl;
+    cerr << "          <session_id> [t=<seconds>] <v1> ... <v128>   (one probe descriptor)" << endl;
+    cerr << "          close <session_id>" << endl;
+    cerr << "  stdout on close: <session_id> present <n> absent <m> unmatched <k>" << endl;
+    cerr << "                   <session_id> absent <student_id> ..." << endl;
+    cerr << "  Sessions still open at the end of input are closed." << endl;
+    cerr << "  students_csv may also be a compiled gallery (gallery compile)." << endl;
+    cerr << "  --track-window: match one averaged descriptor per face track instead of every frame;" << endl;
+    cerr << "  frames within the window and track distance (default " << TRACK_DISTANCE << ") form a track" << endl;
+    cerr << "  --index: search the gallery through its index (gallery index) instead of scanning it;" << endl;
+    cerr << "  the index finds the nearest student exactly, where the scan stops at the first close one" << endl;
+}
+
+bool parseDescriptor(const string& text, vector<double>& values) {
+    values.clear();
+    const char* p = text.c_str();
+    char* end;
+    for (;;) {
+        while (*p == ' ' || *p == ',' || *p == '\t' || *p == '\r') ++p;
+        if (!*p) return !values.empty();
+        double value = strtod(p, &end);
+        if (end == p) return false;
+        values.push_back(value);
+        p = end;
+    }
+}
+
+class SessionPipeline {
+private:
+    const FaceGallery& gallery;
+    const GalleryIndex* index;  // Null: scan the gallery
+    const string storeFilename;
+    const string eventDir;
+    vector<int> roster;  // Sorted gallery student IDs
+
+    const double trackWindow;  // Negative: match every probe
+    const double trackDistance;
+
+    BoundedQueue<Probe> captured;
+    BoundedQueue<Probe> probes;
+    BoundedQueue<Message> messages;
+    atomic<bool> captureDone;
+    atomic<bool> inputDone;
+    atomic<int> matchersRunning;
+    bool failed;
+
+    bool tracking() const {
+        return trackWindow >= 0;
+    }
+
+    void track() {
+        // Session handle -> (tracker, centroids submitted)
+        unordered_map<uint32_t, pair<FaceTracker, size_t>> sessions;
+        Probe probe;
+        vector<double> values;
+        vector<TrackCentroid> ended;
+        Backoff backoff;
+        auto submit = [&](uint32_t session, size_t& submitted) {
+            for (auto& track : ended) {
+                Probe centroid;
+                centroid.session = session;
+                centroid.time = track.firstCaptureTime;
+                centroid.values = move(track.centroid);
+                ++submitted;
+                tracksFormed.add();
+                probes.push(move(centroid));
+            }
+            ended.clear();
+        };
+
+        for (;;) {
+            if (!captured.tryPop(probe)) {
+                if (!captureDone.load(memory_order_acquire)) {
+                    backoff.pause();
+                    continue;
+                }
+                if (!captured.tryPop(probe)) break;
+            }
+            backoff.reset();
+
+            auto it = sessions.try_emplace(probe.session, FaceTracker(trackWindow, trackDistance), 0).first;
+            FaceTracker& tracker = it->second.first;
+            if (probe.kind == Probe::Close) {
+                tracker.flush(ended);
+                submit(probe.session, it->second.second);
+                Message close;
+                close.kind = Message::Close;
+                close.session = probe.session;
+                close.expectedResults = it->second.second;
+                messages.push(move(close));
+                sessions.erase(it);
+                continue;
+            }
+
+            {
+                metrics::ScopedTimer trackTimer(trackPhase);
+                if (parseDescriptor(probe.descriptor, values)) {
+                    tracker.add(values, probe.frameTime, probe.time, ended);
+                } else {
+                    cerr << "Warning: skipping malformed probe" << endl;
+                }
+            }
+            submit(probe.session, it->second.second);
+        }
+        inputDone.store(true, memory_order_release);
+    }
+
+    void match() {
+        Probe probe;
+        vector<double> values;
+        Backoff backoff;
+        for (;;) {
+            if (!probes.tryPop(probe)) {
+                // Every probe is pushed before inputDone is set, so one more
+                // pop after seeing it set cannot miss any
+                if (!inputDone.load(memory_order_acquire)) {
+                    backoff.pause();
+                    continue;
+                }
+                if (!probes.tryPop(probe)) break;
+            }
+            backoff.reset();
+
+            Message result;
+            result.session = probe.session;
+            result.time = probe.time;
+            size_t scanned = 0, dimensions = 0;
+            {
+                metrics::ScopedTimer computeTimer(computePhase);
+                const vector<double>* descriptor = &probe.values;
+                if (probe.values.empty()) {
+                    descriptor = parseDescriptor(probe.descriptor, values) ? &values : nullptr;
+                }
+                if (descriptor && index) {
+                    // The index scores every template it visits in full
+                    result.studentId = static_cast<int>(index->nearest(*descriptor, MATCH_DISTANCE, &scanned));
+                    dimensions = scanned * gallery.getDimension();
+                } else if (descriptor) {
+                    result.studentId =
+                        static_cast<int>(gallery.nearest(*descriptor, MATCH_DISTANCE, &scanned, &dimensions));
+                } else {
+                    cerr << "Warning: skipping malformed probe" << endl;
+                }
+            }
+            rowsScanned.add(scanned);
+            dimensionsEvaluated.add(dimensions);
+            probesMatched.add();
+            messages.push(move(result));
+        }
+        matchersRunning.fetch_sub(1, memory_order_release);
+    }
+
+    // Add one mark per present student to the store (and the event log)
+    bool applyMarks(const SessionState& session, const vector<int>& present) {
+        metrics::ScopedTimer serializeTimer(serializePhase);
+        WriteAheadLog wal(storeFilename + ".wal");
+        {
+            FileLock lock(storeFilename + ".lock", true);
+            AttendanceStore store;
+            if (!lock.isLocked() || !loadStore(store, wal, storeFilename, true)) {
+                cerr << "Failed to load the attendance store from " << storeFilename << endl;
+                return false;
+            }
+            for (int studentId : present) {
+                int subjectValue, totalValue;
+                if (!store.increment(session.subject, studentId, 1, subjectValue, totalValue)) {
+                    cerr << "Warning: student " << studentId << " is not in the attendance store" << endl;
+                    continue;
+                }
+                wal.append(store.encodeIncrement(session.subject, studentId, 1));
+                marksWritten.add();
+            }
+            if (!wal.flush()) {
+                cerr << "Error appending to the write-ahead log of " << storeFilename << endl;
+                return false;
+            }
+            if (wal.size() >= CHECKPOINT_BYTES && !checkpoint(store, wal, storeFilename)) {
+                cerr << "Warning: checkpoint of " << storeFilename << " failed" << endl;
+            }
+        }
+
+        if (!eventDir.empty()) {
+            EventLog log(eventDir);
+            error_code ec;
+            filesystem::create_directories(eventDir, ec);
+            FileLock lock(log.lockFilename(), true);
+            if (!lock.isLocked()) {
+                cerr << "Failed to lock " << log.lockFilename() << endl;
+                return false;
+            }
+            log.load();
+            int subjectIdx = log.subjectIndex(session.subject, true);
+            if (subjectIdx < 0) {
+                cerr << "Failed to add subject " << session.subject << " to the event log" << endl;
+                return false;
+            }
+            vector<Event> events;
+            for (int studentId : present) {
+                events.push_back({studentId, static_cast<uint8_t>(subjectIdx), session.present.at(studentId)});
+            }
+            if (!events.empty() && !log.append(events)) {
+                return false;
+            }
+        }
+        serializeTimer.stop();
+
+        // Group commit outside the store lock, as in attendance_store
+        metrics::ScopedTimer syncTimer(syncPhase);
+        if (!wal.sync()) {
+            cerr << "Error syncing the write-ahead log of " << storeFilename << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void finish(const SessionState& session) {
+        vector<int> present;
+        present.reserve(session.present.size());
+        for (const auto& entry : session.present) {
+            present.push_back(entry.first);
+        }
+        sort(present.begin(), present.end());
+
+        if (!applyMarks(session, present)) {
+            cerr << "Failed to record attendance for session " << session.name << endl;
+            failed = true;
+        }
+
+        vector<int> absent;
+        set_difference(roster.begin(), roster.end(), present.begin(), present.end(), back_inserter(absent));
+
+        metrics::ScopedTimer outputTimer(outputPhase);
+        cout << session.name << " present " << present.size() << " absent " << absent.size()
+             << " unmatched " << session.unmatched << '\n';
+        cout << session.name << " absent";
+        for (int id : absent) {
+            cout << " " << id;
+        }
+        cout << endl;
+    }
+
+    void collect() {
+        unordered_map<uint32_t, SessionState> sessions;
+        Message message;
+        Backoff backoff;
+        for (;;) {
+            if (!messages.tryPop(message)) {
+                if (matchersRunning.load(memory_order_acquire) > 0) {
+                    backoff.pause();
+                    continue;
+                }
+                if (!messages.tryPop(message)) break;
+            }
+            backoff.reset();
+
+            auto it = sessions.find(message.session);
+            if (message.kind == Message::Open) {
+                SessionState& session = sessions[message.session];
+                session.name = message.name;
+                session.subject = message.subject;
+                continue;
+            }
+            if (it == sessions.end()) continue;
+            SessionState& session = it->second;
+
+            if (message.kind == Message::Result) {
+                ++session.results;
+                if (message.studentId < 0) {
+                    ++session.unmatched;
+                } else if (!session.present.emplace(message.studentId, message.time).second) {
+                    duplicateProbes.add();  // Already counted in this session
+                }
+            } else {
+                session.closing = true;
+                session.expectedResults = message.expectedResults;
+            }
+
+            if (session.closing && session.results == session.expectedResults) {
+                finish(session);
+                sessions.erase(it);
+            }
+        }
+    }
+
+public:
+    SessionPipeline(const FaceGallery& faces, const GalleryIndex* galleryIndex, const string& storeFile,
+                    const string& eventDirectory, double window, double distance)
+        : gallery(faces), index(galleryIndex), storeFilename(storeFile), eventDir(eventDirectory), trackWindow(window),
+          trackDistance(distance), captured(QUEUE_CAPACITY), probes(QUEUE_CAPACITY), messages(QUEUE_CAPACITY),
+          captureDone(false), inputDone(false), matchersRunning(0), failed(false) {
+        roster.assign(gallery.getStudentIds().begin(), gallery.getStudentIds().end());
+        sort(roster.begin(), roster.end());
+    }
+
+    // Run the pipeline over the lines of in; false if any session failed to record
+    bool run(istream& in, const vector<string>& subjects, unsigned workers) {
+        matchersRunning.store(static_cast<int>(workers));
+        vector<thread> matchers;
+        for (unsigned i = 0; i < workers; ++i) {
+            matchers.emplace_back(&SessionPipeline::match, this);
+        }
+        thread collector(&SessionPipeline::collect, this);
+        thread tracker;
+        if (tracking()) {
+            tracker = thread(&SessionPipeline::track, this);
+        }
+
+        // Capture: session ids of open sessions -> (handle, probes submitted)
+        unordered_map<string, pair<uint32_t, size_t>> open;
+        uint32_t nextHandle = 0;
+        auto close = [&](unordered_map<string, pair<uint32_t, size_t>>::iterator it) {
+            if (tracking()) {
+                Probe probe;
+                probe.kind = Probe::Close;
+                probe.session = it->second.first;
+                captured.push(move(probe));
+            } else {
+                Message message;
+                message.kind = Message::Close;
+                message.session = it->second.first;
+                message.expectedResults = it->second.second;
+                messages.push(move(message));
+            }
+            open.erase(it);
+        };
+        auto started = chrono::steady_clock::now();
+
+        string line;
+        while (getline(in, line)) {
+            metrics::ScopedTimer parseTimer(parsePhase);
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == string::npos) continue;
+            size_t end = line.find_first_of(" \t\r", start);
+            string first = line.substr(start, end == string::npos ? string::npos : end - start);
+            string rest = end == string::npos ? "" : line.substr(end);
+
+            if (first == "open" || first == "close") {
+                istringstream fields(rest);
+                string sessionId, subject;
+                fields >> sessionId >> subject;
+                auto it = open.find(sessionId);
+                if (first == "close") {
+                    if (it == open.end()) {
+                        cerr << "Warning: close of unknown session " << sessionId << endl;
+                    } else {
+                        close(it);
+                    }
+                    continue;
+                }
+                if (sessionId.empty() || it != open.end() || subject == TOTAL_SUBJECT ||
+                    find(subjects.begin(), subjects.end(), subject) == subjects.end()) {
+                    cerr << "Warning: cannot open session '" << sessionId << "' for subject '" << subject << "'" << endl;
+                    continue;
+                }
+                Message message;
+                message.kind = Message::Open;
+                message.session = nextHandle;
+                message.name = sessionId;
+                message.subject = subject;
+                messages.push(move(message));
+                open[sessionId] = {nextHandle++, 0};
+                continue;
+            }
+
+            auto it = open.find(first);
+            if (it == open.end()) {
+                cerr << "Warning: probe for unknown session " << first << endl;
+                continue;
+            }
+            Probe probe;
+            probe.session = it->second.first;
+            probe.time = static_cast<int64_t>(std::time(nullptr));
+            size_t valuesStart = rest.find_first_not_of(" \t");
+            if (valuesStart != string::npos && rest.compare(valuesStart, 2, "t=") == 0) {
+                // Frame time given by the source; the values follow it
+                char* timeEnd;
+                probe.frameTime = strtod(rest.c_str() + valuesStart + 2, &timeEnd);
+                rest.erase(0, static_cast<size_t>(timeEnd - rest.c_str()));
+            } else {
+                probe.frameTime = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            }
+            probe.descriptor = move(rest);
+            probesCaptured.add();
+            parseTimer.stop();
+            if (tracking()) {
+                captured.push(move(probe));
+            } else {
+                ++it->second.second;
+                probes.push(move(probe));
+            }
+        }
+
+        while (!open.empty()) {
+            close(open.begin());
+        }
+        if (tracking()) {
+            captureDone.store(true, memory_order_release);
+            tracker.join();
+        } else {
+            inputDone.store(true, memory_order_release);
+        }
+
+        for (auto& matcher : matchers) {
+            matcher.join();
+        }
+        collector.join();
+        return !failed;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Probe lines are long; stdio-synced getline would dominate capture
+    ios::sync_with_stdio(false);
+
+    const string studentsFilename = argv[1];
+    const string storeFilename = argv[2];
+    string eventDir;
+    unsigned workers = max(1u, thread::hardware_concurrency());
+    double trackWindow = -1;
+    double trackDistance = TRACK_DISTANCE;
+    string indexFilename;
+    for (int i = 3; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--events" && i + 1 < argc) {
+            eventDir = argv[++i];
+        } else if (option == "--index" && i + 1 < argc) {
+            indexFilename = argv[++i];
+        } else if (option == "--workers" && i + 1 < argc) {
+            try {
+                workers = static_cast<unsigned>(max(1, stoi(argv[++i])));
+            } catch (const exception& e) {
+                cerr << "Error parsing arguments: " << e.what() << endl;
+                return 1;
+            }
+        } else if ((option == "--track-window" || option == "--track-distance") && i + 1 < argc) {
+            try {
+                (option == "--track-window" ? trackWindow : trackDistance) = stod(argv[++i]);
+            } catch (const exception& e) {
+                cerr << "Error parsing arguments: " << e.what() << endl;
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    FaceGallery gallery;
+    GalleryIndex index;
+    vector<string> subjects;
+    {
+        metrics::ScopedTimer parseTimer(parsePhase);
+        if (!gallery.load(studentsFilename)) {
+            return 1;
+        }
+        if (!indexFilename.empty() && !index.load(indexFilename, gallery)) {
+            return 1;
+        }
+
+        // Sessions may only mark subjects the store knows
+        AttendanceStore store;
+        WriteAheadLog wal(storeFilename + ".wal");
+        FileLock lock(storeFilename + ".lock", false);
+        if (!lock.isLocked() || !loadStore(store, wal, storeFilename, false)) {
+            cerr << "Failed to load the attendance store from " << storeFilename << endl;
+            return 1;
+        }
+        subjects = store.getSubjects();
+    }
+
+    SessionPipeline pipeline(gallery, indexFilename.empty() ? nullptr : &index, storeFilename, eventDir, trackWindow, trackDistance);
+    return pipeline.run(cin, subjects, workers) ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+// Read-optimized, memory-mapped snapshot of one subject's attendance index.
+//
+// File layout (all fields 4 bytes, native endianness):
+//   header:   uint32 magic = "AEYT", uint32 version, uint32 numKeys, uint32 numIds
+//   eytKeys:  int32[numKeys + 1]   distinct attendance values in Eytzinger (BFS) order, slot 0 unused
+//   eytRank:  uint32[numKeys + 1]  sorted position of the key in each Eytzinger slot
+//   keys:     int32[numKeys]       distinct attendance values, ascending
+//   offsets:  uint32[numKeys + 1]  offsets[r] = number of IDs with attendance < keys[r]
+//   ids:      int32[numIds]        student IDs in ascending attendance order
+//   indexIds: int32[numIds]        student IDs, ascending
+//   indexAtt: int32[numIds]        attendance of indexIds[i]
+//
+// threshold maps the file read-only and answers every query straight from
+// the mapping: no allocation, no deserialization, and concurrent readers
+// share the same page-cache pages. Writers always replace the file by
+// rename, so a reader keeps its complete old mapping until it exits.
+//
+// create_avl and update_avl write <subject>.snap next to <subject>.dat.
+
+#ifndef ATTENDANCE_SNAPSHOT_H
+#define ATTENDANCE_SNAPSHOT_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+const uint32_t SNAPSHOT_MAGIC = 0x54594541;  // "AEYT"
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// <dir>/<subject>.dat -> <dir>/<subject>.snap
+inline string snapshotFilename(const string& datFilename) {
+    const string extension = ".dat";
+    if (datFilename.size() >= extension.size() &&
+        datFilename.compare(datFilename.size() - extension.size(), extension.size(), extension) == 0) {
+        return datFilename.substr(0, datFilename.size() - extension.size()) + ".snap";
+    }
+    return datFilename + ".snap";
+}
+
+// Whether a file starts with the snapshot magic
+inline bool isSnapshotFile(const string& filename) {
+    ifstream inFile(filename, ios::binary);
+    uint32_t magic = 0;
+    inFile.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+    return inFile && magic == SNAPSHOT_MAGIC;
+}
+
+namespace snapshot_detail {
+
+// Lay out sorted keys in Eytzinger order by an in-order walk of the implicit tree
+inline void fillEytzinger(const vector<int>& keys, vector<int>& eytKeys, vector<uint32_t>& eytRank,
+                          size_t& next, size_t slot) {
+    if (slot > keys.size()) return;
+    fillEytzinger(keys, eytKeys, eytRank, next, 2 * slot);
+    eytKeys[slot] = keys[next];
+    eytRank[slot] = static_cast<uint32_t>(next);
+    ++next;
+    fillEytzinger(keys, eytKeys, eytRank, next, 2 * slot + 1);
+}
+
+template <typename T>
+void writeArray(ofstream& outFile, const vector<T>& values) {
+    if (!values.empty()) {
+        outFile.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+}
+
+} // namespace snapshot_detail
+
+// Write a snapshot from (attendance, student ID) pairs in ascending attendance order.
+// The file is written next to the target and renamed over it, never truncated in
+// place: truncating a file that readers have mapped would fault their next access.
+inline bool writeSnapshot(const string& filename, const vector<pair<int, int>>& entries) {
+    vector<int> keys, ids;
+    vector<uint32_t> offsets;
+    for (const auto& entry : entries) {
+        if (keys.empty() || keys.back() != entry.first) {
+            keys.push_back(entry.first);
+            offsets.push_back(static_cast<uint32_t>(ids.size()));
+        }
+        ids.push_back(entry.second);
+    }
+    offsets.push_back(static_cast<uint32_t>(ids.size()));
+
+    vector<int> eytKeys(keys.size() + 1, INT_MIN);
+    vector<uint32_t> eytRank(keys.size() + 1, 0);
+    size_t next = 0;
+    snapshot_detail::fillEytzinger(keys, eytKeys, eytRank, next, 1);
+
+    vector<pair<int, int>> byId;
+    byId.reserve(entries.size());
+    for (const auto& entry : entries) {
+        byId.push_back({entry.second, entry.first});
+    }
+    sort(byId.begin(), byId.end());
+    vector<int> indexIds, indexAtt;
+    for (const auto& entry : byId) {
+        indexIds.push_back(entry.first);
+        indexAtt.push_back(entry.second);
+    }
+
+    const string tmpFilename = filename + ".tmp";
+    ofstream outFile(tmpFilename, ios::binary);
+    if (!outFile) {
+        cerr << "Error opening file for writing: " << tmpFilename << endl;
+        return false;
+    }
+
+    uint32_t header[4] = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION,
+                          static_cast<uint32_t>(keys.size()), static_cast<uint32_t>(ids.size())};
+    outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+    snapshot_detail::writeArray(outFile, eytKeys);
+    snapshot_detail::writeArray(outFile, eytRank);
+    snapshot_detail::writeArray(outFile, keys);
+    snapshot_detail::writeArray(outFile, offsets);
+    snapshot_detail::writeArray(outFile, ids);
+    snapshot_detail::writeArray(outFile, indexIds);
+    snapshot_detail::writeArray(outFile, indexAtt);
+    outFile.close();
+    if (!outFile) {
+        cerr << "Error writing snapshot: " << tmpFilename << endl;
+        remove(tmpFilename.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    bool replaced = MoveFileExA(tmpFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool replaced = rename(tmpFilename.c_str(), filename.c_str()) == 0;
+#endif
+    if (!replaced) {
+        cerr << "Error replacing " << filename << endl;
+        remove(tmpFilename.c_str());
+    }
+    return replaced;
+}
+
+class AttendanceSnapshot {
+private:
+    const char* data;
+    size_t dataSize;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+
+    uint32_t numKeys;
+    uint32_t numIds;
+    const int* eytKeys;
+    const uint32_t* eytRank;
+    const int* keys;
+    const uint32_t* offsets;
+    const int* ids;
+    const int* indexIds;
+    const int* indexAtt;
+
+    void unmap() {
+        if (!data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+#else
+        munmap(const_cast<char*>(data), dataSize);
+#endif
+        data = nullptr;
+        dataSize = 0;
+    }
+
+    // Number of distinct keys below x: branch-free descent of the Eytzinger array.
+    // Each step prefetches the slot four levels down, whose 16 consecutive keys
+    // share one cache line.
+    uint32_t lowerBoundRank(int x) const {
+        size_t slot = 1;
+        while (slot <= numKeys) {
+#if defined(__GNUC__)
+            __builtin_prefetch(eytKeys + 16 * slot);
+#endif
+            slot = 2 * slot + (eytKeys[slot] < x);
+        }
+        // Undo the trailing right turns plus the final left turn
+        while (slot & 1) slot >>= 1;
+        slot >>= 1;
+        return slot == 0 ? numKeys : eytRank[slot];
+    }
+
+    // Number of student IDs with attendance strictly below (or, if inclusive, at most) a value
+    uint32_t countBelow(int attendance, bool inclusive) const {
+        if (inclusive) {
+            if (attendance == INT_MAX) return numIds;
+            ++attendance;
+        }
+        return offsets[lowerBoundRank(attendance)];
+    }
+
+    // Distinct key containing the ID at a position of the ascending ID array
+    int attendanceAt(uint32_t position) const {
+        return keys[upper_bound(offsets, offsets + numKeys + 1, position) - offsets - 1];
+    }
+
+public:
+    AttendanceSnapshot()
+        : data(nullptr), dataSize(0),
+#ifdef _WIN32
+          mapping(nullptr),
+#endif
+          numKeys(0), numIds(0), eytKeys(nullptr), eytRank(nullptr), keys(nullptr),
+          offsets(nullptr), ids(nullptr), indexIds(nullptr), indexAtt(nullptr) {}
+
+    AttendanceSnapshot(const AttendanceSnapshot&) = delete;
+    AttendanceSnapshot& operator=(const AttendanceSnapshot&) = delete;
+
+    ~AttendanceSnapshot() {
+        unmap();
+    }
+
+    // Map a snapshot file read-only (the withIndex flag is accepted for
+    // interface parity with the tree backends; the index is always mapped)
+    bool deserialize(const string& filename, bool withIndex = false) {
+        (void)withIndex;
+        unmap();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            cerr << "Error opening file for reading: " << filename << endl;
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        dataSize = static_cast<size_t>(fileSize.QuadPart);
+        mapping = dataSize > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        CloseHandle(file);
+        if (!data) {
+            if (mapping) CloseHandle(mapping);
+            cerr << "Error mapping snapshot: " << filename << endl;
+            return false;
+        }
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cerr << "Error opening file for reading: " << filename << endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            cerr << "Empty snapshot: " << filename << endl;
+            return false;
+        }
+        dataSize = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, dataSize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            dataSize = 0;
+            cerr << "Error mapping snapshot: " << filename << endl;
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+#endif
+
+        const uint32_t* header = reinterpret_cast<const uint32_t*>(data);
+        if (dataSize < 4 * sizeof(uint32_t) || header[0] != SNAPSHOT_MAGIC || header[1] != SNAPSHOT_VERSION) {
+            unmap();
+            cerr << "Not an attendance snapshot: " << filename << endl;
+            return false;
+        }
+        numKeys = header[2];
+        numIds = header[3];
+
+        size_t words = 4 + 2 * (static_cast<size_t>(numKeys) + 1) + numKeys + (numKeys + 1) +
+                       3 * static_cast<size_t>(numIds);
+        if (dataSize < words * sizeof(uint32_t)) {
+            unmap();
+            cerr << "Truncated attendance snapshot: " << filename << endl;
+            return false;
+        }
+
+        const uint32_t* cursor = header + 4;
+        eytKeys = reinterpret_cast<const int*>(cursor);   cursor += numKeys + 1;
+        eytRank = cursor;                                  cursor += numKeys + 1;
+        keys = reinterpret_cast<const int*>(cursor);      cursor += numKeys;
+        offsets = cursor;                                  cursor += numKeys + 1;
+        ids = reinterpret_cast<const int*>(cursor);       cursor += numIds;
+        indexIds = reinterpret_cast<const int*>(cursor);  cursor += numIds;
+        indexAtt = reinterpret_cast<const int*>(cursor);
+        return true;
+    }
+
+    // Get student IDs with attendance in [lo, hi] in descending order of attendance
+    // (limit 0 means no limit)
+    vector<int> getStudentIdsInRange(int lo, int hi, size_t limit = 0) const {
+        vector<int> result;
+        if (lo > hi) return result;
+
+        uint32_t first = lowerBoundRank(lo);
+        uint32_t last = hi == INT_MAX ? numKeys : lowerBoundRank(hi + 1);
+        size_t total = offsets[last] - offsets[first];
+        result.reserve(limit > 0 ? min(limit, total) : total);
+
+        for (uint32_t r = last; r > first; --r) {
+            for (uint32_t i = offsets[r - 1]; i < offsets[r]; ++i) {
+                if (limit > 0 && result.size() >= limit) return result;
+                result.push_back(ids[i]);
+            }
+        }
+        return result;
+    }
+
+    // Get student IDs above or below a threshold in descending order of attendance
+    vector<int> getStudentIdsByThreshold(int threshold, int direction, size_t limit = 0) const {
+        if (direction > 0) {
+            return getStudentIdsInRange(threshold, INT_MAX, limit);
+        }
+        return getStudentIdsInRange(INT_MIN, threshold, limit);
+    }
+
+    // Total number of student IDs in the snapshot
+    int size() const {
+        return static_cast<int>(numIds);
+    }
+
+    // Number of student IDs with attendance in [lo, hi]
+    int countInRange(int lo, int hi) const {
+        if (lo > hi) return 0;
+        return static_cast<int>(countBelow(hi, true) - countBelow(lo, false));
+    }
+
+    // Find the k-th smallest (direction -1) or k-th largest (direction 1) entry, 1-based
+    bool kthStudent(int k, int direction, int& studentId, int& attendance) const {
+        if (k < 1 || k > size()) return false;
+        uint32_t position = direction > 0 ? numIds - static_cast<uint32_t>(k) : static_cast<uint32_t>(k - 1);
+        studentId = ids[position];
+        attendance = attendanceAt(position);
+        return true;
+    }
+
+    // Look up a student's attendance through the ID index
+    bool findAttendance(int studentId, int& attendance) const {
+        const int* it = lower_bound(indexIds, indexIds + numIds, studentId);
+        if (it == indexIds + numIds || *it != studentId) return false;
+        attendance = indexAtt[it - indexIds];
+        return true;
+    }
+};
+
+#endif // ATTENDANCE_SNAPSHOT_H
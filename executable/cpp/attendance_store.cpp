@@ -0,0 +1,293 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <climits>
+#include <tuple>
+
+#include "attendance_store.h"
+#include "metrics.h"
+
+using namespace std;
+
+metrics::Phase parsePhase("parse");
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Phase syncPhase("sync");
+metrics::Phase outputPhase("output");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");
+
+// loadStore, timed as the load phase
+bool loadTimed(AttendanceStore& store, WriteAheadLog& wal, const string& storeFilename, bool writable) {
+    metrics::ScopedTimer loadTimer(loadPhase);
+    if (!loadStore(store, wal, storeFilename, writable)) {
+        return false;
+    }
+    bytesRead.addFileSize(storeFilename);
+    bytesRead.addFileSize(storeFilename + ".wal");
+    return true;
+}
+
+// checkpoint, timed as the serialize phase
+bool checkpointTimed(AttendanceStore& store, WriteAheadLog& wal, const string& storeFilename) {
+    metrics::ScopedTimer serializeTimer(serializePhase);
+    if (!checkpoint(store, wal, storeFilename)) {
+        return false;
+    }
+    bytesWritten.addFileSize(storeFilename);
+    return true;
+}
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " build <attendance_csv> <store_file>" << endl;
+    cerr << "       " << program << " add <store_file> <student_id>" << endl;
+    cerr << "       " << program << " remove <store_file> <student_id>" << endl;
+    cerr << "       " << program << " mark <store_file> <subject> <student_id>" << endl;
+    cerr << "       " << program << " increment <store_file> <subject> <student_id> <delta>" << endl;
+    cerr << "       " << program << " batch <store_file>  (reads '<subject> <student_id> <delta>' lines from stdin)" << endl;
+    cerr << "       " << program << " checkpoint <store_file>" << endl;
+    cerr << "       " << program << " get <store_file> <student_id>" << endl;
+    cerr << "       " << program << " export <store_file>" << endl;
+    cerr << "       " << program << " threshold <store_file> <subject> <threshold> <direction> [limit]" << endl;
+    cerr << "  direction: 1 for above threshold, -1 for below threshold" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const string command = argv[1];
+    AttendanceStore store;
+
+    if (command == "build") {
+        if (argc != 4) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        const string storeFilename = argv[3];
+        FileLock lock(storeFilename + ".lock", true);
+        if (!lock.isLocked()) {
+            cerr << "Failed to lock " << storeFilename << endl;
+            return 1;
+        }
+
+        // Start a generation past any existing log so its records are never replayed
+        vector<string> staleRecords;
+        WriteAheadLog wal(storeFilename + ".wal");
+        wal.open(0, staleRecords, false);
+        metrics::ScopedTimer parseTimer(parsePhase);
+        bool built = store.buildFromCSV(argv[2]);
+        parseTimer.stop();
+        bytesRead.addFileSize(argv[2]);
+        if (!built || !checkpointTimed(store, wal, storeFilename)) {
+            cerr << "Failed to build the attendance store" << endl;
+            return 1;
+        }
+        cout << "Attendance store successfully written to " << storeFilename << endl;
+        return 0;
+    }
+
+    bool writer = command == "add" || command == "remove" || command == "mark" || command == "increment" ||
+                  command == "batch" || command == "checkpoint";
+    if (((command == "add" || command == "remove") && argc != 4) || (command == "mark" && argc != 5) ||
+        (command == "increment" && argc != 6) || (command == "batch" && argc != 3) ||
+        (command == "checkpoint" && argc != 3) || (command == "get" && argc != 4) ||
+        (command == "export" && argc != 3) || (command == "threshold" && argc != 6 && argc != 7) ||
+        (!writer && command != "get" && command != "export" && command != "threshold")) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const string storeFilename = argv[2];
+    WriteAheadLog wal(storeFilename + ".wal");
+
+    try {
+        if (writer) {
+            vector<string> output;
+            bool allApplied = true;
+            {
+                // Writers serialize their read-and-append on the lock file
+                FileLock lock(storeFilename + ".lock", true);
+                if (!lock.isLocked()) {
+                    cerr << "Failed to lock " << storeFilename << endl;
+                    return 1;
+                }
+                if (!loadTimed(store, wal, storeFilename, true)) {
+                    cerr << "Failed to load the attendance store from " << storeFilename << endl;
+                    return 1;
+                }
+
+                if (command == "add") {
+                    int studentId = stoi(argv[3]);
+                    if (!store.addStudent(studentId)) {
+                        cerr << "Student ID " << studentId << " already exists" << endl;
+                        return 1;
+                    }
+                    // Adding a row changes the snapshot layout, so fold everything in
+                    if (!checkpointTimed(store, wal, storeFilename)) return 1;
+                    cout << "Added student ID " << studentId << endl;
+                    return 0;
+                }
+
+                if (command == "remove") {
+                    int studentId = stoi(argv[3]);
+                    if (!store.removeStudent(studentId)) {
+                        cerr << "Student ID " << studentId << " not found" << endl;
+                        return 1;
+                    }
+                    // Removing a row changes the snapshot layout, so fold everything in
+                    if (!checkpointTimed(store, wal, storeFilename)) return 1;
+                    cout << "Removed student ID " << studentId << endl;
+                    return 0;
+                }
+
+                if (command == "checkpoint") {
+                    if (!checkpointTimed(store, wal, storeFilename)) return 1;
+                    cout << "Attendance store checkpointed" << endl;
+                    return 0;
+                }
+
+                // Collect (subject, student_id, delta) records from the arguments or stdin
+                vector<tuple<string, int, int>> records;
+                if (command == "batch") {
+                    string line;
+                    while (getline(cin, line)) {
+                        if (line.empty()) continue;
+                        istringstream fields(line);
+                        string subject;
+                        int studentId, delta;
+                        if (fields >> subject >> studentId >> delta) {
+                            records.emplace_back(subject, studentId, delta);
+                        } else {
+                            records.emplace_back("", 0, 0);
+                        }
+                    }
+                } else {
+                    int delta = command == "mark" ? 1 : stoi(argv[5]);
+                    records.emplace_back(argv[3], stoi(argv[4]), delta);
+                }
+
+                metrics::ScopedTimer computeTimer(computePhase);
+                long long logStart = wal.size();
+                for (const auto& [subject, studentId, delta] : records) {
+                    int subjectValue, totalValue;
+                    if (!store.increment(subject, studentId, delta, subjectValue, totalValue)) {
+                        // Unknown student or subject, or count would go negative
+                        output.push_back("-1");
+                        allApplied = false;
+                        continue;
+                    }
+                    wal.append(store.encodeIncrement(subject, studentId, delta));
+                    // Output: new subject count and new total
+                    output.push_back(to_string(subjectValue) + " " + to_string(totalValue));
+                }
+
+                computeTimer.stop();
+
+                metrics::ScopedTimer serializeTimer(serializePhase);
+                if (!wal.flush()) {
+                    cerr << "Error appending to the write-ahead log of " << storeFilename << endl;
+                    return 1;
+                }
+                serializeTimer.stop();
+                bytesWritten.add(static_cast<uint64_t>(wal.size() - logStart));
+                if (wal.size() >= CHECKPOINT_BYTES && !checkpointTimed(store, wal, storeFilename)) {
+                    cerr << "Warning: checkpoint of " << storeFilename << " failed" << endl;
+                }
+            }
+
+            // Group commit: one fsync, shared with writers that appended meanwhile
+            metrics::ScopedTimer syncTimer(syncPhase);
+            if (!wal.sync()) {
+                cerr << "Error syncing the write-ahead log of " << storeFilename << endl;
+                return 1;
+            }
+            syncTimer.stop();
+            metrics::ScopedTimer outputTimer(outputPhase);
+            for (const auto& line : output) {
+                cout << line << '\n';
+            }
+            return allApplied ? 0 : 1;
+        }
+
+        // Readers never wait behind a writer. Only if checkpoints keep landing
+        // during the load (or the store cannot be read, which then fails again)
+        // does a reader fall back to the shared lock.
+        bool loaded;
+        {
+            metrics::ScopedTimer loadTimer(loadPhase);
+            loaded = loadStoreUnlocked(store, storeFilename, 3);
+        }
+        if (loaded) {
+            bytesRead.addFileSize(storeFilename);
+            bytesRead.addFileSize(storeFilename + ".wal");
+        } else {
+            FileLock lock(storeFilename + ".lock", false);
+            loaded = lock.isLocked() && loadTimed(store, wal, storeFilename, false);
+        }
+        if (!loaded) {
+            cerr << "Failed to load the attendance store from " << storeFilename << endl;
+            return 1;
+        }
+
+        if (command == "export") {
+            metrics::ScopedTimer outputTimer(outputPhase);
+            store.exportCSV(cout);
+            return 0;
+        }
+
+        if (command == "get") {
+            vector<int> values;
+            if (!store.getStudent(stoi(argv[3]), values)) {
+                cout << "-1" << endl; // Unknown student
+                return 1;
+            }
+            const auto& subjects = store.getSubjects();
+            for (size_t i = 0; i < subjects.size(); ++i) {
+                cout << subjects[i] << " " << values[i] << endl;
+            }
+            return 0;
+        }
+
+        // threshold
+        const string subject = argv[3];
+        int threshold = stoi(argv[4]);
+        int direction = stoi(argv[5]);
+        long long limit = argc == 7 ? stoll(argv[6]) : 0;
+        if (direction != 1 && direction != -1) {
+            cerr << "Direction must be 1 (above) or -1 (below)" << endl;
+            return 1;
+        }
+        if (limit < 0) {
+            cerr << "Limit must not be negative" << endl;
+            return 1;
+        }
+        if (!store.hasSubject(subject)) {
+            cerr << "Unknown subject: " << subject << endl;
+            return 1;
+        }
+
+        metrics::ScopedTimer computeTimer(computePhase);
+        vector<int> studentIds = direction > 0
+            ? store.getStudentIdsInRange(subject, threshold, INT_MAX, static_cast<size_t>(limit))
+            : store.getStudentIdsInRange(subject, INT_MIN, threshold, static_cast<size_t>(limit));
+        computeTimer.stop();
+        metrics::ScopedTimer outputTimer(outputPhase);
+        if (studentIds.empty()) {
+            cout << "0" << endl; // No students meet the criteria
+        } else {
+            for (const auto& id : studentIds) {
+                cout << id << endl;
+            }
+        }
+        return 0;
+    } catch (const exception& e) {
+        cerr << "Error parsing arguments: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,524 @@
+#ifndef ATTENDANCE_STORE_H
+#define ATTENDANCE_STORE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "write_ahead_log.h"
+
+using namespace std;
+
+// Single-file columnar attendance store.
+//
+// Layout (all integers little-endian, as written by the host):
+//   header:  char magic[4] = "ATST", uint32 version,
+//            uint32 numSubjects, uint32 numStudents, uint64 walGeneration,
+//            numSubjects x (uint32 nameLength, name bytes)
+//   columns: int32 studentIds[numStudents]                  (ascending)
+//            numSubjects x int32 counts[numStudents]        (row-aligned with studentIds)
+//            numSubjects x uint32 order[numStudents]        (rows sorted by (count, studentId))
+//
+// The per-subject order arrays are the ordered indexes used for threshold
+// queries. The file is a snapshot: increments are appended to <store>.wal as
+// checksummed 12-byte records (subject, student_id, delta) and every open
+// replays the log on top of the snapshot. Once the log passes
+// CHECKPOINT_BYTES the next writer folds it into a new snapshot, written to a
+// temporary file, fsynced and atomically renamed, and starts a fresh log.
+// Writers hold an exclusive lock on <store>.lock while they read and append,
+// so concurrent increments never lose each other's updates; the fsync happens
+// after the lock is released so that concurrent marks share it (group commit).
+// Readers take no lock (loadStoreUnlocked): they read the snapshot, then the
+// log, and start over if a checkpoint replaced the snapshot in between.
+//
+// Copies of a store share their columns and a column is copied the first time
+// a copy changes it, so a copy that takes one increment duplicates only the
+// subject's and total_attendance's counts and ordered indexes.
+
+const char STORE_MAGIC[4] = {'A', 'T', 'S', 'T'};
+const uint32_t STORE_VERSION = 2;
+const string TOTAL_SUBJECT = "total_attendance";
+
+// Log size at which a writer folds the log into a new snapshot
+const long long CHECKPOINT_BYTES = 64 * 1024;
+
+class AttendanceStore {
+private:
+    template <typename T>
+    using Column = shared_ptr<vector<T>>;
+
+    vector<string> subjects;
+    Column<int> studentIds;             // Sorted ascending, one row per student
+    vector<Column<int>> counts;         // counts[subject][row]
+    vector<Column<uint32_t>> order;     // order[subject] = rows sorted by (count, studentId)
+    uint64_t walGeneration;             // Generation of the log that extends this snapshot
+
+    // A column this store may change: copied first if another store shares it.
+    // Only one thread changes a store, and a column it holds alone cannot gain
+    // another owner meanwhile, so the use count is exact here.
+    template <typename T>
+    static vector<T>& mutableColumn(Column<T>& column) {
+        if (column.use_count() > 1) {
+            column = make_shared<vector<T>>(*column);
+        }
+        return *column;
+    }
+
+    // Compare two rows of a subject by (count, studentId)
+    bool rowLess(size_t subject, uint32_t a, uint32_t b) const {
+        const auto& column = *counts[subject];
+        if (column[a] != column[b]) {
+            return column[a] < column[b];
+        }
+        return (*studentIds)[a] < (*studentIds)[b];
+    }
+
+    // Rebuild the ordered index of one subject from scratch
+    void sortOrder(size_t subject) {
+        auto ord = make_shared<vector<uint32_t>>(studentIds->size());
+        for (size_t row = 0; row < studentIds->size(); ++row) {
+            (*ord)[row] = static_cast<uint32_t>(row);
+        }
+        sort(ord->begin(), ord->end(),
+             [&](uint32_t a, uint32_t b) { return rowLess(subject, a, b); });
+        order[subject] = move(ord);
+    }
+
+    // Position of a row inside a subject's ordered index (binary search)
+    size_t orderPosition(size_t subject, uint32_t row) const {
+        const auto& ord = *order[subject];
+        auto it = lower_bound(ord.begin(), ord.end(), row,
+                              [&](uint32_t a, uint32_t b) { return rowLess(subject, a, b); });
+        return static_cast<size_t>(it - ord.begin());
+    }
+
+    // Change a row's count and slide it to its new place in the ordered index.
+    // Only the entries between the old and new position move.
+    void setCount(size_t subject, uint32_t row, int value) {
+        auto& ord = mutableColumn(order[subject]);
+        size_t from = orderPosition(subject, row);
+        mutableColumn(counts[subject])[row] = value;
+
+        size_t to = from;
+        while (to + 1 < ord.size() && rowLess(subject, ord[to + 1], row)) {
+            ord[to] = ord[to + 1];
+            ++to;
+        }
+        while (to > 0 && rowLess(subject, row, ord[to - 1])) {
+            ord[to] = ord[to - 1];
+            --to;
+        }
+        ord[to] = row;
+    }
+
+    // Index of a subject column, or -1
+    int subjectIndex(const string& subject) const {
+        for (size_t i = 0; i < subjects.size(); ++i) {
+            if (subjects[i] == subject) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Row of a student, or -1
+    int rowOf(int studentId) const {
+        auto it = lower_bound(studentIds->begin(), studentIds->end(), studentId);
+        if (it == studentIds->end() || *it != studentId) return -1;
+        return static_cast<int>(it - studentIds->begin());
+    }
+
+    template <typename T>
+    static void writeColumn(ofstream& outFile, const vector<T>& column) {
+        if (!column.empty()) {
+            outFile.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+        }
+    }
+
+    template <typename T>
+    static bool readColumn(ifstream& inFile, Column<T>& column, size_t size) {
+        column = make_shared<vector<T>>(size);
+        if (size == 0) return true;
+        return static_cast<bool>(inFile.read(reinterpret_cast<char*>(column->data()), size * sizeof(T)));
+    }
+
+public:
+    AttendanceStore() : studentIds(make_shared<vector<int>>()), walGeneration(0) {}
+
+    // Build the store from attendance.csv (student_id,name,<subject>...)
+    bool buildFromCSV(const string& csvFilename) {
+        ifstream csvFile(csvFilename);
+        if (!csvFile) {
+            cerr << "Error opening CSV file: " << csvFilename << endl;
+            return false;
+        }
+
+        string line;
+        if (!getline(csvFile, line)) {
+            cerr << "Empty CSV file: " << csvFilename << endl;
+            return false;
+        }
+
+        // Every column after student_id and name is a subject counter
+        stringstream header(line);
+        string column;
+        vector<string> columns;
+        while (getline(header, column, ',')) {
+            if (!column.empty() && column.back() == '\r') column.pop_back();
+            columns.push_back(column);
+        }
+        if (columns.size() < 3 || columns[0] != "student_id") {
+            cerr << "Unexpected CSV header in " << csvFilename << endl;
+            return false;
+        }
+        subjects.assign(columns.begin() + 2, columns.end());
+        if (subjectIndex(TOTAL_SUBJECT) < 0) {
+            cerr << "CSV has no " << TOTAL_SUBJECT << " column" << endl;
+            return false;
+        }
+
+        vector<pair<int, vector<int>>> rows;
+        while (getline(csvFile, line)) {
+            if (line.empty() || line == "\r") continue;
+            stringstream ss(line);
+            string field;
+            vector<string> fields;
+            while (getline(ss, field, ',')) {
+                fields.push_back(field);
+            }
+            if (fields.size() != columns.size()) {
+                cerr << "Warning: skipping malformed row: " << line << endl;
+                continue;
+            }
+            try {
+                vector<int> values;
+                for (size_t i = 2; i < fields.size(); ++i) {
+                    values.push_back(static_cast<int>(stod(fields[i])));
+                }
+                rows.push_back({stoi(fields[0]), values});
+            } catch (const exception& e) {
+                cerr << "Warning: skipping malformed row: " << line << endl;
+            }
+        }
+
+        sort(rows.begin(), rows.end(),
+             [](const pair<int, vector<int>>& a, const pair<int, vector<int>>& b) { return a.first < b.first; });
+        rows.erase(unique(rows.begin(), rows.end(),
+                          [](const pair<int, vector<int>>& a, const pair<int, vector<int>>& b) { return a.first == b.first; }),
+                   rows.end());
+
+        studentIds = make_shared<vector<int>>();
+        counts.assign(subjects.size(), nullptr);
+        order.assign(subjects.size(), nullptr);
+        for (auto& column : counts) column = make_shared<vector<int>>();
+        for (const auto& [id, values] : rows) {
+            studentIds->push_back(id);
+            for (size_t s = 0; s < subjects.size(); ++s) {
+                counts[s]->push_back(values[s]);
+            }
+        }
+        for (size_t s = 0; s < subjects.size(); ++s) {
+            sortOrder(s);
+        }
+        return true;
+    }
+
+    // Deserialize the store from a binary file
+    bool deserialize(const string& filename) {
+        ifstream inFile(filename, ios::binary);
+        if (!inFile) {
+            cerr << "Error opening file for reading: " << filename << endl;
+            return false;
+        }
+
+        char magic[4];
+        uint32_t version, numSubjects, numStudents;
+        inFile.read(magic, sizeof(magic));
+        inFile.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+        inFile.read(reinterpret_cast<char*>(&numSubjects), sizeof(uint32_t));
+        inFile.read(reinterpret_cast<char*>(&numStudents), sizeof(uint32_t));
+        if (!inFile || !equal(magic, magic + 4, STORE_MAGIC) || version < 1 || version > STORE_VERSION) {
+            cerr << "Not an attendance store: " << filename << endl;
+            return false;
+        }
+
+        // Version 1 stores predate the write-ahead log
+        walGeneration = 0;
+        if (version >= 2) {
+            inFile.read(reinterpret_cast<char*>(&walGeneration), sizeof(uint64_t));
+        }
+
+        subjects.resize(numSubjects);
+        for (auto& subject : subjects) {
+            uint32_t length;
+            inFile.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+            if (!inFile || length > 256) {
+                cerr << "Corrupt subject table in " << filename << endl;
+                return false;
+            }
+            subject.assign(length, '\0');
+            inFile.read(&subject[0], length);
+        }
+
+        bool ok = readColumn(inFile, studentIds, numStudents);
+        counts.assign(numSubjects, nullptr);
+        order.assign(numSubjects, nullptr);
+        for (auto& column : counts) ok = ok && readColumn(inFile, column, numStudents);
+        for (auto& column : order) ok = ok && readColumn(inFile, column, numStudents);
+        if (!ok) {
+            cerr << "Truncated attendance store: " << filename << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Serialize the store to a temporary file, flush it to disk and atomically rename
+    // it into place, so readers see either the old or the new store, never a partial one
+    bool serialize(const string& filename) {
+        const string tmpFilename = filename + ".tmp";
+        ofstream outFile(tmpFilename, ios::binary | ios::trunc);
+        if (!outFile) {
+            cerr << "Error opening file for writing: " << tmpFilename << endl;
+            return false;
+        }
+
+        uint32_t numSubjects = static_cast<uint32_t>(subjects.size());
+        uint32_t numStudents = static_cast<uint32_t>(studentIds->size());
+        outFile.write(STORE_MAGIC, sizeof(STORE_MAGIC));
+        outFile.write(reinterpret_cast<const char*>(&STORE_VERSION), sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(&numSubjects), sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(&numStudents), sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(&walGeneration), sizeof(uint64_t));
+        for (const auto& subject : subjects) {
+            uint32_t length = static_cast<uint32_t>(subject.size());
+            outFile.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+            outFile.write(subject.data(), length);
+        }
+
+        writeColumn(outFile, *studentIds);
+        for (const auto& column : counts) writeColumn(outFile, *column);
+        for (const auto& column : order) writeColumn(outFile, *column);
+        outFile.close();
+        if (!outFile) {
+            cerr << "Error writing " << tmpFilename << endl;
+            remove(tmpFilename.c_str());
+            return false;
+        }
+
+        if (!syncFile(tmpFilename) || !replaceFile(tmpFilename, filename)) {
+            cerr << "Error replacing " << filename << endl;
+            remove(tmpFilename.c_str());
+            return false;
+        }
+        syncParentDirectory(filename);
+        return true;
+    }
+
+    uint64_t getWalGeneration() const {
+        return walGeneration;
+    }
+
+    void setWalGeneration(uint64_t generation) {
+        walGeneration = generation;
+    }
+
+    // Encode an increment as a log record: uint32 subject index, int32 student ID, int32 delta
+    string encodeIncrement(const string& subject, int studentId, int delta) const {
+        uint32_t s = static_cast<uint32_t>(subjectIndex(subject));
+        string payload(3 * sizeof(uint32_t), '\0');
+        memcpy(&payload[0], &s, sizeof(uint32_t));
+        memcpy(&payload[sizeof(uint32_t)], &studentId, sizeof(int));
+        memcpy(&payload[2 * sizeof(uint32_t)], &delta, sizeof(int));
+        return payload;
+    }
+
+    // Re-apply an increment read back from the log
+    bool applyLogRecord(const string& payload) {
+        if (payload.size() != 3 * sizeof(uint32_t)) return false;
+        uint32_t s;
+        int studentId, delta, subjectValue, totalValue;
+        memcpy(&s, &payload[0], sizeof(uint32_t));
+        memcpy(&studentId, &payload[sizeof(uint32_t)], sizeof(int));
+        memcpy(&delta, &payload[2 * sizeof(uint32_t)], sizeof(int));
+        if (s >= subjects.size()) return false;
+        return increment(subjects[s], studentId, delta, subjectValue, totalValue);
+    }
+
+    const vector<string>& getSubjects() const {
+        return subjects;
+    }
+
+    bool hasSubject(const string& subject) const {
+        return subjectIndex(subject) >= 0;
+    }
+
+    // Add a student with zero attendance in every subject; false if already present
+    bool addStudent(int studentId) {
+        if (rowOf(studentId) >= 0) return false;
+
+        auto& ids = mutableColumn(studentIds);
+        uint32_t row = static_cast<uint32_t>(lower_bound(ids.begin(), ids.end(), studentId) - ids.begin());
+        ids.insert(ids.begin() + row, studentId);
+        for (size_t s = 0; s < subjects.size(); ++s) {
+            auto& column = mutableColumn(counts[s]);
+            column.insert(column.begin() + row, 0);
+
+            // Rows at or after the insertion point shifted by one
+            auto& ord = mutableColumn(order[s]);
+            for (auto& r : ord) {
+                if (r >= row) ++r;
+            }
+            size_t position = orderPosition(s, row);
+            ord.insert(ord.begin() + position, row);
+        }
+        return true;
+    }
+
+    // Remove a student's row from every subject; false if not present
+    bool removeStudent(int studentId) {
+        int found = rowOf(studentId);
+        if (found < 0) return false;
+
+        uint32_t row = static_cast<uint32_t>(found);
+        for (size_t s = 0; s < subjects.size(); ++s) {
+            // Find the row in the ordered index while its count is still there
+            size_t position = orderPosition(s, row);
+            auto& ord = mutableColumn(order[s]);
+            ord.erase(ord.begin() + position);
+        }
+        auto& ids = mutableColumn(studentIds);
+        ids.erase(ids.begin() + row);
+        for (size_t s = 0; s < subjects.size(); ++s) {
+            auto& column = mutableColumn(counts[s]);
+            column.erase(column.begin() + row);
+
+            // Rows after the removed one shifted down by one
+            for (auto& r : mutableColumn(order[s])) {
+                if (r > row) --r;
+            }
+        }
+        return true;
+    }
+
+    // Add delta to a student's subject count and total together and report the new values.
+    // Fails (without changing anything) for an unknown student or subject, for the
+    // total itself (it only moves with a subject), or if a count would drop below zero.
+    bool increment(const string& subject, int studentId, int delta, int& subjectValue, int& totalValue) {
+        int s = subjectIndex(subject);
+        int t = subjectIndex(TOTAL_SUBJECT);
+        int row = rowOf(studentId);
+        if (s < 0 || t < 0 || s == t || row < 0) return false;
+        if ((*counts[s])[row] + delta < 0 || (*counts[t])[row] + delta < 0) return false;
+
+        setCount(s, row, (*counts[s])[row] + delta);
+        setCount(t, row, (*counts[t])[row] + delta);
+        subjectValue = (*counts[s])[row];
+        totalValue = (*counts[t])[row];
+        return true;
+    }
+
+    // All counters of one student, in subject order
+    bool getStudent(int studentId, vector<int>& values) const {
+        int row = rowOf(studentId);
+        if (row < 0) return false;
+        values.clear();
+        for (const auto& column : counts) {
+            values.push_back((*column)[row]);
+        }
+        return true;
+    }
+
+    // Student IDs of a subject with attendance in [lo, hi], descending by attendance
+    // (limit 0 means no limit)
+    vector<int> getStudentIdsInRange(const string& subject, int lo, int hi, size_t limit = 0) const {
+        vector<int> result;
+        int s = subjectIndex(subject);
+        if (s < 0 || lo > hi) return result;
+
+        const auto& ord = *order[s];
+        const auto& column = *counts[s];
+        auto end = upper_bound(ord.begin(), ord.end(), hi,
+                               [&](int value, uint32_t row) { return value < column[row]; });
+        auto begin = lower_bound(ord.begin(), end, lo,
+                                 [&](uint32_t row, int value) { return column[row] < value; });
+
+        for (auto it = end; it != begin; ) {
+            --it;
+            if (limit > 0 && result.size() >= limit) break;
+            result.push_back((*studentIds)[*it]);
+        }
+        return result;
+    }
+
+    // Write every row as CSV (student_id,<subject>...)
+    void exportCSV(ostream& out) const {
+        out << "student_id";
+        for (const auto& subject : subjects) {
+            out << "," << subject;
+        }
+        out << '\n';
+        for (size_t row = 0; row < studentIds->size(); ++row) {
+            out << (*studentIds)[row];
+            for (const auto& column : counts) {
+                out << "," << (*column)[row];
+            }
+            out << '\n';
+        }
+    }
+};
+
+// Load the snapshot and replay its write-ahead log on top of it
+inline bool loadStore(AttendanceStore& store, WriteAheadLog& wal, const string& storeFilename, bool writable) {
+    if (!store.deserialize(storeFilename)) {
+        return false;
+    }
+
+    vector<string> records;
+    if (!wal.open(store.getWalGeneration(), records, writable)) {
+        cerr << "Error opening write-ahead log for " << storeFilename << endl;
+        return false;
+    }
+    for (const auto& record : records) {
+        if (!store.applyLogRecord(record)) {
+            cerr << "Warning: skipping unreplayable log record in " << storeFilename << endl;
+        }
+    }
+    return true;
+}
+
+// Load the store without taking <store>.lock, for readers. A checkpoint renames
+// a new snapshot into place before it restarts the log, so a load is
+// consistent unless the snapshot file changed while it ran or the log already
+// belongs to a newer snapshot; then it is tried again. Returns false if the
+// store cannot be read or every attempt raced a checkpoint.
+inline bool loadStoreUnlocked(AttendanceStore& store, const string& storeFilename, int attempts) {
+    bool consistent = false;
+    for (int attempt = 0; attempt < attempts && !consistent; ++attempt) {
+        FileStamp snapshotStamp = fileStamp(storeFilename);
+        WriteAheadLog wal(storeFilename + ".wal");
+        if (!loadStore(store, wal, storeFilename, false)) {
+            return false;
+        }
+        consistent = fileStamp(storeFilename) == snapshotStamp && wal.getGeneration() <= store.getWalGeneration();
+    }
+    return consistent;
+}
+
+// Fold the log into a new durable snapshot and start an empty log for it
+inline bool checkpoint(AttendanceStore& store, WriteAheadLog& wal, const string& storeFilename) {
+    uint64_t generation = max(store.getWalGeneration(), wal.getGeneration()) + 1;
+    store.setWalGeneration(generation);
+    if (!store.serialize(storeFilename)) {
+        return false;
+    }
+    // Until the log is reset its older generation tells readers to ignore it
+    return wal.reset(generation);
+}
+
+#endif // ATTENDANCE_STORE_H
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <filesystem>
+
+#include "child_process.h"
+#include "synthetic_roster.h"
+
+using namespace std;
+
+// Scale benchmarks for the name trie and attendance index tools.
+//
+// For each roster size, writes a synthetic roster (synthetic_roster.h) into a
+// work directory laid out like the server's, then runs the tools as the server
+// would and measures:
+//
+//   create_trie  build time, name.dat size, peak RSS
+//   search_trie  load time, and query latency by prefix length
+//   insert_trie  cost of one insert (load, insert, rewrite)
+//   create_avl   build time of every subject index, .dat and .snap sizes, peak RSS
+//   threshold    load time, and query latency by selectivity
+//   update_avl   cost of one update and of one --batch of updates
+//
+// Wall times are per process, including startup. Load and compute times come
+// from the tools' own phase timers (ATTENDANCE_METRICS=json, see metrics.h).
+// Peak RSS is the child's maximum resident set size. Each query measurement is
+// the median of --repeat runs. The report is one JSON object on stdout.
+
+struct Options {
+    string binDir = "./executable";
+    string workDir = "bench_work";
+    vector<size_t> sizes = {10000, 100000};
+    size_t repeat = 15;
+    size_t batch = 1000;
+    uint64_t seed = 1;
+};
+
+// The tool measurements of one run
+struct Sample {
+    double wallMs = 0;
+    double loadMs = 0;
+    double computeMs = 0;
+    long peakRssKb = 0;
+    size_t outputLines = 0;
+};
+
+// Seconds of a phase in a tool's ATTENDANCE_METRICS=json line (0 if absent)
+double phaseSeconds(const string& metricsJson, const string& phase) {
+    const string key = "\"" + phase + "\":{\"seconds\":";
+    size_t pos = metricsJson.rfind(key);
+    return pos == string::npos ? 0 : strtod(metricsJson.c_str() + pos + key.size(), nullptr);
+}
+
+double median(vector<double> values) {
+    if (values.empty()) return 0;
+    sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+class Bench {
+private:
+    const Options& options;
+    ostringstream& json;
+
+public:
+    Bench(const Options& opts, ostringstream& out) : options(opts), json(out) {}
+
+    // Run one tool in the work directory; exits on failure, since every
+    // later number would be meaningless
+    Sample run(const string& tool, const vector<string>& args, const string& input = "") {
+        ProcessResult result = runProcess(toolPath(options.binDir, tool), args, options.workDir, input,
+                                          {"ATTENDANCE_METRICS=json"});
+        if (result.status != 0) {
+            cerr << tool << " failed (status " << result.status << "):\n" << result.errors << endl;
+            exit(1);
+        }
+        Sample sample;
+        sample.wallMs = result.seconds * 1000;
+        sample.loadMs = phaseSeconds(result.errors, "load") * 1000;
+        sample.computeMs = phaseSeconds(result.errors, "compute") * 1000;
+        sample.peakRssKb = result.peakRssKb;
+        sample.outputLines = static_cast<size_t>(count(result.output.begin(), result.output.end(), '\n'));
+        return sample;
+    }
+
+    // Median wall, load and compute time of repeated runs, and their peak RSS
+    void writeRepeated(const function<Sample(size_t)>& once, size_t repeat, const string& extra = "") {
+        vector<double> wall, load, compute;
+        long peak = 0;
+        size_t lines = 0;
+        for (size_t i = 0; i < repeat; ++i) {
+            Sample sample = once(i);
+            wall.push_back(sample.wallMs);
+            load.push_back(sample.loadMs);
+            compute.push_back(sample.computeMs);
+            peak = max(peak, sample.peakRssKb);
+            lines += sample.outputLines;
+        }
+        json << "{\"median_ms\":" << median(wall) << ",\"load_ms\":" << median(load)
+             << ",\"compute_ms\":" << median(compute) << ",\"peak_rss_kb\":" << peak
+             << ",\"mean_results\":" << static_cast<double>(lines) / max<size_t>(repeat, 1) << extra << "}";
+    }
+};
+
+uintmax_t fileSize(const string& filename) {
+    error_code ec;
+    uintmax_t size = filesystem::file_size(filename, ec);
+    return ec ? 0 : size;
+}
+
+void benchmarkSize(const Options& options, size_t students, ostringstream& json) {
+    const string data = options.workDir + "/executable/data";
+    const string serialized = options.workDir + "/executable/serialized";
+    error_code ec;
+    filesystem::remove_all(serialized, ec);
+    filesystem::create_directories(data);
+    filesystem::create_directories(serialized);
+
+    // The trie and index tools never read the faces, so leave them out
+    vector<SyntheticStudent> roster = generateRoster(students, options.seed, 0);
+    if (!writeStudentsCSV(data + "/students.csv", roster) || !writeAttendanceCSV(data + "/attendance.csv", roster)) {
+        cerr << "Failed to write the synthetic roster to " << data << endl;
+        exit(1);
+    }
+
+    Bench bench(options, json);
+    mt19937_64 rng(options.seed + students);
+    json << "{\"students\":" << students;
+
+    // ---- Name trie ----
+    Sample build = bench.run("create_trie", {});
+    json << ",\"create_trie\":{\"seconds\":" << build.wallMs / 1000 << ",\"peak_rss_kb\":" << build.peakRssKb
+         << ",\"file_bytes\":" << fileSize(serialized + "/name.dat") << "}";
+
+    json << ",\"search_trie\":{";
+    const size_t prefixLengths[] = {1, 2, 3, 4, 6, 8, 12};
+    for (size_t i = 0; i < sizeof(prefixLengths) / sizeof(prefixLengths[0]); ++i) {
+        size_t length = prefixLengths[i];
+        json << (i ? "," : "") << "\"prefix_" << length << "\":";
+        bench.writeRepeated([&](size_t) {
+            const string& name = roster[uniform_int_distribution<size_t>(0, roster.size() - 1)(rng)].name;
+            return bench.run("search_trie", {name.substr(0, min(length, name.size()))});
+        }, options.repeat);
+    }
+    json << "}";
+
+    json << ",\"insert_trie\":";
+    bench.writeRepeated([&](size_t i) {
+        return bench.run("insert_trie", {roster[i % roster.size()].name + " Jr", to_string(900000000 + i)});
+    }, min<size_t>(options.repeat, 5), ",\"file_bytes\":" + to_string(fileSize(serialized + "/name.dat")));
+
+    // ---- Attendance indexes ----
+    build = bench.run("create_avl", {"--csv", "executable/data/attendance.csv", "executable/serialized"});
+    uintmax_t datBytes = 0, snapBytes = 0;
+    for (const auto& entry : filesystem::directory_iterator(serialized)) {
+        if (entry.path().extension() == ".dat" && entry.path().filename() != "name.dat") {
+            datBytes += fileSize(entry.path().string());
+        } else if (entry.path().extension() == ".snap") {
+            snapBytes += fileSize(entry.path().string());
+        }
+    }
+    json << ",\"create_avl\":{\"seconds\":" << build.wallMs / 1000 << ",\"peak_rss_kb\":" << build.peakRssKb
+         << ",\"dat_bytes\":" << datBytes << ",\"snap_bytes\":" << snapBytes << "}";
+
+    // Thresholds that select a given fraction of the class in maths, from the
+    // bottom up: most students attend nearly everything, so only the long
+    // tail of low attendance reaches the small fractions
+    vector<int> maths;
+    for (const auto& student : roster) maths.push_back(student.attendance[0]);
+    sort(maths.begin(), maths.end());
+    json << ",\"threshold\":{";
+    const double selectivities[] = {0.001, 0.01, 0.1, 0.5, 1.0};
+    for (size_t i = 0; i < sizeof(selectivities) / sizeof(selectivities[0]); ++i) {
+        size_t rank = max<size_t>(1, static_cast<size_t>(selectivities[i] * static_cast<double>(students)));
+        int threshold = maths[min(rank, maths.size()) - 1];
+        size_t selected = static_cast<size_t>(upper_bound(maths.begin(), maths.end(), threshold) - maths.begin());
+        json << (i ? "," : "") << "\"selectivity_" << selectivities[i] << "\":";
+        bench.writeRepeated([&](size_t) {
+            return bench.run("threshold", {"executable/serialized/maths.dat", to_string(threshold), "-1"});
+        }, options.repeat, ",\"threshold\":" + to_string(threshold) + ",\"selected\":" + to_string(selected));
+    }
+    json << "}";
+
+    // Updates move students between buckets, so each one changes the value
+    json << ",\"update_avl\":{\"single\":";
+    bench.writeRepeated([&](size_t i) {
+        const SyntheticStudent& student = roster[uniform_int_distribution<size_t>(0, roster.size() - 1)(rng)];
+        return bench.run("update_avl", {"executable/serialized/maths.dat",
+                                        to_string(student.attendance[0] + 1 + static_cast<int>(i)),
+                                        to_string(student.studentId)});
+    }, min<size_t>(options.repeat, 5));
+    string records;
+    for (size_t i = 0; i < options.batch; ++i) {
+        const SyntheticStudent& student = roster[uniform_int_distribution<size_t>(0, roster.size() - 1)(rng)];
+        records += "maths " + to_string(student.studentId) + " " + to_string(student.attendance[0] + 10) + "\n";
+    }
+    Sample batch = bench.run("update_avl", {"--batch", "executable/serialized"}, records);
+    json << ",\"batch\":{\"records\":" << options.batch << ",\"ms\":" << batch.wallMs
+         << ",\"per_record_us\":" << batch.wallMs * 1000 / max<size_t>(options.batch, 1)
+         << ",\"peak_rss_kb\":" << batch.peakRssKb << "}}";
+
+    json << "}";
+}
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [--bin <dir>] [--work <dir>] [--sizes 10000,100000,1000000]" << endl;
+    cerr << "       [--repeat <runs per query>] [--batch <records>] [--seed <n>]" << endl;
+    cerr << "  --bin: directory of the compiled tools (default ./executable)" << endl;
+    cerr << "  --work: scratch directory for the synthetic rosters (default bench_work)" << endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string option = argv[i];
+            if (i + 1 >= argc) return false;
+            string value = argv[++i];
+            if (option == "--bin") options.binDir = value;
+            else if (option == "--work") options.workDir = value;
+            else if (option == "--repeat") options.repeat = stoul(value);
+            else if (option == "--batch") options.batch = stoul(value);
+            else if (option == "--seed") options.seed = stoull(value);
+            else if (option == "--sizes") {
+                options.sizes.clear();
+                stringstream ss(value);
+                string size;
+                while (getline(ss, size, ',')) options.sizes.push_back(stoul(size));
+            } else return false;
+        }
+    } catch (const exception& e) {
+        cerr << "Error parsing arguments: " << e.what() << endl;
+        return false;
+    }
+    return !options.sizes.empty() && options.repeat > 0 &&
+           all_of(options.sizes.begin(), options.sizes.end(), [](size_t n) { return n > 0; });
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    ostringstream json;
+    json << "{\"sizes\":[";
+    for (size_t i = 0; i < options.sizes.size(); ++i) {
+        if (i) json << ",";
+        benchmarkSize(options, options.sizes[i], json);
+    }
+    json << "]}";
+    cout << json.str() << endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Bounded lock-free multi-producer multi-consumer queue.
+//
+// A ring of slots, each with a sequence number (Vyukov's bounded MPMC queue).
+// A producer claims a slot by advancing the enqueue position with a CAS and
+// publishes the value by bumping the slot's sequence; a consumer does the same
+// on the dequeue side. Neither side takes a lock, so a stalled consumer never
+// blocks a producer until the ring is actually full.
+//
+// tryPush/tryPop never wait; push waits for room with Backoff. Consumers
+// poll tryPop with a Backoff of their own: a short spin, then yielding the
+// core, then short sleeps, so an idle stage costs almost nothing.
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+
+// Escalating wait for a condition polled in a loop
+class Backoff {
+private:
+    unsigned rounds = 0;
+
+public:
+    void pause() {
+        if (rounds < 16) {
+            // Busy spin; the other side is probably about to finish
+        } else if (rounds < 64) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+        ++rounds;
+    }
+
+    void reset() {
+        rounds = 0;
+    }
+};
+
+template <typename T>
+class BoundedQueue {
+private:
+    struct Slot {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    // Keep the producer and consumer positions on separate cache lines
+    alignas(64) atomic<size_t> enqueuePos;
+    alignas(64) atomic<size_t> dequeuePos;
+    alignas(64) unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    static size_t roundUpToPowerOfTwo(size_t n) {
+        size_t capacity = 2;
+        while (capacity < n) capacity <<= 1;
+        return capacity;
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+        size_t size = roundUpToPowerOfTwo(capacity);
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    // Add a value unless the queue is full
+    bool tryPush(T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    slot.value = move(value);
+                    slot.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Take the oldest value unless the queue is empty
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = move(slot.value);
+                    slot.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Empty
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Add a value, waiting while the queue is full
+    void push(T value) {
+        Backoff backoff;
+        while (!tryPush(value)) {
+            backoff.pause();
+        }
+    }
+};
+
+#endif // BOUNDED_QUEUE_H
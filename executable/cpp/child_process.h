@@ -0,0 +1,150 @@
+// Running the compiled tools as child processes, for the load generator and
+// the benchmark suite.
+//
+// runProcess forks, changes to the given directory and execs the program with
+// input on its stdin, then collects stdout and stderr, the exit status, the
+// wall time and the child's peak resident set size (from wait4). Pipes are
+// close-on-exec, so children forked concurrently by other threads do not
+// inherit each other's ends. POSIX only.
+
+#ifndef CHILD_PROCESS_H
+#define CHILD_PROCESS_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+using namespace std;
+
+struct ProcessResult {
+    int status = -1;         // Exit status, or -1 if the program could not be run
+    double seconds = 0;      // Wall time from fork to exit
+    long peakRssKb = 0;      // Peak resident set size of the child
+    string output;           // stdout
+    string errors;           // stderr
+};
+
+// Path of a compiled tool, with or without the Windows .exe suffix
+inline string toolPath(const string& binDir, const string& tool) {
+    string path = filesystem::absolute(binDir + "/" + tool).string();
+    if (!filesystem::exists(path) && filesystem::exists(path + ".exe")) path += ".exe";
+    return path;
+}
+
+// Run a program to completion in dir; extraEnvironment holds NAME=value
+// entries added to this process's environment
+inline ProcessResult runProcess(const string& program, const vector<string>& args, const string& dir,
+                                const string& input = "", const vector<string>& extraEnvironment = {}) {
+    ProcessResult result;
+
+    // A child that exits without reading its input must not kill us on write
+    static const bool ignoreBrokenPipes = signal(SIGPIPE, SIG_IGN) != SIG_ERR;
+    (void)ignoreBrokenPipes;
+
+    // Everything the child needs is built before fork
+    vector<string> argvStrings = {program};
+    argvStrings.insert(argvStrings.end(), args.begin(), args.end());
+    vector<char*> argv;
+    for (auto& arg : argvStrings) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    vector<string> envStrings(extraEnvironment);
+    vector<char*> envp;
+    for (auto& entry : envStrings) envp.push_back(&entry[0]);
+    for (char** entry = environ; *entry; ++entry) envp.push_back(*entry);
+    envp.push_back(nullptr);
+
+    int inPipe[2], outPipe[2], errPipe[2];
+    if (pipe2(inPipe, O_CLOEXEC) != 0) return result;
+    if (pipe2(outPipe, O_CLOEXEC) != 0) {
+        close(inPipe[0]);
+        close(inPipe[1]);
+        return result;
+    }
+    if (pipe2(errPipe, O_CLOEXEC) != 0) {
+        close(inPipe[0]);
+        close(inPipe[1]);
+        close(outPipe[0]);
+        close(outPipe[1]);
+        return result;
+    }
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child: only async-signal-safe calls until exec
+        if (chdir(dir.c_str()) != 0) _exit(127);
+        dup2(inPipe[0], STDIN_FILENO);
+        dup2(outPipe[1], STDOUT_FILENO);
+        dup2(errPipe[1], STDERR_FILENO);
+        execve(argv[0], argv.data(), envp.data());
+        _exit(127);
+    }
+    close(inPipe[0]);
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (pid < 0) {
+        close(inPipe[1]);
+        close(outPipe[0]);
+        close(errPipe[0]);
+        return result;
+    }
+
+    // Feed stdin and drain both outputs together, so no pipe fills up and stalls the child
+    size_t written = 0;
+    if (input.empty()) {
+        close(inPipe[1]);
+        inPipe[1] = -1;
+    } else {
+        fcntl(inPipe[1], F_SETFL, O_NONBLOCK);
+    }
+    pollfd fds[3] = {{outPipe[0], POLLIN, 0}, {errPipe[0], POLLIN, 0}, {inPipe[1], POLLOUT, 0}};
+    string* sinks[2] = {&result.output, &result.errors};
+    char buffer[65536];
+    while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                sinks[i]->append(buffer, static_cast<size_t>(n));
+            } else {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+            }
+        }
+        if (fds[2].fd >= 0 && (fds[2].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            ssize_t n = write(fds[2].fd, input.data() + written, input.size() - written);
+            if (n > 0) written += static_cast<size_t>(n);
+            if ((n < 0 && errno != EAGAIN && errno != EINTR) || n == 0 || written == input.size()) {
+                close(fds[2].fd);
+                fds[2].fd = -1;
+            }
+        }
+    }
+    if (fds[2].fd >= 0) close(fds[2].fd);
+
+    int status;
+    rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return result;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.peakRssKb = usage.ru_maxrss;
+    result.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return result;
+}
+
+#endif // CHILD_PROCESS_H
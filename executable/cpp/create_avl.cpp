@@ -5,19 +5,29 @@
 #include <memory>
 #include <algorithm>
 #include <queue>
+#include <sstream>
+#include <thread>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+#include <unordered_set>
 
 using namespace std;
 
+// Largest accepted attendance value (total_attendance runs well past 100)
+const int MAX_ATTENDANCE = 1000;
+
 // AVL Tree Node structure
 struct AVLNode {
     int attendance;     // Key by which we will balance the tree
     vector<int> studentIds;  // Student IDs with this attendance
     int height;
+    int count;          // Number of student IDs in this subtree (order statistics)
     shared_ptr<AVLNode> left;
     shared_ptr<AVLNode> right;
 
     AVLNode(int attend, int studentId) 
-        : attendance(attend), height(1), left(nullptr), right(nullptr) {
+        : attendance(attend), height(1), count(1), left(nullptr), right(nullptr) {
         studentIds.push_back(studentId);
     }
 };
@@ -26,6 +36,10 @@ class AVLTree {
 private:
     shared_ptr<AVLNode> root;
 
+    // Files start with a magic and layout version (see update_avl.cpp)
+    static constexpr uint32_t MAGIC = 0x4c564141;  // "AAVL"
+    static constexpr uint32_t VERSION = 2;
+
     // Get height of a node
     int getHeight(const shared_ptr<AVLNode>& node) {
         if (!node) return 0;
@@ -38,10 +52,17 @@ private:
         return getHeight(node->left) - getHeight(node->right);
     }
 
-    // Update height of a node
+    // Get number of student IDs in a subtree
+    int getCount(const shared_ptr<AVLNode>& node) {
+        if (!node) return 0;
+        return node->count;
+    }
+
+    // Update height and subtree student count of a node
     void updateHeight(shared_ptr<AVLNode>& node) {
         if (!node) return;
         node->height = 1 + max(getHeight(node->left), getHeight(node->right));
+        node->count = static_cast<int>(node->studentIds.size()) + getCount(node->left) + getCount(node->right);
     }
 
     // Right rotation
@@ -92,6 +113,7 @@ private:
             // Check if student ID already exists to avoid duplicates
             if (find(node->studentIds.begin(), node->studentIds.end(), studentId) == node->studentIds.end()) {
                 node->studentIds.push_back(studentId);
+                node->count++;
             }
             return node;
         }
@@ -152,11 +174,50 @@ private:
         // Write node height
         outFile.write(reinterpret_cast<const char*>(&root->height), sizeof(int));
         
+        // Write subtree student count
+        outFile.write(reinterpret_cast<const char*>(&root->count), sizeof(int));
+        
         // Recursively serialize left and right subtrees
         serializeHelper(outFile, root->left);
         serializeHelper(outFile, root->right);
     }
 
+    // Link nodes[lo, hi), sorted by attendance, into a balanced subtree: every
+    // node's subtrees differ in height by at most one, so it is an AVL tree
+    shared_ptr<AVLNode> linkBalanced(vector<shared_ptr<AVLNode>>& nodes, size_t lo, size_t hi) {
+        if (lo >= hi) return nullptr;
+        size_t mid = lo + (hi - lo) / 2;
+        shared_ptr<AVLNode> node = nodes[mid];
+        node->left = linkBalanced(nodes, lo, mid);
+        node->right = linkBalanced(nodes, mid + 1, hi);
+        updateHeight(node);
+        return node;
+    }
+
+    // Helper function to collect (student ID, attendance) pairs for the index
+    void collectIndex(const shared_ptr<AVLNode>& node, vector<pair<int, int>>& entries) {
+        if (!node) return;
+        for (const auto& id : node->studentIds) {
+            entries.push_back({id, node->attendance});
+        }
+        collectIndex(node->left, entries);
+        collectIndex(node->right, entries);
+    }
+
+    // Write the student ID -> attendance index as an array sorted by ID,
+    // so update_avl can find a student's bucket without scanning the tree
+    void serializeIndex(ofstream& outFile) {
+        vector<pair<int, int>> entries;
+        collectIndex(root, entries);
+        sort(entries.begin(), entries.end());
+        
+        size_t numEntries = entries.size();
+        outFile.write(reinterpret_cast<const char*>(&numEntries), sizeof(size_t));
+        if (numEntries > 0) {
+            outFile.write(reinterpret_cast<const char*>(entries.data()), numEntries * sizeof(pair<int, int>));
+        }
+    }
+
 public:
     AVLTree() : root(nullptr) {}
 
@@ -165,6 +226,30 @@ public:
         root = insertNode(root, attendance, studentId);
     }
 
+    // Replace the tree with one over (attendance, student ID) entries: sort by
+    // attendance, one node per value, linked balanced. O(n log n) for the sort,
+    // where inserting one at a time searches the bucket for a duplicate on
+    // every insert. Buckets keep the entries' order, and an ID repeated within
+    // a bucket is kept once, as insert() does.
+    void build(vector<pair<int, int>> entries) {
+        stable_sort(entries.begin(), entries.end(),
+                    [](const pair<int, int>& a, const pair<int, int>& b) { return a.first < b.first; });
+        vector<shared_ptr<AVLNode>> nodes;
+        unordered_set<int> bucketIds;
+        for (size_t i = 0; i < entries.size();) {
+            auto node = make_shared<AVLNode>(entries[i].first, entries[i].second);
+            bucketIds.clear();
+            bucketIds.insert(entries[i].second);
+            for (++i; i < entries.size() && entries[i].first == node->attendance; ++i) {
+                if (bucketIds.insert(entries[i].second).second) {
+                    node->studentIds.push_back(entries[i].second);
+                }
+            }
+            nodes.push_back(move(node));
+        }
+        root = linkBalanced(nodes, 0, nodes.size());
+    }
+
     // Serialize the AVL tree to a binary file
     bool serialize(const string& filename) {
         ofstream outFile(filename, ios::binary);
@@ -173,12 +258,32 @@ public:
             return false;
         }
 
+        uint32_t header[2] = {MAGIC, VERSION};
+        outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
         serializeHelper(outFile, root);
+        serializeIndex(outFile);
         outFile.close();
         
         return true;
     }
 
+    // Collect (attendance, student ID) pairs in ascending attendance order
+    void collectEntries(const shared_ptr<AVLNode>& node, vector<pair<int, int>>& entries) {
+        if (!node) return;
+        collectEntries(node->left, entries);
+        for (const auto& id : node->studentIds) {
+            entries.push_back({node->attendance, id});
+        }
+        collectEntries(node->right, entries);
+    }
+
+    // (attendance, student ID) pairs in ascending attendance order, for the read snapshot
+    vector<pair<int, int>> getEntries() {
+        vector<pair<int, int>> entries;
+        collectEntries(root, entries);
+        return entries;
+    }
+
     // Print the AVL tree (in-order traversal) - for debugging purposes
     void printInOrder(const shared_ptr<AVLNode>& node) {
         if (!node) return;
@@ -203,17 +308,64 @@ public:
     }
 };
 
-// Function to read student attendance data from stdin and build the AVL tree
-AVLTree buildAVLTree() {
-    AVLTree tree;
+#ifdef ATTENDANCE_HISTOGRAM
+#include "attendance_histogram.h"
+using AttendanceIndex = AttendanceHistogram;
+#else
+using AttendanceIndex = AVLTree;
+#endif
+
+#include "attendance_snapshot.h"
+#include "write_ahead_log.h"
+#include "metrics.h"
+
+// With --csv the compute and serialize phases run on one thread per subject,
+// so their totals are summed over threads and may exceed wall_seconds
+metrics::Phase parsePhase("parse");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Counter rowsScanned("rows_scanned");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");
+
+// Publish a subject index under the subject's writer lock, as update_avl does:
+// the .dat is written to a temporary file and renamed over the old one, then
+// the .snap is replaced the same way, so threshold (which takes no lock) always
+// opens a complete version
+bool publishIndex(AttendanceIndex& index, const string& datFilename) {
+    metrics::ScopedTimer serializeTimer(serializePhase);
+    FileLock lock(datFilename + ".lock", true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << datFilename << ".lock" << endl;
+        return false;
+    }
+    const string tmpFilename = datFilename + ".tmp";
+    if (!index.serialize(tmpFilename) || !replaceFile(tmpFilename, datFilename)) {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    bytesWritten.addFileSize(datFilename);
+    if (!writeSnapshot(snapshotFilename(datFilename), index.getEntries())) {
+        return false;
+    }
+    bytesWritten.addFileSize(snapshotFilename(datFilename));
+    return true;
+}
+
+// Function to read student attendance data from stdin and build the attendance index
+AttendanceIndex buildAVLTree() {
+    AttendanceIndex tree;
     int attendance, studentId;
     
     cout << "Enter attendance and student ID pairs (Ctrl+Z or Ctrl+D to end):" << endl;
     cout << "Format: <attendance> <student_id>" << endl;
     
+    // Reading and inserting are interleaved, so both count as compute
+    metrics::ScopedTimer computeTimer(computePhase);
     while (cin >> attendance >> studentId) {
-        if (attendance < 0 || attendance > 100) {
-            cerr << "Warning: Attendance should be between 0 and 100. Skipping entry." << endl;
+        rowsScanned.add();
+        if (attendance < 0 || attendance > MAX_ATTENDANCE) {
+            cerr << "Warning: Attendance should be between 0 and " << MAX_ATTENDANCE << ". Skipping entry." << endl;
             continue;
         }
         tree.insert(attendance, studentId);
@@ -225,22 +377,200 @@ AVLTree buildAVLTree() {
     return tree;
 }
 
+// One subject column of attendance.csv: (attendance, student ID) in row order
+struct SubjectColumn {
+    string name;
+    vector<pair<int, int>> entries;
+    int skipped = 0;   // Rows with attendance outside [0, MAX_ATTENDANCE]
+    bool written = false;
+};
+
+// Subject names become file names, so only accept plain identifiers
+bool isValidSubject(const string& subject) {
+    if (subject.empty()) return false;
+    for (char c : subject) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+    }
+    return true;
+}
+
+// Parse a numeric CSV field (an integer, possibly written with a fractional part)
+// starting at p; returns false if the field is not a number
+bool scanNumber(const char*& p, const char* end, int& value) {
+    // strtol would skip leading whitespace, including the newline of an empty row
+    if (p == end || !(isdigit(static_cast<unsigned char>(*p)) || *p == '-' || *p == '+')) return false;
+    char* numberEnd;
+    long parsed = strtol(p, &numberEnd, 10);
+    if (numberEnd == p) return false;
+    p = numberEnd;
+    if (p < end && *p == '.') {
+        do ++p; while (p < end && isdigit(static_cast<unsigned char>(*p)));
+    }
+    value = static_cast<int>(parsed);
+    return p == end || *p == ',' || *p == '\r' || *p == '\n';
+}
+
+// Skip the rest of a field (quoted or not) and its trailing comma
+void skipField(const char*& p, const char* end) {
+    if (p < end && *p == '"') {
+        for (++p; p < end; ++p) {
+            if (*p != '"') continue;
+            if (p + 1 < end && p[1] == '"') {
+                ++p;  // Escaped quote
+                continue;
+            }
+            ++p;
+            break;
+        }
+    }
+    while (p < end && *p != ',' && *p != '\n') ++p;
+    if (p < end && *p == ',') ++p;
+}
+
+// Read attendance.csv in one pass: student_id, name, then one column per subject
+bool scanAttendanceCSV(const string& csvFilename, vector<SubjectColumn>& columns) {
+    metrics::ScopedTimer parseTimer(parsePhase);
+    ifstream csvFile(csvFilename, ios::binary);
+    if (!csvFile) {
+        cerr << "Error opening CSV file: " << csvFilename << endl;
+        return false;
+    }
+    ostringstream buffer;
+    buffer << csvFile.rdbuf();
+    const string contents = buffer.str();
+    bytesRead.add(contents.size());
+    const char* p = contents.data();
+    const char* end = p + contents.size();
+
+    // Header
+    const char* lineEnd = find(p, end, '\n');
+    string header(p, lineEnd);
+    if (!header.empty() && header.back() == '\r') header.pop_back();
+    stringstream headerStream(header);
+    string column;
+    vector<string> names;
+    while (getline(headerStream, column, ',')) {
+        names.push_back(column);
+    }
+    if (names.size() < 3 || names[0] != "student_id") {
+        cerr << "Unexpected CSV header in " << csvFilename << endl;
+        return false;
+    }
+    columns.clear();
+    for (size_t i = 2; i < names.size(); ++i) {
+        if (!isValidSubject(names[i])) {
+            cerr << "Invalid subject column '" << names[i] << "' in " << csvFilename << endl;
+            return false;
+        }
+        columns.push_back({names[i], {}});
+    }
+    p = lineEnd < end ? lineEnd + 1 : end;
+
+    // Rows
+    size_t rows = 0;
+    while (p < end) {
+        lineEnd = find(p, end, '\n');
+        const char* row = p;
+        p = lineEnd < end ? lineEnd + 1 : end;
+        ++rows;
+
+        const char* rowStart = row;
+        int studentId;
+        if (!scanNumber(row, lineEnd, studentId) || row == lineEnd || *row != ',') {
+            if (rowStart != lineEnd && *rowStart != '\r') {
+                cerr << "Warning: skipping malformed row: " << string(rowStart, lineEnd) << endl;
+            }
+            continue;
+        }
+        ++row;
+        skipField(row, lineEnd);
+
+        vector<int> values(columns.size());
+        bool valid = true;
+        for (size_t c = 0; c < columns.size() && valid; ++c) {
+            valid = row < lineEnd && scanNumber(row, lineEnd, values[c]);
+            if (valid && row < lineEnd && *row == ',') ++row;
+        }
+        if (!valid) {
+            cerr << "Warning: skipping malformed row for student ID " << studentId << endl;
+            continue;
+        }
+        for (size_t c = 0; c < columns.size(); ++c) {
+            if (values[c] < 0 || values[c] > MAX_ATTENDANCE) {
+                ++columns[c].skipped;
+                continue;
+            }
+            columns[c].entries.push_back({values[c], studentId});
+        }
+    }
+    rowsScanned.add(rows);
+    return true;
+}
+
+// Build and write <dir>/<subject>.dat and .snap for every subject column of
+// attendance.csv, one thread per subject
+int buildFromCSV(const string& csvFilename, const string& outputDir) {
+    vector<SubjectColumn> columns;
+    if (!scanAttendanceCSV(csvFilename, columns)) {
+        return 1;
+    }
+
+    vector<thread> workers;
+    for (auto& column : columns) {
+        workers.emplace_back([&column, &outputDir]() {
+            AttendanceIndex tree;
+            {
+                metrics::ScopedTimer computeTimer(computePhase);
+                tree.build(move(column.entries));
+            }
+            const string datFilename = outputDir + "/" + column.name + ".dat";
+            column.written = publishIndex(tree, datFilename);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    int failed = 0;
+    for (const auto& column : columns) {
+        if (column.skipped > 0) {
+            cerr << "Warning: skipped " << column.skipped << " " << column.name
+                 << " values outside 0.." << MAX_ATTENDANCE << endl;
+        }
+        if (!column.written) {
+            cerr << "Failed to write the " << column.name << " index" << endl;
+            ++failed;
+        }
+    }
+    if (failed > 0) {
+        return 1;
+    }
+    cout << "Built " << columns.size() << " subject indexes in " << outputDir << endl;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc == 4 && string(argv[1]) == "--csv") {
+        return buildFromCSV(argv[2], argv[3]);
+    }
+
     if (argc != 2) {
         cerr << "Usage: " << argv[0] << " <output_dat_file>" << endl;
+        cerr << "       " << argv[0] << " --csv <attendance_csv> <output_dir>  (builds every subject index)" << endl;
         return 1;
     }
 
     const string outFilename = argv[1];
     
     // Build the AVL tree
-    AVLTree avlTree = buildAVLTree();
+    AttendanceIndex avlTree = buildAVLTree();
     
     // Print the tree (optional, for debugging)
     avlTree.printTree();
     
     // Serialize the AVL tree
-    if (avlTree.serialize(outFilename)) {
+    if (publishIndex(avlTree, outFilename)) {
         cout << "AVL tree successfully serialized to " << outFilename << endl;
         return 0;
     } else {
@@ -3,15 +3,27 @@
 #include <sstream>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <memory>
+#include <algorithm>
+#include <cstdio>
+
+#include "art_children.h"
+#include "face_gallery.h"
+#include "write_ahead_log.h"
+#include "metrics.h"
 
 using namespace std;
 
+metrics::Phase parsePhase("parse");
+metrics::Phase serializePhase("serialize");
+metrics::Counter rowsScanned("rows_scanned");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");
+
 // Trie node structure
 struct TrieNode {
     bool isEndOfName;
-    unordered_map<char, shared_ptr<TrieNode>> children;
+    ArtChildren<shared_ptr<TrieNode>> children;  // Node4/16/48/256, see art_children.h
     vector<string> studentIds; // Store IDs at the end of each name
 
     TrieNode() : isEndOfName(false) {}
@@ -37,18 +49,20 @@ private:
             outFile.write(id.c_str(), idLength);
         }
         
-        // Write number of children
+        // Write the node kind and number of children
+        uint8_t kind = static_cast<uint8_t>(node->children.kind());
+        outFile.write(reinterpret_cast<const char*>(&kind), sizeof(uint8_t));
         size_t numChildren = node->children.size();
         outFile.write(reinterpret_cast<const char*>(&numChildren), sizeof(size_t));
         
-        // Write each child
-        for (const auto& [ch, childNode] : node->children) {
+        // Write each child, in key order
+        node->children.forEach([&](char ch, const shared_ptr<TrieNode>& childNode) {
             // Write the character
             outFile.write(&ch, sizeof(char));
             
             // Recursively serialize the child node
             serializeHelper(outFile, childNode);
-        }
+        });
     }
 
 public:
@@ -61,26 +75,41 @@ public:
         shared_ptr<TrieNode> current = root;
         
         for (char c : name) {
-            if (current->children.find(c) == current->children.end()) {
-                current->children[c] = make_shared<TrieNode>();
+            const shared_ptr<TrieNode>* child = current->children.find(c);
+            if (!child) {
+                auto node = make_shared<TrieNode>();
+                current->children.set(c, node);
+                current = node;
+            } else {
+                current = *child;
             }
-            current = current->children[c];
         }
         
         current->isEndOfName = true;
-        current->studentIds.push_back(studentId);
+        
+        // A student with several templates has several rows
+        if (find(current->studentIds.begin(), current->studentIds.end(), studentId) == current->studentIds.end()) {
+            current->studentIds.push_back(studentId);
+        }
     }
 
-    // Serialize the trie to a binary file
+    // Serialize the trie to a temporary file and rename it over the binary file,
+    // so search_trie (which takes no lock) never reads a half-written trie
     bool serialize(const string& filename) {
-        ofstream outFile(filename, ios::binary);
+        const string tmpFilename = filename + ".tmp";
+        ofstream outFile(tmpFilename, ios::binary);
         if (!outFile) {
-            cerr << "Error opening file for writing: " << filename << endl;
+            cerr << "Error opening file for writing: " << tmpFilename << endl;
             return false;
         }
 
+        outFile.write(ART_TRIE_MAGIC, sizeof(ART_TRIE_MAGIC));
         serializeHelper(outFile, root);
         outFile.close();
+        if (!outFile || !replaceFile(tmpFilename, filename)) {
+            remove(tmpFilename.c_str());
+            return false;
+        }
         return true;
     }
 };
@@ -107,7 +136,9 @@ vector<string> parseCSVLine(const string& line) {
     return result;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    metrics::Report report(argc > 0 ? argv[0] : "create_trie");
+    
     // Using fixed filenames
     const string csvFilename = "executable/data/students.csv";
     const string trieFilename = "executable/serialized/name.dat";
@@ -122,12 +153,22 @@ int main() {
     Trie trie;
     string line;
     bool isFirstLine = true; // To skip header if present
+    size_t row = 0;          // Data row, as tombstones count them
+    
+    // Removed students keep their rows until the gallery is compacted
+    GalleryTombstones tombstones = loadTombstones(csvFilename);
     
+    // Rows are parsed and inserted in one pass
+    metrics::ScopedTimer parseTimer(parsePhase);
+    bytesRead.addFileSize(csvFilename);
     while (getline(csvFile, line)) {
+        rowsScanned.add();
         if (isFirstLine) {
             isFirstLine = false;
             // Uncomment the following line if the CSV has a header row
             // continue;
+        } else if (isTombstoned(tombstones, row++, rowStudentId(line))) {
+            continue;
         }
         
         auto fields = parseCSVLine(line);
@@ -137,9 +178,20 @@ int main() {
             trie.insert(name, studentId);
         }
     }
+    parseTimer.stop();
+    
+    // Writers of name.dat take its lock, so this rebuild and insert_trie never interleave
+    FileLock lock(trieFilename + ".lock", true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << trieFilename << ".lock" << endl;
+        return 1;
+    }
     
     // Serialize the trie
+    metrics::ScopedTimer serializeTimer(serializePhase);
     if (trie.serialize(trieFilename)) {
+        serializeTimer.stop();
+        bytesWritten.addFileSize(trieFilename);
         cout << "Trie has been successfully serialized to " << trieFilename << endl;
         return 0;
     } else {
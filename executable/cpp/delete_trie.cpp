@@ -0,0 +1,233 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+
+#include "write_ahead_log.h"
+#include "art_children.h"
+#include "metrics.h"
+
+using namespace std;
+
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Counter nodesVisited("nodes_visited");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");  
+
+// Trie node structure (consistent with the other programs)
+struct TrieNode {
+    bool isEndOfName;
+    ArtChildren<shared_ptr<TrieNode>> children;  // Node4/16/48/256, see art_children.h
+    vector<string> studentIds;
+
+    TrieNode() : isEndOfName(false) {}
+};
+
+class Trie {
+private:
+    shared_ptr<TrieNode> root;
+
+    // Helper function to deserialize the trie
+    shared_ptr<TrieNode> deserializeHelper(ifstream& inFile, bool withKinds) {
+        auto node = make_shared<TrieNode>();
+        
+        // Read if this node marks the end of a name
+        inFile.read(reinterpret_cast<char*>(&node->isEndOfName), sizeof(bool));
+        
+        // Read number of student IDs at this node
+        size_t numIds;
+        inFile.read(reinterpret_cast<char*>(&numIds), sizeof(size_t));
+        
+        // Read each student ID
+        for (size_t i = 0; i < numIds; ++i) {
+            size_t idLength;
+            inFile.read(reinterpret_cast<char*>(&idLength), sizeof(size_t));
+            
+            string id(idLength, '\0');
+            inFile.read(&id[0], idLength);
+            node->studentIds.push_back(id);
+        }
+        
+        // Read the node kind (absent from files older than node kinds) and
+        // number of children
+        uint8_t kind = 0;
+        if (withKinds) inFile.read(reinterpret_cast<char*>(&kind), sizeof(uint8_t));
+        size_t numChildren;
+        inFile.read(reinterpret_cast<char*>(&numChildren), sizeof(size_t));
+        if (withKinds && numChildren > 0 && kind <= static_cast<uint8_t>(ArtKind::Node256)) {
+            node->children.reserve(static_cast<ArtKind>(kind));
+        }
+        
+        // Read each child
+        for (size_t i = 0; i < numChildren && inFile; ++i) {
+            char ch;
+            inFile.read(&ch, sizeof(char));
+            
+            // Recursively deserialize the child node
+            node->children.set(ch, deserializeHelper(inFile, withKinds));
+        }
+        
+        return node;
+    }
+
+    // Helper function to serialize the trie
+    void serializeHelper(ofstream& outFile, const shared_ptr<TrieNode>& node) {
+        // Write if this node marks the end of a name
+        outFile.write(reinterpret_cast<const char*>(&node->isEndOfName), sizeof(bool));
+        
+        // Write number of student IDs at this node
+        size_t numIds = node->studentIds.size();
+        outFile.write(reinterpret_cast<const char*>(&numIds), sizeof(size_t));
+        
+        // Write each student ID
+        for (const auto& id : node->studentIds) {
+            size_t idLength = id.length();
+            outFile.write(reinterpret_cast<const char*>(&idLength), sizeof(size_t));
+            outFile.write(id.c_str(), idLength);
+        }
+        
+        // Write the node kind and number of children
+        uint8_t kind = static_cast<uint8_t>(node->children.kind());
+        outFile.write(reinterpret_cast<const char*>(&kind), sizeof(uint8_t));
+        size_t numChildren = node->children.size();
+        outFile.write(reinterpret_cast<const char*>(&numChildren), sizeof(size_t));
+        
+        // Write each child, in key order
+        node->children.forEach([&](char ch, const shared_ptr<TrieNode>& childNode) {
+            // Write the character
+            outFile.write(&ch, sizeof(char));
+            
+            // Recursively serialize the child node
+            serializeHelper(outFile, childNode);
+        });
+    }
+
+    // Helper function to remove a student ID below a node
+    bool removeHelper(const shared_ptr<TrieNode>& node, const string& name, size_t depth, const string& studentId) {
+        nodesVisited.add();
+        if (depth == name.size()) {
+            auto& ids = node->studentIds;
+            auto removed = remove(ids.begin(), ids.end(), studentId);
+            if (removed == ids.end()) return false;
+            ids.erase(removed, ids.end());
+            node->isEndOfName = !ids.empty();
+            return true;
+        }
+
+        const shared_ptr<TrieNode>* child = node->children.find(name[depth]);
+        if (!child || !removeHelper(*child, name, depth + 1, studentId)) {
+            return false;
+        }
+        // The child no longer leads to any name
+        if (!(*child)->isEndOfName && (*child)->children.empty()) {
+            node->children.erase(name[depth]);
+        }
+        return true;
+    }
+
+public:
+    Trie() {
+        root = make_shared<TrieNode>();
+    }
+
+    // Deserialize the trie from a binary file
+    bool deserialize(const string& filename) {
+        ifstream inFile(filename, ios::binary);
+        if (!inFile) {
+            cerr << "Error opening file for reading: " << filename << endl;
+            return false;
+        }
+
+        // Files written since node kinds were recorded start with a magic
+        char magic[sizeof(ART_TRIE_MAGIC)] = {};
+        inFile.read(magic, sizeof(magic));
+        bool withKinds = inFile && equal(magic, magic + sizeof(magic), ART_TRIE_MAGIC);
+        if (!withKinds) {
+            inFile.clear();
+            inFile.seekg(0);
+        }
+        root = deserializeHelper(inFile, withKinds);
+        inFile.close();
+        return true;
+    }
+
+    // Serialize the trie to a temporary file and rename it over the binary file,
+    // so search_trie (which takes no lock) never reads a half-written trie
+    bool serialize(const string& filename) {
+        const string tmpFilename = filename + ".tmp";
+        ofstream outFile(tmpFilename, ios::binary);
+        if (!outFile) {
+            cerr << "Error opening file for writing: " << tmpFilename << endl;
+            return false;
+        }
+
+        outFile.write(ART_TRIE_MAGIC, sizeof(ART_TRIE_MAGIC));
+        serializeHelper(outFile, root);
+        outFile.close();
+        if (!outFile || !replaceFile(tmpFilename, filename)) {
+            remove(tmpFilename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Remove a student ID from a name, pruning the nodes left with neither
+    // IDs nor children; returns whether the ID was there
+    bool erase(const string& name, const string& studentId) {
+        return removeHelper(root, name, 0, studentId);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <student_name> <student_id>" << endl;
+        return 1;
+    }
+
+    const string name = argv[1];
+    const string studentId = argv[2];
+    const string trieFilename = "executable/serialized/name.dat";
+    
+    Trie trie;
+    
+    // Single writer: the same lock as insert_trie and the server's trie flushes
+    FileLock lock(trieFilename + ".lock", true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << trieFilename << ".lock" << endl;
+        return 1;
+    }
+    
+    metrics::ScopedTimer loadTimer(loadPhase);
+    if (!trie.deserialize(trieFilename)) {
+        cerr << "Failed to deserialize the trie from " << trieFilename << endl;
+        return 1;
+    }
+    bytesRead.addFileSize(trieFilename);
+    loadTimer.stop();
+    
+    metrics::ScopedTimer computeTimer(computePhase);
+    bool removed = trie.erase(name, studentId);
+    computeTimer.stop();
+    if (!removed) {
+        cout << "Name " << name << " with student ID " << studentId << " not found" << endl;
+        return 1;
+    }
+    cout << "Removed name: " << name << " with student ID: " << studentId << endl;
+    
+    metrics::ScopedTimer serializeTimer(serializePhase);
+    if (trie.serialize(trieFilename)) {
+        serializeTimer.stop();
+        bytesWritten.addFileSize(trieFilename);
+        cout << "Trie has been successfully updated and serialized." << endl;
+        return 0;
+    } else {
+        cerr << "Failed to serialize the updated trie" << endl;
+        return 1;
+    }
+}
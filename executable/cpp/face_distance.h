@@ -0,0 +1,270 @@
+// Distance kernels for face descriptors, specialized at compile time for the
+// common embedding sizes (128, 256 and 512) and generic for any other.
+//
+// squaredDistance sums (a[i] - b[i])^2 in SIMD lanes: AVX when the build
+// enables it (-mavx or -march=native), SSE2 on any x86-64 build, scalar
+// elsewhere. minSquaredDistance scores a probe against a student's
+// templates, stored back to back, in one pass: each block of the probe is
+// loaded once and compared with the same block of up to four templates.
+// Every template is summed in the same order as squaredDistance sums it, so
+// both kernels, and every specialization, give bit-identical distances.
+// minDistanceKernel picks the instantiation for a gallery's dimension once,
+// when the gallery is loaded.
+//
+// A scan that only needs distances up to a bound (the acceptance distance,
+// or the nearest found so far) uses boundedMinSquaredDistance, which checks
+// the partial sums every ABANDON_CHECK_DIMENSIONS elements and abandons
+// templates already past the bound. The partial sum of a template never
+// exceeds its full sum, so a template is only abandoned when its full sum
+// would have been past the bound too; the templates that are finished get
+// the same sums as in the full scan.
+
+#ifndef FACE_DISTANCE_H
+#define FACE_DISTANCE_H
+
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Templates scored together by minSquaredDistance
+const size_t TEMPLATES_PER_PASS = 4;
+
+// Elements summed between two checks of boundedMinSquaredDistance
+const size_t ABANDON_CHECK_DIMENSIONS = 32;
+
+namespace distance_detail {
+
+#if defined(__AVX__)
+const size_t LANES = 4;
+using Lane = __m256d;
+inline Lane zero() { return _mm256_setzero_pd(); }
+inline Lane load(const double* p) { return _mm256_loadu_pd(p); }
+inline Lane squareDiff(Lane acc, Lane a, Lane b) {
+    Lane d = _mm256_sub_pd(a, b);
+    return _mm256_add_pd(acc, _mm256_mul_pd(d, d));
+}
+inline double total(Lane acc0, Lane acc1) {
+    Lane acc = _mm256_add_pd(acc0, acc1);
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+const size_t LANES = 2;
+using Lane = __m128d;
+inline Lane zero() { return _mm_setzero_pd(); }
+inline Lane load(const double* p) { return _mm_loadu_pd(p); }
+inline Lane squareDiff(Lane acc, Lane a, Lane b) {
+    Lane d = _mm_sub_pd(a, b);
+    return _mm_add_pd(acc, _mm_mul_pd(d, d));
+}
+inline double total(Lane acc0, Lane acc1) {
+    Lane acc = _mm_add_pd(acc0, acc1);
+    return _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+}
+#else
+// Scalar fallback with the same two-accumulator shape
+const size_t LANES = 1;
+using Lane = double;
+inline Lane zero() { return 0.0; }
+inline Lane load(const double* p) { return *p; }
+inline Lane squareDiff(Lane acc, Lane a, Lane b) { return acc + (a - b) * (a - b); }
+inline double total(Lane acc0, Lane acc1) { return acc0 + acc1; }
+#endif
+
+inline double tail(const double* a, const double* b, size_t from, size_t n, double sum) {
+    for (size_t i = from; i < n; ++i) {
+        double d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+// One step: two lanes of the probe against the same lanes of K templates
+template <size_t K>
+inline void step(const double* probe, const double* templates, size_t n, size_t i, Lane* acc0, Lane* acc1) {
+    Lane p0 = load(probe + i);
+    Lane p1 = load(probe + i + LANES);
+    for (size_t k = 0; k < K; ++k) {
+        acc0[k] = squareDiff(acc0[k], p0, load(templates + k * n + i));
+        acc1[k] = squareDiff(acc1[k], p1, load(templates + k * n + i + LANES));
+    }
+}
+
+// The steps from element first on, unrolled
+template <size_t K, size_t... Steps>
+inline void unrolledSteps(const double* probe, const double* templates, size_t n, size_t first, Lane* acc0,
+                          Lane* acc1, index_sequence<Steps...>) {
+    (step<K>(probe, templates, n, first + Steps * 2 * LANES, acc0, acc1), ...);
+}
+
+// Steps between two checks of the partial sums
+const size_t STEPS_PER_CHECK = ABANDON_CHECK_DIMENSIONS / (2 * LANES);
+
+// Whether the partial sums of all K templates are above bound; if so they
+// go to out. Each lane only grows and total is monotone in both, so a full
+// sum is never below a partial one.
+template <size_t K>
+inline bool allAbove(const Lane* acc0, const Lane* acc1, double bound, double* out) {
+    for (size_t k = 0; k < K; ++k) {
+        out[k] = total(acc0[k], acc1[k]);
+        if (!(out[k] > bound)) return false;
+    }
+    return true;
+}
+
+// Squared distances from a probe to K templates stored back to back. With
+// N > 0 the dimension is a compile-time constant and the steps are fully
+// unrolled; N = 0 takes the dimension n at run time. Both sum in the same order.
+template <size_t K, size_t N>
+inline void squaredDistances(const double* probe, const double* templates, size_t n, double* out) {
+    Lane acc0[K], acc1[K];
+    for (size_t k = 0; k < K; ++k) {
+        acc0[k] = zero();
+        acc1[k] = zero();
+    }
+    size_t vectorEnd;
+    if constexpr (N > 0) {
+        n = N;
+        vectorEnd = N - N % (2 * LANES);
+        unrolledSteps<K>(probe, templates, N, 0, acc0, acc1, make_index_sequence<N / (2 * LANES)>());
+    } else {
+        vectorEnd = n - n % (2 * LANES);
+        for (size_t i = 0; i < vectorEnd; i += 2 * LANES) {
+            step<K>(probe, templates, n, i, acc0, acc1);
+        }
+    }
+    for (size_t k = 0; k < K; ++k) {
+        out[k] = tail(probe, templates + k * n, vectorEnd, n, total(acc0[k], acc1[k]));
+    }
+}
+
+// squaredDistances that gives up once all K partial sums are above bound,
+// checking every ABANDON_CHECK_DIMENSIONS elements. Returns the elements
+// summed per template: n when finished, in which case out holds the same
+// sums as squaredDistances; fewer when abandoned, with the partial sums in out.
+template <size_t K, size_t N>
+inline size_t boundedSquaredDistances(const double* probe, const double* templates, size_t n, double bound,
+                                      double* out) {
+    if constexpr (N > 0) n = N;
+    Lane acc0[K], acc1[K];
+    for (size_t k = 0; k < K; ++k) {
+        acc0[k] = zero();
+        acc1[k] = zero();
+    }
+    const size_t vectorEnd = n - n % (2 * LANES);
+    size_t i = 0;
+    for (; i + ABANDON_CHECK_DIMENSIONS <= vectorEnd; i += ABANDON_CHECK_DIMENSIONS) {
+        if (i > 0 && allAbove<K>(acc0, acc1, bound, out)) return i;
+        unrolledSteps<K>(probe, templates, n, i, acc0, acc1, make_index_sequence<STEPS_PER_CHECK>());
+    }
+    for (; i < vectorEnd; i += 2 * LANES) {
+        step<K>(probe, templates, n, i, acc0, acc1);
+    }
+    for (size_t k = 0; k < K; ++k) {
+        out[k] = tail(probe, templates + k * n, vectorEnd, n, total(acc0[k], acc1[k]));
+    }
+    return n;
+}
+
+} // namespace distance_detail
+
+template <size_t N = 0>
+inline double squaredDistance(const double* a, const double* b, size_t n) {
+    double result;
+    distance_detail::squaredDistances<1, N>(a, b, n, &result);
+    return result;
+}
+
+// Smallest squared distance from a probe to count templates of n values each
+template <size_t N = 0>
+inline double minSquaredDistance(const double* probe, const double* templates, size_t count, size_t n) {
+    if constexpr (N > 0) n = N;
+    double best = numeric_limits<double>::max();
+    double distances[TEMPLATES_PER_PASS];
+    size_t t = 0;
+    for (; t + TEMPLATES_PER_PASS <= count; t += TEMPLATES_PER_PASS) {
+        distance_detail::squaredDistances<TEMPLATES_PER_PASS, N>(probe, templates + t * n, n, distances);
+        best = min(best, *min_element(distances, distances + TEMPLATES_PER_PASS));
+    }
+    for (; t + 2 <= count; t += 2) {
+        distance_detail::squaredDistances<2, N>(probe, templates + t * n, n, distances);
+        best = min(best, min(distances[0], distances[1]));
+    }
+    if (t < count) {
+        best = min(best, squaredDistance<N>(probe, templates + t * n, n));
+    }
+    return best;
+}
+
+// minSquaredDistance for a scan that only needs distances up to bound:
+// templates whose partial sum passes bound are abandoned. Every template
+// at or below bound (and below the nearest found so far) is summed in full,
+// so the result is minSquaredDistance's whenever that is at most bound, and
+// above bound otherwise. dimensions, if given, counts the elements summed.
+template <size_t N = 0>
+inline double boundedMinSquaredDistance(const double* probe, const double* templates, size_t count, size_t n,
+                                        double bound, size_t* dimensions) {
+    if constexpr (N > 0) n = N;
+    double best = numeric_limits<double>::max();
+    double distances[TEMPLATES_PER_PASS];
+    size_t summed = 0;
+    size_t t = 0;
+    for (; t + TEMPLATES_PER_PASS <= count; t += TEMPLATES_PER_PASS) {
+        summed += TEMPLATES_PER_PASS * distance_detail::boundedSquaredDistances<TEMPLATES_PER_PASS, N>(
+                                           probe, templates + t * n, n, min(bound, best), distances);
+        best = min(best, *min_element(distances, distances + TEMPLATES_PER_PASS));
+    }
+    for (; t + 2 <= count; t += 2) {
+        summed += 2 * distance_detail::boundedSquaredDistances<2, N>(probe, templates + t * n, n, min(bound, best),
+                                                                     distances);
+        best = min(best, min(distances[0], distances[1]));
+    }
+    if (t < count) {
+        summed += distance_detail::boundedSquaredDistances<1, N>(probe, templates + t * n, n, min(bound, best),
+                                                                 distances);
+        best = min(best, distances[0]);
+    }
+    if (dimensions) *dimensions += summed;
+    return best;
+}
+
+using MinDistanceKernel = double (*)(const double*, const double*, size_t, size_t);
+using BoundedMinDistanceKernel = double (*)(const double*, const double*, size_t, size_t, double, size_t*);
+
+// The kernel instantiated for an embedding size: unrolled for 128 (dlib),
+// 256 and 512, the run-time loop for any other size
+inline MinDistanceKernel minDistanceKernel(size_t dimension) {
+    switch (dimension) {
+        case 128: return minSquaredDistance<128>;
+        case 256: return minSquaredDistance<256>;
+        case 512: return minSquaredDistance<512>;
+        default: return minSquaredDistance<0>;
+    }
+}
+
+inline BoundedMinDistanceKernel boundedMinDistanceKernel(size_t dimension) {
+    switch (dimension) {
+        case 128: return boundedMinSquaredDistance<128>;
+        case 256: return boundedMinSquaredDistance<256>;
+        case 512: return boundedMinSquaredDistance<512>;
+        default: return boundedMinSquaredDistance<0>;
+    }
+}
+
+// A squared distance whose square root is not below distance, so that no
+// squared distance above it is closer than distance despite rounding
+inline double squaredLimit(double distance) {
+    double limit = distance * distance;
+    while (sqrt(limit) < distance) limit = nextafter(limit, numeric_limits<double>::infinity());
+    return limit;
+}
+
+#endif // FACE_DISTANCE_H
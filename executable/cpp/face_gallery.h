@@ -0,0 +1,628 @@
+// Face gallery: the registered facial vectors of students.csv and a nearest
+// match over them, for tools that match many probes in one process.
+//
+// students.csv rows are  student_id,name,roll_number,"v1,v2,...,v128"
+// and a student may have several rows, one per template (the server stores
+// each registration pose). A probe matches the student whose nearest
+// template is the nearest, if closer than the acceptance distance (0.6 for
+// dlib embeddings, as in vectordistance.cpp). In memory, and in the compiled
+// gallery file written by `gallery compile`, a student's templates are
+// stored back to back so that one pass of the distance kernel
+// (face_distance.h) scores all of them. The scan abandons templates whose
+// partial distance already passes the acceptance distance or the nearest
+// template so far, and `gallery compile` stores the dimensions in
+// descending order of variance across the gallery, so that the partial
+// distances of the wrong students pass those bounds as early as possible.
+//
+// Removing a student does not rewrite students.csv: it tombstones the
+// student's rows in <students.csv>.deleted, one "row,student_id" line per
+// row, row being the 0-based data row below the header. Every reader of the
+// gallery skips tombstoned rows; a tombstone whose row no longer holds that
+// student ID (students.csv was rewritten since) is stale and ignored. Once
+// tombstoned rows reach a ratio of the file, compaction rewrites students.csv
+// without them and deletes the tombstones, so a scan costs the active roster
+// rather than every student ever registered. Writers of either file hold
+// <students.csv>.lock; new students are only ever appended, which keeps the
+// row numbers of the tombstones valid until the next compaction.
+
+#ifndef FACE_GALLERY_H
+#define FACE_GALLERY_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <iomanip>
+
+#include "face_distance.h"
+#include "write_ahead_log.h"
+
+using namespace std;
+
+const double MATCH_DISTANCE = 0.6;
+
+// Share of tombstoned rows at which a removal compacts students.csv
+const double GALLERY_COMPACT_RATIO = 0.25;
+
+// Data row -> student ID it held when it was tombstoned
+using GalleryTombstones = unordered_map<size_t, long long>;
+
+struct GalleryStats {
+    size_t rows = 0;        // Data rows in students.csv
+    size_t tombstones = 0;  // Rows among them that are tombstoned
+};
+
+inline string galleryTombstoneFilename(const string& csvFilename) {
+    return csvFilename + ".deleted";
+}
+
+inline string galleryLockFilename(const string& csvFilename) {
+    return csvFilename + ".lock";
+}
+
+// Student ID in the first field of a students.csv row, or -1
+inline long long rowStudentId(const string& line) {
+    try {
+        return stoll(line.substr(0, line.find(',')));
+    } catch (const exception&) {
+        return -1;
+    }
+}
+
+// The tombstones of a gallery (none if it has no tombstone file)
+inline GalleryTombstones loadTombstones(const string& csvFilename) {
+    GalleryTombstones tombstones;
+    ifstream file(galleryTombstoneFilename(csvFilename));
+    string line;
+    while (getline(file, line)) {
+        size_t comma = line.find(',');
+        if (comma == string::npos) continue;  // Torn last line
+        try {
+            tombstones[stoul(line.substr(0, comma))] = stoll(line.substr(comma + 1));
+        } catch (const exception&) {
+        }
+    }
+    return tombstones;
+}
+
+inline bool isTombstoned(const GalleryTombstones& tombstones, size_t row, long long studentId) {
+    auto it = tombstones.find(row);
+    return it != tombstones.end() && it->second == studentId;
+}
+
+namespace gallery_detail {
+
+// Header and data rows of students.csv
+inline bool readRows(const string& csvFilename, string& header, vector<string>& rows) {
+    ifstream file(csvFilename);
+    if (!file.is_open()) {
+        cerr << "Could not open " << csvFilename << endl;
+        return false;
+    }
+    getline(file, header);
+    string line;
+    while (getline(file, line)) {
+        rows.push_back(move(line));
+    }
+    return true;
+}
+
+inline size_t countTombstoned(const vector<string>& rows, const GalleryTombstones& tombstones) {
+    size_t count = 0;
+    for (const auto& [row, studentId] : tombstones) {
+        if (row < rows.size() && rowStudentId(rows[row]) == studentId) ++count;
+    }
+    return count;
+}
+
+// Rewrite students.csv without its tombstoned rows and delete the tombstones.
+// Call with the gallery lock held.
+inline bool compactRows(const string& csvFilename, const string& header, const vector<string>& rows,
+                        const GalleryTombstones& tombstones, GalleryStats& stats) {
+    const string tmpFilename = csvFilename + ".tmp";
+    ofstream out(tmpFilename);
+    if (!out) {
+        cerr << "Error opening file for writing: " << tmpFilename << endl;
+        return false;
+    }
+    stats = GalleryStats();
+    out << header << '\n';
+    for (size_t row = 0; row < rows.size(); ++row) {
+        if (isTombstoned(tombstones, row, rowStudentId(rows[row]))) continue;
+        out << rows[row] << '\n';
+        ++stats.rows;
+    }
+    out.close();
+    if (!out || !syncFile(tmpFilename) || !replaceFile(tmpFilename, csvFilename)) {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    // The row numbers of any tombstone left now point at other rows; a crash
+    // before this removal leaves them stale, which readers ignore
+    remove(galleryTombstoneFilename(csvFilename).c_str());
+    return true;
+}
+
+} // namespace gallery_detail
+
+// Row and tombstone counts of a gallery
+inline bool galleryStats(const string& csvFilename, GalleryStats& stats) {
+    string header;
+    vector<string> rows;
+    if (!gallery_detail::readRows(csvFilename, header, rows)) return false;
+    stats.rows = rows.size();
+    stats.tombstones = gallery_detail::countTombstoned(rows, loadTombstones(csvFilename));
+    return true;
+}
+
+// Tombstone every row of a student, then compact the gallery if tombstoned
+// rows reach compactRatio of all rows (0 compacts on every removal, above 1
+// never). Returns the number of rows tombstoned, or -1 on error.
+inline long long removeFromGallery(const string& csvFilename, long long studentId, double compactRatio,
+                                   GalleryStats& stats, bool& compacted) {
+    compacted = false;
+    FileLock lock(galleryLockFilename(csvFilename), true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << galleryLockFilename(csvFilename) << endl;
+        return -1;
+    }
+
+    string header;
+    vector<string> rows;
+    if (!gallery_detail::readRows(csvFilename, header, rows)) return -1;
+    GalleryTombstones tombstones = loadTombstones(csvFilename);
+
+    string appended;
+    long long removed = 0;
+    for (size_t row = 0; row < rows.size(); ++row) {
+        if (rowStudentId(rows[row]) != studentId || isTombstoned(tombstones, row, studentId)) continue;
+        appended += to_string(row) + "," + to_string(studentId) + "\n";
+        tombstones[row] = studentId;
+        ++removed;
+    }
+    if (removed > 0) {
+        ofstream out(galleryTombstoneFilename(csvFilename), ios::app);
+        out << appended;
+        out.close();
+        if (!out) {
+            cerr << "Error appending to " << galleryTombstoneFilename(csvFilename) << endl;
+            return -1;
+        }
+    }
+
+    stats.rows = rows.size();
+    stats.tombstones = gallery_detail::countTombstoned(rows, tombstones);
+    if (stats.tombstones > 0 &&
+        static_cast<double>(stats.tombstones) >= compactRatio * static_cast<double>(stats.rows)) {
+        if (!gallery_detail::compactRows(csvFilename, header, rows, tombstones, stats)) return -1;
+        compacted = true;
+    }
+    return removed;
+}
+
+// A students.csv row for one template, or "" if the name or roll number
+// would not survive the comma-split parse of the readers
+inline string galleryRow(long long studentId, const string& name, const string& rollNumber, const double* values,
+                         size_t dimension) {
+    if (name.find_first_of(",\"\r\n") != string::npos || rollNumber.find_first_of(",\"\r\n") != string::npos) {
+        return "";
+    }
+    ostringstream row;
+    row << studentId << ',' << name << ',' << rollNumber << ",\"" << setprecision(17);
+    for (size_t i = 0; i < dimension; ++i) {
+        row << (i ? "," : "") << values[i];
+    }
+    row << '"';
+    return row.str();
+}
+
+// Append rows to students.csv under the gallery lock, so that a compaction
+// cannot replace the file between the append and the rename and drop them.
+// A missing file is started with the header.
+inline bool appendToGallery(const string& csvFilename, const vector<string>& rows) {
+    FileLock lock(galleryLockFilename(csvFilename), true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << galleryLockFilename(csvFilename) << endl;
+        return false;
+    }
+
+    // A last line without its newline (a torn append) must not absorb the first row
+    string prefix;
+    ifstream in(csvFilename, ios::binary | ios::ate);
+    if (!in || in.tellg() <= 0) {
+        prefix = "student_id,name,rn,facial_vector\n";
+    } else {
+        in.seekg(-1, ios::end);
+        if (in.get() != '\n') prefix = "\n";
+    }
+    in.close();
+
+    ofstream out(csvFilename, ios::binary | ios::app);
+    out << prefix;
+    for (const auto& row : rows) {
+        out << row << '\n';
+    }
+    out.close();
+    if (!out) {
+        cerr << "Error appending to " << csvFilename << endl;
+        return false;
+    }
+    return true;
+}
+
+// Rewrite students.csv without its tombstoned rows, whatever their share
+inline bool compactGallery(const string& csvFilename, GalleryStats& stats) {
+    FileLock lock(galleryLockFilename(csvFilename), true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << galleryLockFilename(csvFilename) << endl;
+        return false;
+    }
+    string header;
+    vector<string> rows;
+    return gallery_detail::readRows(csvFilename, header, rows) &&
+           gallery_detail::compactRows(csvFilename, header, rows, loadTombstones(csvFilename), stats);
+}
+
+class FaceGallery {
+private:
+    static constexpr char MAGIC[4] = {'F', 'G', 'A', 'L'};
+    static constexpr uint32_t VERSION = 2;  // 1: no dimension order
+
+    size_t dimension;           // Values per template, 0 while empty
+    MinDistanceKernel kernel;   // minSquaredDistance instantiated for dimension
+    BoundedMinDistanceKernel boundedKernel;
+    vector<uint32_t> dimensionOrder;  // Stored element i is descriptor element dimensionOrder[i]; empty: as given
+    vector<long long> studentIds;
+    vector<uint32_t> offsets;   // Templates of student i are offsets[i] .. offsets[i + 1] - 1
+    vector<double> templates;   // Template values, grouped by student
+
+    // The kernel is picked once per dimension, not per distance
+    void setDimension(size_t values) {
+        dimension = values;
+        kernel = minDistanceKernel(values);
+        boundedKernel = boundedMinDistanceKernel(values);
+    }
+
+    // Parse the quoted vector of a students.csv row
+    static bool parseRow(const string& line, long long& studentId, vector<double>& values) {
+        stringstream ss(line);
+        string id, name, rn, vectorStr;
+        getline(ss, id, ',');
+        getline(ss, name, ',');
+        getline(ss, rn, ',');
+        getline(ss, vectorStr);
+
+        if (!vectorStr.empty() && vectorStr.front() == '"') vectorStr.erase(0, 1);
+        if (!vectorStr.empty() && vectorStr.back() == '\r') vectorStr.pop_back();
+        if (!vectorStr.empty() && vectorStr.back() == '"') vectorStr.pop_back();
+
+        try {
+            values.clear();
+            stringstream vectorStream(vectorStr);
+            string val;
+            while (getline(vectorStream, val, ',')) {
+                values.push_back(stod(val));
+            }
+            studentId = stoll(id);
+        } catch (const exception&) {
+            return false;
+        }
+        return !values.empty();
+    }
+
+    // Lay out per-student template lists contiguously, students in order
+    void build(const vector<long long>& ids, const vector<vector<vector<double>>>& lists) {
+        studentIds = ids;
+        offsets.assign(1, 0);
+        templates.clear();
+        for (const auto& list : lists) {
+            for (const auto& values : list) {
+                templates.insert(templates.end(), values.begin(), values.end());
+            }
+            offsets.push_back(offsets.back() + static_cast<uint32_t>(list.size()));
+        }
+    }
+
+    template <typename T>
+    static bool readColumn(ifstream& inFile, vector<T>& column, size_t size) {
+        column.resize(size);
+        return size == 0 || static_cast<bool>(inFile.read(reinterpret_cast<char*>(column.data()), size * sizeof(T)));
+    }
+
+public:
+    FaceGallery()
+        : dimension(0), kernel(minDistanceKernel(0)), boundedKernel(boundedMinDistanceKernel(0)), offsets(1, 0) {}
+
+    // Read every live row of students.csv, one template per row, grouping the
+    // rows of a student in the order students first appear. Malformed rows,
+    // and rows whose dimension differs from the first row's, are skipped with
+    // a warning.
+    bool loadCSV(const string& filename) {
+        ifstream file(filename);
+        if (!file.is_open()) {
+            cerr << "Could not open " << filename << endl;
+            return false;
+        }
+
+        GalleryTombstones tombstones = loadTombstones(filename);
+        vector<long long> ids;
+        vector<vector<vector<double>>> lists;
+        unordered_map<long long, size_t> indexOf;
+        dimension = 0;
+        long long studentId;
+        vector<double> values;
+        string line;
+        getline(file, line);  // Header
+        for (size_t row = 0; getline(file, line); ++row) {
+            if (!tombstones.empty() && isTombstoned(tombstones, row, rowStudentId(line))) continue;
+            if (!parseRow(line, studentId, values) || (dimension != 0 && values.size() != dimension)) {
+                cerr << "Warning: skipping malformed student row" << endl;
+                continue;
+            }
+            dimension = values.size();
+            auto [it, added] = indexOf.emplace(studentId, ids.size());
+            if (added) {
+                ids.push_back(studentId);
+                lists.emplace_back();
+            }
+            lists[it->second].push_back(values);
+        }
+        setDimension(dimension);
+        dimensionOrder.clear();
+        build(ids, lists);
+        return true;
+    }
+
+    // Compiled gallery file (gallery compile), native endianness:
+    //   header:     char magic[4] = "FGAL", uint32 version, uint32 dimension,
+    //               uint32 numStudents, uint32 numTemplates
+    //   order:      uint32[dimension], descriptor element of each stored element
+    //               (version 2; version 1 files have none and keep the given order)
+    //   studentIds: int64[numStudents]
+    //   offsets:    uint32[numStudents + 1]
+    //   templates:  double[numTemplates * dimension], grouped by student
+    bool saveCompiled(const string& filename) const {
+        const string tmpFilename = filename + ".tmp";
+        ofstream outFile(tmpFilename, ios::binary);
+        if (!outFile) {
+            cerr << "Error opening file for writing: " << tmpFilename << endl;
+            return false;
+        }
+        uint32_t header[4] = {VERSION, static_cast<uint32_t>(dimension), static_cast<uint32_t>(studentIds.size()),
+                              offsets.back()};
+        outFile.write(MAGIC, sizeof(MAGIC));
+        outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+        vector<uint32_t> order(dimensionOrder);
+        if (order.empty()) {
+            order.resize(dimension);
+            iota(order.begin(), order.end(), 0);
+        }
+        outFile.write(reinterpret_cast<const char*>(order.data()), order.size() * sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(studentIds.data()), studentIds.size() * sizeof(long long));
+        outFile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(templates.data()), templates.size() * sizeof(double));
+        outFile.close();
+        if (!outFile || !replaceFile(tmpFilename, filename)) {
+            remove(tmpFilename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool loadCompiled(const string& filename) {
+        ifstream inFile(filename, ios::binary);
+        char magic[4];
+        uint32_t header[4];
+        if (!inFile.read(magic, sizeof(magic)) || !equal(magic, magic + 4, MAGIC) ||
+            !inFile.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] < 1 || header[0] > VERSION) {
+            cerr << "Not a compiled gallery: " << filename << endl;
+            return false;
+        }
+        setDimension(header[1]);
+        dimensionOrder.clear();
+        if (header[0] >= 2 && !readColumn(inFile, dimensionOrder, dimension)) {
+            cerr << "Truncated compiled gallery: " << filename << endl;
+            return false;
+        }
+        bool identity = true;
+        vector<bool> seen(dimension, false);
+        for (size_t i = 0; i < dimensionOrder.size(); ++i) {
+            if (dimensionOrder[i] >= dimension || seen[dimensionOrder[i]]) {
+                cerr << "Corrupt dimension order in compiled gallery: " << filename << endl;
+                return false;
+            }
+            seen[dimensionOrder[i]] = true;
+            identity = identity && dimensionOrder[i] == i;
+        }
+        if (identity) dimensionOrder.clear();
+        if (!readColumn(inFile, studentIds, header[2]) || !readColumn(inFile, offsets, header[2] + size_t(1)) ||
+            offsets.back() != header[3] || !readColumn(inFile, templates, size_t(header[3]) * dimension)) {
+            cerr << "Truncated compiled gallery: " << filename << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A compiled gallery or students.csv, told apart by the magic
+    bool load(const string& filename) {
+        ifstream inFile(filename, ios::binary);
+        char magic[4] = {};
+        inFile.read(magic, sizeof(magic));
+        inFile.close();
+        return equal(magic, magic + 4, MAGIC) ? loadCompiled(filename) : loadCSV(filename);
+    }
+
+    // Add a template to a student, who is registered first if new
+    bool add(long long studentId, const double* values, size_t count) {
+        if (count == 0 || (dimension != 0 && count != dimension)) return false;
+        if (dimension == 0) setDimension(count);
+        vector<double> ordered;
+        values = orderProbe(values, ordered);
+        size_t student = static_cast<size_t>(find(studentIds.begin(), studentIds.end(), studentId) - studentIds.begin());
+        if (student == studentIds.size()) {
+            studentIds.push_back(studentId);
+            offsets.push_back(offsets.back());
+        }
+        templates.insert(templates.begin() + static_cast<ptrdiff_t>(offsets[student + 1] * dimension),
+                         values, values + count);
+        for (size_t i = student + 1; i < offsets.size(); ++i) {
+            ++offsets[i];
+        }
+        return true;
+    }
+
+    // Drop a student and every template of it
+    bool removeStudent(long long studentId) {
+        size_t student = static_cast<size_t>(find(studentIds.begin(), studentIds.end(), studentId) - studentIds.begin());
+        if (student == studentIds.size()) return false;
+        uint32_t first = offsets[student], count = offsets[student + 1] - first;
+        templates.erase(templates.begin() + static_cast<ptrdiff_t>(first * dimension),
+                        templates.begin() + static_cast<ptrdiff_t>((first + count) * dimension));
+        studentIds.erase(studentIds.begin() + static_cast<ptrdiff_t>(student));
+        offsets.erase(offsets.begin() + static_cast<ptrdiff_t>(student + 1));
+        for (size_t i = student + 1; i < offsets.size(); ++i) {
+            offsets[i] -= count;
+        }
+        return true;
+    }
+
+    // Number of students
+    size_t size() const {
+        return studentIds.size();
+    }
+
+    size_t templateCount() const {
+        return offsets.back();
+    }
+
+    size_t getDimension() const {
+        return dimension;
+    }
+
+    const vector<long long>& getStudentIds() const {
+        return studentIds;
+    }
+
+    // Templates of student i are offsets[i] .. offsets[i + 1] - 1
+    const vector<uint32_t>& getOffsets() const {
+        return offsets;
+    }
+
+    const double* templateValues(size_t t) const {
+        return templates.data() + t * dimension;
+    }
+
+    // Store the dimensions in descending order of their variance across the
+    // templates, so that a bounded scan meets the largest differences first.
+    // Probes are reordered the same way by nearest (and orderProbe).
+    void orderDimensionsByVariance() {
+        const size_t count = templateCount();
+        if (count == 0) return;
+        vector<double> mean(dimension, 0), variance(dimension, 0);
+        for (size_t t = 0; t < count; ++t) {
+            for (size_t i = 0; i < dimension; ++i) mean[i] += templates[t * dimension + i];
+        }
+        for (double& m : mean) m /= static_cast<double>(count);
+        for (size_t t = 0; t < count; ++t) {
+            for (size_t i = 0; i < dimension; ++i) {
+                double d = templates[t * dimension + i] - mean[i];
+                variance[i] += d * d;
+            }
+        }
+        vector<uint32_t> positions(dimension);
+        iota(positions.begin(), positions.end(), 0);
+        stable_sort(positions.begin(), positions.end(),
+                    [&](uint32_t a, uint32_t b) { return variance[a] > variance[b]; });
+
+        vector<double> values(dimension);
+        for (size_t t = 0; t < count; ++t) {
+            double* row = templates.data() + t * dimension;
+            for (size_t i = 0; i < dimension; ++i) values[i] = row[positions[i]];
+            copy(values.begin(), values.end(), row);
+        }
+        vector<uint32_t> order(dimension);
+        for (size_t i = 0; i < dimension; ++i) {
+            order[i] = dimensionOrder.empty() ? positions[i] : dimensionOrder[positions[i]];
+        }
+        dimensionOrder = order;
+    }
+
+    // A descriptor in the stored dimension order: the descriptor itself, or
+    // its reordered copy in buffer
+    const double* orderProbe(const double* probe, vector<double>& buffer) const {
+        if (dimensionOrder.empty()) return probe;
+        buffer.resize(dimension);
+        for (size_t i = 0; i < dimension; ++i) buffer[i] = probe[dimensionOrder[i]];
+        return buffer.data();
+    }
+
+    // Squared distance from a (reordered) probe to template t, as a full scan computes it
+    double squaredDistanceTo(const double* probe, size_t t) const {
+        return kernel(probe, templates.data() + t * dimension, 1, dimension);
+    }
+
+    // CRC-32 of the IDs, offsets and template values, which ties an index
+    // built over the gallery to its contents
+    uint32_t checksum() const {
+        uint32_t crc = wal_detail::crc32(reinterpret_cast<const char*>(studentIds.data()),
+                                         studentIds.size() * sizeof(long long));
+        crc = wal_detail::crc32(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t), crc);
+        return wal_detail::crc32(reinterpret_cast<const char*>(templates.data()), templates.size() * sizeof(double),
+                                 crc);
+    }
+
+    // Student ID whose nearest template is the nearest to the probe and
+    // closer than maxDistance, or -1. The scan stops at the first student
+    // with a template closer than earlyExitDistance: for a probe that close,
+    // any other student's template closer still would be within twice that
+    // distance of this student's, so with earlyExitDistance at half the
+    // acceptance distance the answer only differs from a full scan for
+    // students the acceptance distance cannot tell apart anyway. 0 scans
+    // every student. Templates are abandoned once their partial distance
+    // passes maxDistance or the nearest template so far, which leaves the
+    // answer as it is. templatesScanned, if given, counts the templates
+    // scored, and dimensionsEvaluated the elements summed over them.
+    long long nearest(const double* probe, size_t count, double maxDistance, double earlyExitDistance,
+                      size_t* templatesScanned = nullptr, size_t* dimensionsEvaluated = nullptr) const {
+        if (count != dimension || studentIds.empty()) return -1;
+        vector<double> buffer;
+        probe = orderProbe(probe, buffer);
+        const double earlyExit = earlyExitDistance * earlyExitDistance;
+        const double limit = squaredLimit(maxDistance);
+        double smallest = numeric_limits<double>::max();
+        long long match = -1;
+        size_t student = 0;
+        for (; student < studentIds.size(); ++student) {
+            double d = boundedKernel(probe, templates.data() + offsets[student] * dimension,
+                                     offsets[student + 1] - offsets[student], dimension, min(smallest, limit),
+                                     dimensionsEvaluated);
+            if (d < smallest && d <= limit) {
+                smallest = d;
+                match = studentIds[student];
+                if (d < earlyExit) {
+                    ++student;
+                    break;
+                }
+            }
+        }
+        if (templatesScanned) *templatesScanned += offsets[student];
+        return sqrt(smallest) < maxDistance ? match : -1;
+    }
+
+    // Nearest match with the early exit at half the acceptance distance
+    long long nearest(const vector<double>& probe, double maxDistance = MATCH_DISTANCE,
+                      size_t* templatesScanned = nullptr, size_t* dimensionsEvaluated = nullptr) const {
+        return nearest(probe.data(), probe.size(), maxDistance, maxDistance / 2, templatesScanned,
+                       dimensionsEvaluated);
+    }
+};
+
+#endif // FACE_GALLERY_H
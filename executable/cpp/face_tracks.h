@@ -0,0 +1,124 @@
+// Track-level aggregation of face descriptors from video.
+//
+// The same face shows up in many consecutive frames. FaceTracker groups the
+// descriptors of one stream into tracks by online clustering: a descriptor
+// joins the active track whose running centroid is nearest, if that centroid
+// is closer than the track distance and the track was seen within the time
+// window; otherwise it starts a new track. A track ends when it has not been
+// seen for a window, when more than maxTracks are active (the least recently
+// seen one is ended), or when the stream is flushed. Only the centroid of an
+// ended track is matched against the gallery, which both saves a gallery scan
+// per frame and averages out per-frame noise, as the three-pose average in
+// capture_face_vector does.
+
+#ifndef FACE_TRACKS_H
+#define FACE_TRACKS_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+// Frames of one person are typically well within this of each other, and
+// different people well outside the 0.6 acceptance distance
+const double TRACK_DISTANCE = 0.4;
+const size_t MAX_ACTIVE_TRACKS = 32;
+
+// The mean descriptor of an ended track
+struct TrackCentroid {
+    vector<double> centroid;
+    size_t frames;
+    int64_t firstCaptureTime;  // Unix seconds of the track's first frame
+};
+
+class FaceTracker {
+private:
+    struct Track {
+        vector<double> sum;
+        vector<double> centroid;
+        size_t frames;
+        double lastSeen;
+        int64_t firstCaptureTime;
+    };
+
+    double window;
+    double maxDistance;
+    size_t maxTracks;
+    vector<Track> tracks;
+
+    static double distance(const vector<double>& v1, const vector<double>& v2) {
+        double sum = 0.0;
+        for (size_t i = 0; i < v1.size(); ++i) {
+            double diff = v1[i] - v2[i];
+            sum += diff * diff;
+        }
+        return sqrt(sum);
+    }
+
+    void end(size_t index, vector<TrackCentroid>& ended) {
+        ended.push_back({move(tracks[index].centroid), tracks[index].frames, tracks[index].firstCaptureTime});
+        tracks[index] = move(tracks.back());
+        tracks.pop_back();
+    }
+
+public:
+    FaceTracker(double windowSeconds, double trackDistance = TRACK_DISTANCE, size_t activeTracks = MAX_ACTIVE_TRACKS)
+        : window(windowSeconds), maxDistance(trackDistance), maxTracks(max<size_t>(1, activeTracks)) {}
+
+    size_t activeTracks() const {
+        return tracks.size();
+    }
+
+    // Add one descriptor seen at frameTime (seconds, non-decreasing within a
+    // stream); the tracks it ends are appended to ended
+    void add(const vector<double>& descriptor, double frameTime, int64_t captureTime, vector<TrackCentroid>& ended) {
+        // End tracks that have not been seen within the window
+        for (size_t i = tracks.size(); i-- > 0;) {
+            if (frameTime - tracks[i].lastSeen > window) end(i, ended);
+        }
+
+        size_t nearest = tracks.size();
+        double nearestDistance = numeric_limits<double>::max();
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            if (tracks[i].centroid.size() != descriptor.size()) continue;
+            double d = distance(descriptor, tracks[i].centroid);
+            if (d < nearestDistance) {
+                nearestDistance = d;
+                nearest = i;
+            }
+        }
+
+        if (nearest < tracks.size() && nearestDistance < maxDistance) {
+            Track& track = tracks[nearest];
+            ++track.frames;
+            for (size_t i = 0; i < descriptor.size(); ++i) {
+                track.sum[i] += descriptor[i];
+                track.centroid[i] = track.sum[i] / static_cast<double>(track.frames);
+            }
+            track.lastSeen = max(track.lastSeen, frameTime);
+            return;
+        }
+
+        if (tracks.size() >= maxTracks) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < tracks.size(); ++i) {
+                if (tracks[i].lastSeen < tracks[oldest].lastSeen) oldest = i;
+            }
+            end(oldest, ended);
+        }
+        tracks.push_back({descriptor, descriptor, 1, frameTime, captureTime});
+    }
+
+    // End every active track
+    void flush(vector<TrackCentroid>& ended) {
+        while (!tracks.empty()) {
+            end(tracks.size() - 1, ended);
+        }
+    }
+};
+
+#endif // FACE_TRACKS_H
@@ -0,0 +1,173 @@
+#include <iostream>
+#include <string>
+
+#include "face_gallery.h"
+#include "gallery_index.h"
+#include "metrics.h"
+
+using namespace std;
+
+metrics::Phase computePhase("compute");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");
+metrics::Counter distancesEvaluated("distances_evaluated");
+metrics::Counter distancesAvoided("distances_avoided");
+
+// Tombstones and compaction of the face gallery (students.csv, see
+// face_gallery.h), the compiled gallery file the matchers can load instead
+// of the CSV, and the exact search index over it (gallery_index.h)
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " remove <students_csv> <student_id> [--compact-ratio <ratio>]" << endl;
+    cerr << "       " << program << " compact <students_csv>" << endl;
+    cerr << "       " << program << " compile <students_csv> <gallery_file>" << endl;
+    cerr << "       " << program << " index <gallery_file> <index_file>" << endl;
+    cerr << "       " << program << " search <gallery_file> <index_file> [--stats] <v1> ... <vN>" << endl;
+    cerr << "       " << program << " stats <students_csv>" << endl;
+    cerr << "  --compact-ratio: share of tombstoned rows at which students.csv is rewritten (default "
+         << GALLERY_COMPACT_RATIO << ")" << endl;
+    cerr << "  compile stores the dimensions in descending order of variance, for the bounded scan" << endl;
+    cerr << "  gallery_file: students.csv or a compiled gallery; index_file: e.g. executable/serialized/gallery.vpt" << endl;
+    cerr << "  search prints the matching student ID, or -1, exactly as a full scan would;" << endl;
+    cerr << "  --stats also prints how many distance evaluations the index avoided" << endl;
+}
+
+void printStats(const GalleryStats& stats) {
+    cout << "rows " << stats.rows << " tombstones " << stats.tombstones
+         << " live " << stats.rows - stats.tombstones << endl;
+}
+
+int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const string command = argv[1];
+    const string csvFilename = argv[2];
+    GalleryStats stats;
+
+    try {
+        if (command == "remove" && (argc == 4 || (argc == 6 && string(argv[4]) == "--compact-ratio"))) {
+            long long studentId = stoll(argv[3]);
+            double compactRatio = argc == 6 ? stod(argv[5]) : GALLERY_COMPACT_RATIO;
+            bool compacted;
+            bytesRead.addFileSize(csvFilename);
+            metrics::ScopedTimer computeTimer(computePhase);
+            long long removed = removeFromGallery(csvFilename, studentId, compactRatio, stats, compacted);
+            computeTimer.stop();
+            if (removed < 0) {
+                cerr << "Failed to remove student ID " << studentId << " from " << csvFilename << endl;
+                return 1;
+            }
+            if (removed == 0) {
+                cout << "Student ID " << studentId << " not found" << endl;
+                return 1;
+            }
+            cout << "Removed student ID " << studentId << " (" << removed << " rows)" << endl;
+            if (compacted) {
+                bytesWritten.addFileSize(csvFilename);
+                cout << "Compacted " << csvFilename << endl;
+            }
+            printStats(stats);
+            return 0;
+        }
+
+        if (command == "compact" && argc == 3) {
+            bytesRead.addFileSize(csvFilename);
+            metrics::ScopedTimer computeTimer(computePhase);
+            if (!compactGallery(csvFilename, stats)) {
+                cerr << "Failed to compact " << csvFilename << endl;
+                return 1;
+            }
+            computeTimer.stop();
+            bytesWritten.addFileSize(csvFilename);
+            printStats(stats);
+            return 0;
+        }
+
+        if (command == "compile" && argc == 4) {
+            FaceGallery gallery;
+            metrics::ScopedTimer computeTimer(computePhase);
+            if (!gallery.loadCSV(csvFilename)) return 1;
+            bytesRead.addFileSize(csvFilename);
+            gallery.orderDimensionsByVariance();
+            if (!gallery.saveCompiled(argv[3])) {
+                cerr << "Failed to write " << argv[3] << endl;
+                return 1;
+            }
+            computeTimer.stop();
+            bytesWritten.addFileSize(argv[3]);
+            cout << "Compiled " << gallery.size() << " students (" << gallery.templateCount() << " templates, "
+                 << gallery.getDimension() << "-d) to " << argv[3] << endl;
+            return 0;
+        }
+
+        if (command == "index" && argc == 4) {
+            FaceGallery gallery;
+            GalleryIndex index;
+            metrics::ScopedTimer computeTimer(computePhase);
+            if (!gallery.load(csvFilename)) return 1;
+            bytesRead.addFileSize(csvFilename);
+            index.build(gallery);
+            if (!index.save(argv[3])) {
+                cerr << "Failed to write " << argv[3] << endl;
+                return 1;
+            }
+            computeTimer.stop();
+            bytesWritten.addFileSize(argv[3]);
+            cout << "Indexed " << gallery.templateCount() << " templates (" << index.nodeCount() << " nodes) to "
+                 << argv[3] << endl;
+            return 0;
+        }
+
+        if (command == "search" && argc >= 5) {
+            int first = 4;
+            bool printDistanceStats = string(argv[first]) == "--stats";
+            if (printDistanceStats) ++first;
+            if (first >= argc) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            vector<double> probe;
+            for (int i = first; i < argc; ++i) probe.push_back(stod(argv[i]));
+
+            FaceGallery gallery;
+            GalleryIndex index;
+            if (!gallery.load(csvFilename) || !index.load(argv[3], gallery)) return 1;
+            bytesRead.addFileSize(csvFilename);
+            bytesRead.addFileSize(argv[3]);
+            if (probe.size() != gallery.getDimension()) {
+                cerr << "Expected " << gallery.getDimension() << " values, got " << probe.size() << endl;
+                return 1;
+            }
+
+            size_t evaluated = 0;
+            metrics::ScopedTimer computeTimer(computePhase);
+            long long studentId = index.nearest(probe, MATCH_DISTANCE, &evaluated);
+            computeTimer.stop();
+            distancesEvaluated.add(evaluated);
+            distancesAvoided.add(gallery.templateCount() - evaluated);
+            cout << studentId << endl;
+            if (printDistanceStats) {
+                cout << "distances evaluated " << evaluated << " avoided " << gallery.templateCount() - evaluated
+                     << " of " << gallery.templateCount() << endl;
+            }
+            return 0;
+        }
+
+        if (command == "stats" && argc == 3) {
+            bytesRead.addFileSize(csvFilename);
+            if (!galleryStats(csvFilename, stats)) return 1;
+            printStats(stats);
+            return 0;
+        }
+    } catch (const exception& e) {
+        cerr << "Error parsing arguments: " << e.what() << endl;
+        return 1;
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
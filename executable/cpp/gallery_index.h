@@ -0,0 +1,295 @@
+// Exact nearest-template search over a face gallery with a vantage-point tree.
+//
+// Each node picks a vantage template and splits the templates below it at the
+// median distance from it: the inner child holds the nearer half, the outer
+// child the farther half, and the node records how far the inner half reaches
+// (innerRadius) and where the outer half starts (outerRadius). For a probe q
+// at distance d from the vantage template, every template p of the inner
+// child satisfies  |q - p| >= d - innerRadius  and every template of the
+// outer child  |q - p| >= outerRadius - d  (triangle inequality). A search
+// skips a child when that bound exceeds the smaller of the acceptance
+// distance and the best distance found so far, and scans the few templates
+// of a leaf directly.
+//
+// The index only skips templates that cannot be at or below the current
+// bound, so its answer is the full scan's: the student with the nearest
+// template (the earlier student on a tie) if closer than the acceptance
+// distance, else -1. Distances come from the gallery's own kernel, and a
+// skip needs the bound to be exceeded by more than PRUNE_SLACK, which
+// absorbs the rounding of the square roots and subtractions.
+//
+// File (gallery index, executable/serialized/gallery.vpt), native endianness:
+//   header: char magic[4] = "FVPT", uint32 version, uint32 dimension,
+//           uint32 numTemplates, uint32 numNodes, uint32 galleryChecksum
+//   items:  uint32[numTemplates], template numbers in tree order
+//   nodes:  Node[numNodes], the root first
+// The checksum is FaceGallery::checksum() of the gallery the tree was built
+// over; an index whose checksum differs from the gallery's is stale and
+// refused, since it would silently miss templates.
+
+#ifndef GALLERY_INDEX_H
+#define GALLERY_INDEX_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+#include "face_gallery.h"
+
+using namespace std;
+
+class GalleryIndex {
+private:
+    static constexpr char MAGIC[4] = {'F', 'V', 'P', 'T'};
+    static constexpr uint32_t VERSION = 1;
+
+    // Templates per leaf; below this, skipping costs more than scanning
+    static constexpr uint32_t LEAF_SIZE = 8;
+    static constexpr double PRUNE_SLACK = 1e-9;
+
+    // Leaves have no children and scan items[begin, end). Inner nodes have
+    // their vantage template at items[begin], the inner child over
+    // items[begin + 1, split) and the outer child over items[split, end).
+    struct Node {
+        uint32_t begin, end;
+        int32_t inner, outer;  // Child nodes, -1 for a leaf
+        double innerRadius;    // Largest distance from the vantage to the inner half
+        double outerRadius;    // Smallest distance from the vantage to the outer half
+    };
+
+    const FaceGallery* gallery;
+    vector<uint32_t> items;
+    vector<Node> nodes;
+
+    // Not saved: the templates copied in tree order, so that a search reads
+    // each leaf sequentially, the student index of each, and the gallery's kernel
+    vector<double> ordered;
+    vector<uint32_t> owners;
+    MinDistanceKernel kernel;
+
+    int32_t build(uint32_t begin, uint32_t end, mt19937& rng, vector<pair<double, uint32_t>>& scratch) {
+        int32_t index = static_cast<int32_t>(nodes.size());
+        nodes.push_back({begin, end, -1, -1, 0, 0});
+        if (end - begin <= LEAF_SIZE) return index;
+
+        swap(items[begin], items[uniform_int_distribution<uint32_t>(begin, end - 1)(rng)]);
+        const double* vantage = gallery->templateValues(items[begin]);
+        scratch.clear();
+        for (uint32_t i = begin + 1; i < end; ++i) {
+            scratch.emplace_back(sqrt(gallery->squaredDistanceTo(vantage, items[i])), items[i]);
+        }
+        auto median = scratch.begin() + static_cast<ptrdiff_t>(scratch.size() / 2);
+        nth_element(scratch.begin(), median, scratch.end());
+        double innerRadius = 0;
+        for (auto it = scratch.begin(); it != median; ++it) innerRadius = max(innerRadius, it->first);
+        double outerRadius = median->first;
+        uint32_t split = begin + 1 + static_cast<uint32_t>(scratch.size() / 2);
+        for (size_t i = 0; i < scratch.size(); ++i) items[begin + 1 + i] = scratch[i].second;
+
+        int32_t inner = build(begin + 1, split, rng, scratch);
+        int32_t outer = build(split, end, rng, scratch);
+        nodes[index].inner = inner;
+        nodes[index].outer = outer;
+        nodes[index].innerRadius = innerRadius;
+        nodes[index].outerRadius = outerRadius;
+        return index;
+    }
+
+    // Whether a loaded tree only refers to templates, items and nodes that
+    // exist. The gallery checksum does not cover the index file's own bytes,
+    // so a corrupt file would otherwise send the search out of bounds. Children
+    // come after their parent, as build() numbers them, so a search ends.
+    bool isWellFormed(size_t templateCount) const {
+        for (uint32_t item : items) {
+            if (item >= templateCount) return false;
+        }
+        if (nodes.empty() != items.empty()) return false;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const Node& node = nodes[i];
+            if (node.begin > node.end || node.end > items.size()) return false;
+            if (node.inner < 0 && node.outer < 0) continue;
+            if (node.begin == node.end || node.inner < 0 || node.outer < 0 ||
+                static_cast<size_t>(node.inner) <= i || static_cast<size_t>(node.inner) >= nodes.size() ||
+                static_cast<size_t>(node.outer) <= i || static_cast<size_t>(node.outer) >= nodes.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void layOut() {
+        const vector<uint32_t>& offsets = gallery->getOffsets();
+        vector<uint32_t> studentOf(gallery->templateCount());
+        for (uint32_t student = 0; student + 1 < offsets.size(); ++student) {
+            fill(studentOf.begin() + offsets[student], studentOf.begin() + offsets[student + 1], student);
+        }
+        const size_t dimension = gallery->getDimension();
+        ordered.resize(items.size() * dimension);
+        owners.resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            copy(gallery->templateValues(items[i]), gallery->templateValues(items[i]) + dimension,
+                 ordered.begin() + static_cast<ptrdiff_t>(i * dimension));
+            owners[i] = studentOf[items[i]];
+        }
+        kernel = minDistanceKernel(dimension);
+    }
+
+    struct Search {
+        const double* probe;
+        double maxDistance;
+        double best = numeric_limits<double>::max();  // Squared
+        uint32_t student = numeric_limits<uint32_t>::max();
+        size_t evaluated = 0;
+
+        double bound() const {
+            return min(maxDistance, sqrt(best));
+        }
+    };
+
+    // Score the template at items[i]; the same sum as the gallery's scan
+    double evaluate(Search& state, uint32_t i) const {
+        const size_t dimension = gallery->getDimension();
+        double d = kernel(state.probe, ordered.data() + size_t(i) * dimension, 1, dimension);
+        ++state.evaluated;
+        if (d < state.best || (d == state.best && owners[i] < state.student)) {
+            state.best = d;
+            state.student = owners[i];
+        }
+        return d;
+    }
+
+    void search(Search& state, int32_t index) const {
+        const Node& node = nodes[static_cast<size_t>(index)];
+        if (node.inner < 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) evaluate(state, i);
+            return;
+        }
+        double d = sqrt(evaluate(state, node.begin));
+        // Visit the side the probe falls on first, where closer templates are likelier
+        bool innerFirst = d <= (node.innerRadius + node.outerRadius) / 2;
+        for (int pass = 0; pass < 2; ++pass) {
+            bool inner = innerFirst == (pass == 0);
+            double lowerBound = inner ? d - node.innerRadius : node.outerRadius - d;
+            if (lowerBound <= state.bound() + PRUNE_SLACK) {
+                search(state, inner ? node.inner : node.outer);
+            }
+        }
+    }
+
+public:
+    GalleryIndex() : gallery(nullptr), kernel(minDistanceKernel(0)) {}
+
+    // Build over a loaded gallery, which must outlive the index
+    void build(const FaceGallery& faces, uint32_t seed = 1) {
+        gallery = &faces;
+        const size_t count = faces.templateCount();
+        items.resize(count);
+        for (uint32_t t = 0; t < count; ++t) items[t] = t;
+        nodes.clear();
+        if (count > 0) {
+            mt19937 rng(seed);
+            vector<pair<double, uint32_t>> scratch;
+            build(0, static_cast<uint32_t>(count), rng, scratch);
+        }
+        layOut();
+    }
+
+    bool save(const string& filename) const {
+        const string tmpFilename = filename + ".tmp";
+        ofstream outFile(tmpFilename, ios::binary);
+        if (!outFile) {
+            cerr << "Error opening file for writing: " << tmpFilename << endl;
+            return false;
+        }
+        uint32_t header[5] = {VERSION, static_cast<uint32_t>(gallery->getDimension()),
+                              static_cast<uint32_t>(items.size()), static_cast<uint32_t>(nodes.size()),
+                              gallery->checksum()};
+        outFile.write(MAGIC, sizeof(MAGIC));
+        outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+        outFile.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(uint32_t));
+        outFile.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(Node));
+        outFile.close();
+        if (!outFile || !replaceFile(tmpFilename, filename)) {
+            remove(tmpFilename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Load an index built over this gallery; false if it was built over
+    // another one (rebuild it with gallery index)
+    bool load(const string& filename, const FaceGallery& faces) {
+        ifstream inFile(filename, ios::binary);
+        char magic[4];
+        uint32_t header[5];
+        if (!inFile.read(magic, sizeof(magic)) || !equal(magic, magic + 4, MAGIC) ||
+            !inFile.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != VERSION) {
+            cerr << "Not a gallery index: " << filename << endl;
+            return false;
+        }
+        if (header[1] != faces.getDimension() || header[2] != faces.templateCount() ||
+            header[4] != faces.checksum()) {
+            cerr << "Gallery index " << filename << " is stale: it was built over another gallery" << endl;
+            return false;
+        }
+        // The node count is not covered by the checksum: check it against the
+        // file size before allocating for it
+        streampos here = inFile.tellg();
+        inFile.seekg(0, ios::end);
+        size_t available = static_cast<size_t>(inFile.tellg() - here);
+        inFile.seekg(here);
+        if (static_cast<size_t>(header[2]) * sizeof(uint32_t) + static_cast<size_t>(header[3]) * sizeof(Node) > available) {
+            cerr << "Truncated gallery index: " << filename << endl;
+            return false;
+        }
+        items.resize(header[2]);
+        nodes.resize(header[3]);
+        if (!inFile.read(reinterpret_cast<char*>(items.data()), items.size() * sizeof(uint32_t)) ||
+            !inFile.read(reinterpret_cast<char*>(nodes.data()), nodes.size() * sizeof(Node))) {
+            cerr << "Truncated gallery index: " << filename << endl;
+            return false;
+        }
+        if (!isWellFormed(faces.templateCount())) {
+            items.clear();
+            nodes.clear();
+            cerr << "Corrupt gallery index: " << filename << endl;
+            return false;
+        }
+        gallery = &faces;
+        layOut();
+        return true;
+    }
+
+    size_t nodeCount() const {
+        return nodes.size();
+    }
+
+    // Same answer as FaceGallery::nearest with no early exit: the student ID
+    // of the nearest template if closer than maxDistance, or -1.
+    // distancesEvaluated, if given, counts the templates scored; the rest of
+    // the gallery's templates were skipped.
+    long long nearest(const double* probe, size_t count, double maxDistance,
+                      size_t* distancesEvaluated = nullptr) const {
+        if (count != gallery->getDimension() || nodes.empty()) return -1;
+        vector<double> buffer;
+        Search state{gallery->orderProbe(probe, buffer), maxDistance};
+        search(state, 0);
+        if (distancesEvaluated) *distancesEvaluated += state.evaluated;
+        if (state.student == numeric_limits<uint32_t>::max() || !(sqrt(state.best) < maxDistance)) return -1;
+        return gallery->getStudentIds()[state.student];
+    }
+
+    long long nearest(const vector<double>& probe, double maxDistance = MATCH_DISTANCE,
+                      size_t* distancesEvaluated = nullptr) const {
+        return nearest(probe.data(), probe.size(), maxDistance, distancesEvaluated);
+    }
+};
+
+#endif // GALLERY_INDEX_H
@@ -2,15 +2,26 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <memory>
+#include <cstdio>
 
-using namespace std;  
+#include "write_ahead_log.h"
+#include "art_children.h"
+#include "metrics.h"
+
+using namespace std;
+
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Counter nodesVisited("nodes_visited");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");  
 
 // Trie node structure (consistent with the other programs)
 struct TrieNode {
     bool isEndOfName;
-    unordered_map<char, shared_ptr<TrieNode>> children;
+    ArtChildren<shared_ptr<TrieNode>> children;  // Node4/16/48/256, see art_children.h
     vector<string> studentIds;
 
     TrieNode() : isEndOfName(false) {}
@@ -21,7 +32,7 @@ private:
     shared_ptr<TrieNode> root;
 
     // Helper function to deserialize the trie
-    shared_ptr<TrieNode> deserializeHelper(ifstream& inFile) {
+    shared_ptr<TrieNode> deserializeHelper(ifstream& inFile, bool withKinds) {
         auto node = make_shared<TrieNode>();
         
         // Read if this node marks the end of a name
@@ -41,17 +52,23 @@ private:
             node->studentIds.push_back(id);
         }
         
-        // Read number of children
+        // Read the node kind (absent from files older than node kinds) and
+        // number of children
+        uint8_t kind = 0;
+        if (withKinds) inFile.read(reinterpret_cast<char*>(&kind), sizeof(uint8_t));
         size_t numChildren;
         inFile.read(reinterpret_cast<char*>(&numChildren), sizeof(size_t));
+        if (withKinds && numChildren > 0 && kind <= static_cast<uint8_t>(ArtKind::Node256)) {
+            node->children.reserve(static_cast<ArtKind>(kind));
+        }
         
         // Read each child
-        for (size_t i = 0; i < numChildren; ++i) {
+        for (size_t i = 0; i < numChildren && inFile; ++i) {
             char ch;
             inFile.read(&ch, sizeof(char));
             
             // Recursively deserialize the child node
-            node->children[ch] = deserializeHelper(inFile);
+            node->children.set(ch, deserializeHelper(inFile, withKinds));
         }
         
         return node;
@@ -73,18 +90,20 @@ private:
             outFile.write(id.c_str(), idLength);
         }
         
-        // Write number of children
+        // Write the node kind and number of children
+        uint8_t kind = static_cast<uint8_t>(node->children.kind());
+        outFile.write(reinterpret_cast<const char*>(&kind), sizeof(uint8_t));
         size_t numChildren = node->children.size();
         outFile.write(reinterpret_cast<const char*>(&numChildren), sizeof(size_t));
         
-        // Write each child
-        for (const auto& [ch, childNode] : node->children) {
+        // Write each child, in key order
+        node->children.forEach([&](char ch, const shared_ptr<TrieNode>& childNode) {
             // Write the character
             outFile.write(&ch, sizeof(char));
             
             // Recursively serialize the child node
             serializeHelper(outFile, childNode);
-        }
+        });
     }
 
 public:
@@ -100,21 +119,36 @@ public:
             return false;
         }
 
-        root = deserializeHelper(inFile);
+        // Files written since node kinds were recorded start with a magic
+        char magic[sizeof(ART_TRIE_MAGIC)] = {};
+        inFile.read(magic, sizeof(magic));
+        bool withKinds = inFile && equal(magic, magic + sizeof(magic), ART_TRIE_MAGIC);
+        if (!withKinds) {
+            inFile.clear();
+            inFile.seekg(0);
+        }
+        root = deserializeHelper(inFile, withKinds);
         inFile.close();
         return true;
     }
 
-    // Serialize the trie to a binary file
+    // Serialize the trie to a temporary file and rename it over the binary file,
+    // so search_trie (which takes no lock) never reads a half-written trie
     bool serialize(const string& filename) {
-        ofstream outFile(filename, ios::binary);
+        const string tmpFilename = filename + ".tmp";
+        ofstream outFile(tmpFilename, ios::binary);
         if (!outFile) {
-            cerr << "Error opening file for writing: " << filename << endl;
+            cerr << "Error opening file for writing: " << tmpFilename << endl;
             return false;
         }
 
+        outFile.write(ART_TRIE_MAGIC, sizeof(ART_TRIE_MAGIC));
         serializeHelper(outFile, root);
         outFile.close();
+        if (!outFile || !replaceFile(tmpFilename, filename)) {
+            remove(tmpFilename.c_str());
+            return false;
+        }
         return true;
     }
 
@@ -123,10 +157,15 @@ public:
         shared_ptr<TrieNode> current = root;
         
         for (char c : name) {
-            if (current->children.find(c) == current->children.end()) {
-                current->children[c] = make_shared<TrieNode>();
+            nodesVisited.add();
+            const shared_ptr<TrieNode>* child = current->children.find(c);
+            if (!child) {
+                auto node = make_shared<TrieNode>();
+                current->children.set(c, node);
+                current = node;
+            } else {
+                current = *child;
             }
-            current = current->children[c];
         }
         
         current->isEndOfName = true;
@@ -147,6 +186,7 @@ public:
 };
 
 int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
     if (argc != 3) {
         cerr << "Usage: " << argv[0] << " <student_name> <student_id>" << endl;
         return 1;
@@ -158,6 +198,14 @@ int main(int argc, char* argv[]) {
     
     Trie trie;
     
+    // Single writer: hold name.dat's lock from load to rename, so concurrent
+    // inserts (and the server's trie flushes) never drop each other's names
+    FileLock lock(trieFilename + ".lock", true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << trieFilename << ".lock" << endl;
+        return 1;
+    }
+    
     // Check if the file exists and is not empty
     ifstream fileCheck(trieFilename, ios::binary | ios::ate);
     if (!fileCheck || fileCheck.tellg() == 0) {
@@ -177,19 +225,27 @@ int main(int argc, char* argv[]) {
         fileCheck.close();
         
         // Load the existing trie
+        metrics::ScopedTimer loadTimer(loadPhase);
         if (!trie.deserialize(trieFilename)) {
             cerr << "Failed to deserialize the trie from " << trieFilename << endl;
             return 1;
         }
+        bytesRead.addFileSize(trieFilename);
+        loadTimer.stop();
         cout << "Existing trie loaded successfully." << endl;
     }
     
     // Insert the new name and student ID
+    metrics::ScopedTimer computeTimer(computePhase);
     trie.insert(name, studentId);
+    computeTimer.stop();
     cout << "Inserted name: " << name << " with student ID: " << studentId << endl;
     
     // Serialize the updated trie
+    metrics::ScopedTimer serializeTimer(serializePhase);
     if (trie.serialize(trieFilename)) {
+        serializeTimer.stop();
+        bytesWritten.addFileSize(trieFilename);
         cout << "Trie has been successfully updated and serialized." << endl;
         return 0;
     } else {
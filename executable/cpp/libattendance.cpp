@@ -0,0 +1,731 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <cctype>
+#include <ctime>
+#include <limits>
+
+#include "attendance_api.h"
+#include "attendance_store.h"
+#include "attendance_events.h"
+#include "face_gallery.h"
+#include "art_children.h"
+#include "metrics.h"
+
+using namespace std;
+
+// One phase per entry point, so a server can see where its request time goes
+metrics::Phase matchPhase("match");
+metrics::Phase trieSearchPhase("trie_search");
+metrics::Phase trieFlushPhase("trie_flush");
+metrics::Phase storeReloadPhase("store_reload");
+metrics::Phase storeUpdatePhase("store_update");
+metrics::Phase storeSyncPhase("store_sync");
+metrics::Phase storeThresholdPhase("store_threshold");
+metrics::Phase eventsRecordPhase("events_record");
+metrics::Counter rowsScanned("rows_scanned");
+metrics::Counter dimensionsEvaluated("dimensions_evaluated");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");
+
+// Concurrency: every handle publishes immutable versions of its data. Readers
+// pin the current version with an atomic shared_ptr load and never take a
+// lock, so they neither wait for nor block a writer. Writers are serialized
+// by the handle's writer mutex, build the next version next to the current
+// one and publish it with an atomic store; a version stays alive for as long
+// as some reader still holds it. On disk, writers replace files by rename,
+// which gives processes the same guarantee.
+
+// Trie node structure (same as in create_trie.cpp)
+struct TrieNode {
+    bool isEndOfName;
+    ArtChildren<shared_ptr<TrieNode>> children;  // Node4/16/48/256, see art_children.h
+    vector<string> studentIds;
+
+    TrieNode() : isEndOfName(false) {}
+};
+
+class Trie {
+private:
+    shared_ptr<TrieNode> root;
+
+    // Helper function to deserialize the trie
+    shared_ptr<TrieNode> deserializeHelper(ifstream& inFile, bool withKinds) {
+        auto node = make_shared<TrieNode>();
+
+        inFile.read(reinterpret_cast<char*>(&node->isEndOfName), sizeof(bool));
+
+        size_t numIds;
+        inFile.read(reinterpret_cast<char*>(&numIds), sizeof(size_t));
+        for (size_t i = 0; i < numIds && inFile; ++i) {
+            size_t idLength;
+            inFile.read(reinterpret_cast<char*>(&idLength), sizeof(size_t));
+            string id(idLength, '\0');
+            inFile.read(&id[0], idLength);
+            node->studentIds.push_back(id);
+        }
+
+        uint8_t kind = 0;
+        if (withKinds) inFile.read(reinterpret_cast<char*>(&kind), sizeof(uint8_t));
+        size_t numChildren;
+        inFile.read(reinterpret_cast<char*>(&numChildren), sizeof(size_t));
+        if (withKinds && numChildren > 0 && kind <= static_cast<uint8_t>(ArtKind::Node256)) {
+            node->children.reserve(static_cast<ArtKind>(kind));
+        }
+        for (size_t i = 0; i < numChildren && inFile; ++i) {
+            char ch;
+            inFile.read(&ch, sizeof(char));
+            node->children.set(ch, deserializeHelper(inFile, withKinds));
+        }
+
+        return node;
+    }
+
+    // Helper function to serialize the trie
+    void serializeHelper(ofstream& outFile, const shared_ptr<TrieNode>& node) const {
+        outFile.write(reinterpret_cast<const char*>(&node->isEndOfName), sizeof(bool));
+
+        size_t numIds = node->studentIds.size();
+        outFile.write(reinterpret_cast<const char*>(&numIds), sizeof(size_t));
+        for (const auto& id : node->studentIds) {
+            size_t idLength = id.length();
+            outFile.write(reinterpret_cast<const char*>(&idLength), sizeof(size_t));
+            outFile.write(id.c_str(), idLength);
+        }
+
+        uint8_t kind = static_cast<uint8_t>(node->children.kind());
+        outFile.write(reinterpret_cast<const char*>(&kind), sizeof(uint8_t));
+        size_t numChildren = node->children.size();
+        outFile.write(reinterpret_cast<const char*>(&numChildren), sizeof(size_t));
+        node->children.forEach([&](char ch, const shared_ptr<TrieNode>& childNode) {
+            outFile.write(&ch, sizeof(char));
+            serializeHelper(outFile, childNode);
+        });
+    }
+
+    // Copy the nodes on the path to a name and return the copy of node; every
+    // other node is shared with the version the copy was made from
+    static shared_ptr<TrieNode> insertPath(const shared_ptr<TrieNode>& node, const string& name, size_t depth,
+                                           const string& studentId) {
+        auto copy = node ? make_shared<TrieNode>(*node) : make_shared<TrieNode>();
+        if (depth == name.size()) {
+            copy->isEndOfName = true;
+            if (find(copy->studentIds.begin(), copy->studentIds.end(), studentId) == copy->studentIds.end()) {
+                copy->studentIds.push_back(studentId);
+            }
+            return copy;
+        }
+        const shared_ptr<TrieNode>* child = copy->children.find(name[depth]);
+        copy->children.set(name[depth], insertPath(child ? *child : nullptr, name, depth + 1, studentId));
+        return copy;
+    }
+
+    // Copy the nodes on the path to a name with a student ID removed, or
+    // return node itself if the ID is not there. Returns nullptr for a node
+    // left with neither IDs nor children, so empty branches are pruned.
+    static shared_ptr<TrieNode> removePath(const shared_ptr<TrieNode>& node, const string& name, size_t depth,
+                                           const string& studentId) {
+        shared_ptr<TrieNode> copy;
+        if (depth == name.size()) {
+            if (find(node->studentIds.begin(), node->studentIds.end(), studentId) == node->studentIds.end()) {
+                return node;
+            }
+            copy = make_shared<TrieNode>(*node);
+            auto& ids = copy->studentIds;
+            ids.erase(remove(ids.begin(), ids.end(), studentId), ids.end());
+            copy->isEndOfName = !ids.empty();
+        } else {
+            const shared_ptr<TrieNode>* existing = node->children.find(name[depth]);
+            if (!existing) return node;
+            auto child = removePath(*existing, name, depth + 1, studentId);
+            if (child == *existing) return node;
+            copy = make_shared<TrieNode>(*node);
+            copy->children.set(name[depth], child);  // A null child erases the branch
+        }
+        return copy->isEndOfName || !copy->children.empty() ? copy : nullptr;
+    }
+
+    // Helper function to collect the student IDs of every name below a node
+    void collectStudentIds(const shared_ptr<TrieNode>& node, vector<string>& results) const {
+        if (node->isEndOfName) {
+            results.insert(results.end(), node->studentIds.begin(), node->studentIds.end());
+        }
+        node->children.forEach([&](char, const shared_ptr<TrieNode>& childNode) {
+            collectStudentIds(childNode, results);
+        });
+    }
+
+public:
+    Trie() {
+        root = make_shared<TrieNode>();
+    }
+
+    // Deserialize the trie from a binary file
+    bool deserialize(const string& filename) {
+        ifstream inFile(filename, ios::binary);
+        if (!inFile) {
+            cerr << "Error opening file for reading: " << filename << endl;
+            return false;
+        }
+        // Files written since node kinds were recorded start with a magic
+        char magic[sizeof(ART_TRIE_MAGIC)] = {};
+        inFile.read(magic, sizeof(magic));
+        bool withKinds = inFile && equal(magic, magic + sizeof(magic), ART_TRIE_MAGIC);
+        if (!withKinds) {
+            inFile.clear();
+            inFile.seekg(0);
+        }
+        root = deserializeHelper(inFile, withKinds);
+        return true;
+    }
+
+    // Serialize the trie to a binary file
+    bool serialize(const string& filename) const {
+        ofstream outFile(filename, ios::binary);
+        if (!outFile) {
+            cerr << "Error opening file for writing: " << filename << endl;
+            return false;
+        }
+        outFile.write(ART_TRIE_MAGIC, sizeof(ART_TRIE_MAGIC));
+        serializeHelper(outFile, root);
+        outFile.close();
+        return static_cast<bool>(outFile);
+    }
+
+    // The trie with a name and its student ID added. This trie is left
+    // untouched, so readers holding it keep a consistent view.
+    Trie inserted(const string& name, const string& studentId) const {
+        Trie next;
+        next.root = insertPath(root, name, 0, studentId);
+        return next;
+    }
+
+    // The trie with a student ID removed from a name, or an equal trie if the
+    // name does not hold it. This trie is left untouched.
+    Trie removed(const string& name, const string& studentId) const {
+        Trie next;
+        next.root = removePath(root, name, 0, studentId);
+        if (!next.root) next.root = make_shared<TrieNode>();
+        return next;
+    }
+
+    bool sameRoot(const Trie& other) const {
+        return root == other.root;
+    }
+
+    // Student IDs of every name with a given prefix
+    vector<string> searchByPrefix(const string& prefix) const {
+        vector<string> results;
+        shared_ptr<TrieNode> current = root;
+        for (char c : prefix) {
+            // A Node256 is indexed directly by the character
+            const shared_ptr<TrieNode>* dense = current->children.dense();
+            const shared_ptr<TrieNode>* child = dense ? &dense[static_cast<unsigned char>(c)]
+                                                      : current->children.find(c);
+            if (!child || !*child) return results;
+            current = *child;
+        }
+        collectStudentIds(current, results);
+        return results;
+    }
+};
+
+// Immutable matcher data: the templates of every student, laid out for one
+// kernel pass per student (face_gallery.h)
+struct MatcherVersion {
+    FaceGallery gallery;
+};
+
+struct att_matcher {
+    mutex writer;
+    string filename;                           // students.csv, for tombstones
+    shared_ptr<const MatcherVersion> current;  // Accessed with atomic_load/atomic_store only
+};
+
+// A trie version remembers the trie file it was loaded from or written to
+struct TrieVersion {
+    Trie trie;
+    FileStamp fileStamp;
+};
+
+// An insert or removal of a (name, student ID) pair
+struct TrieEdit {
+    bool remove;
+    string name;
+    string studentId;
+};
+
+struct att_trie {
+    mutex writer;
+    string filename;
+    shared_ptr<const TrieVersion> current;     // Accessed with atomic_load/atomic_store only
+    vector<TrieEdit> pending;                  // Writer only: edits not flushed yet
+};
+
+// A store version remembers the log as it saw it. Another process writing to
+// the store changes the log's stamp, and the next call reloads from disk.
+struct StoreVersion {
+    AttendanceStore store;
+    FileStamp logStamp;
+};
+
+struct att_store {
+    mutex writer;
+    string filename;
+    shared_ptr<const StoreVersion> current;    // Accessed with atomic_load/atomic_store only
+    unique_ptr<WriteAheadLog> wal;             // Writer only
+
+    string logFilename() const { return filename + ".wal"; }
+};
+
+struct att_events {
+    mutex lock;
+    EventLog log;
+
+    explicit att_events(const string& dir) : log(dir) {}
+};
+
+namespace {
+
+// Current store version, reloaded first if another process changed the store
+// on disk. Call with the writer mutex and the exclusive file lock held.
+shared_ptr<const StoreVersion> refreshStore(att_store* handle) {
+    auto version = atomic_load(&handle->current);
+    if (version && handle->wal && fileStamp(handle->logFilename()) == version->logStamp) {
+        return version;
+    }
+
+    metrics::ScopedTimer reloadTimer(storeReloadPhase);
+    auto next = make_shared<StoreVersion>();
+    handle->wal.reset(new WriteAheadLog(handle->logFilename()));
+    if (!loadStore(next->store, *handle->wal, handle->filename, true)) {
+        handle->wal.reset();
+        return nullptr;
+    }
+    bytesRead.addFileSize(handle->filename);
+    bytesRead.addFileSize(handle->logFilename());
+    // Taken after the load, which may have repaired or restarted the log
+    next->logStamp = fileStamp(handle->logFilename());
+    atomic_store(&handle->current, shared_ptr<const StoreVersion>(next));
+    return next;
+}
+
+// Store version for a reader. A reader that finds the store changed on disk
+// reloads it only if no writer is busy, neither this handle's nor another
+// process's; otherwise that writer is about to publish and the pinned version
+// is used as is. Both locks are only tried, so a reader never waits.
+shared_ptr<const StoreVersion> readStore(att_store* handle) {
+    auto version = atomic_load(&handle->current);
+    if (fileStamp(handle->logFilename()) == version->logStamp) return version;
+
+    unique_lock<mutex> writer(handle->writer, try_to_lock);
+    if (!writer.owns_lock()) return version;
+    FileLock lock(handle->filename + ".lock", true, false);
+    if (!lock.isLocked()) return version;
+    auto fresh = refreshStore(handle);
+    return fresh ? fresh : version;
+}
+
+// Rebuild the trie from its file plus the edits not flushed yet, if another
+// process replaced the file. Call with the writer mutex held.
+bool refreshTrie(att_trie* handle) {
+    auto version = atomic_load(&handle->current);
+    FileStamp stamp = fileStamp(handle->filename);
+    if (version && stamp == version->fileStamp) return true;
+
+    // A missing or empty file starts an empty trie, as insert_trie does
+    auto next = make_shared<TrieVersion>();
+    if (stamp.size > 0 && !next->trie.deserialize(handle->filename)) return false;
+    for (const auto& edit : handle->pending) {
+        next->trie = edit.remove ? next->trie.removed(edit.name, edit.studentId)
+                                 : next->trie.inserted(edit.name, edit.studentId);
+    }
+    next->fileStamp = stamp;
+    atomic_store(&handle->current, shared_ptr<const TrieVersion>(move(next)));
+    return true;
+}
+
+// Subject names become file names and dictionary lines, so only accept plain identifiers
+bool isValidSubject(const string& subject) {
+    if (subject.empty() || subject == TOTAL_SUBJECT) return false;
+    for (char c : subject) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+    }
+    return true;
+}
+
+} // namespace
+
+extern "C" {
+
+int att_api_version(void) {
+    return ATT_API_VERSION;
+}
+
+// ---- Face matcher ----
+
+att_matcher* att_matcher_open(const char* students_csv) {
+    if (!students_csv) return nullptr;
+    auto version = make_shared<MatcherVersion>();
+    if (!version->gallery.loadCSV(students_csv)) return nullptr;
+    // Compiled in memory: the bounded scan meets the high-variance dimensions first
+    version->gallery.orderDimensionsByVariance();
+
+    att_matcher* matcher = new att_matcher();
+    matcher->filename = students_csv;
+    matcher->current = move(version);
+    return matcher;
+}
+
+void att_matcher_close(att_matcher* matcher) {
+    delete matcher;
+}
+
+long long att_matcher_match(att_matcher* matcher, const double* vector, size_t dimension, double max_distance) {
+    if (!matcher || !vector) return -1;
+    metrics::ScopedTimer matchTimer(matchPhase);
+    auto version = atomic_load(&matcher->current);
+    size_t scanned = 0, dimensions = 0;
+    long long match =
+        version->gallery.nearest(vector, dimension, max_distance, max_distance / 2, &scanned, &dimensions);
+    rowsScanned.add(scanned);
+    dimensionsEvaluated.add(dimensions);
+    return match;
+}
+
+int att_matcher_add(att_matcher* matcher, long long student_id, const double* vector, size_t dimension) {
+    if (!matcher || !vector) return ATT_ERROR;
+    lock_guard<mutex> guard(matcher->writer);
+    // Registrations are rare next to matches, so the next version is a plain copy
+    auto next = make_shared<MatcherVersion>(*atomic_load(&matcher->current));
+    if (!next->gallery.add(student_id, vector, dimension)) return ATT_ERROR;
+    atomic_store(&matcher->current, shared_ptr<const MatcherVersion>(move(next)));
+    return ATT_OK;
+}
+
+int att_matcher_register(att_matcher* matcher, long long student_id, const char* name,
+                         const char* roll_number, const double* vectors, size_t count, size_t dimension) {
+    if (!matcher || !name || !roll_number || !vectors || count == 0) return ATT_ERROR;
+    lock_guard<mutex> guard(matcher->writer);
+    auto next = make_shared<MatcherVersion>(*atomic_load(&matcher->current));
+    vector<string> rows;
+    for (size_t t = 0; t < count; ++t) {
+        rows.push_back(galleryRow(student_id, name, roll_number, vectors + t * dimension, dimension));
+        if (rows.back().empty() || !next->gallery.add(student_id, vectors + t * dimension, dimension)) {
+            return ATT_ERROR;
+        }
+    }
+    // On disk first: a version matching faces that students.csv lacks would
+    // lose them on the next restart
+    if (!appendToGallery(matcher->filename, rows)) return ATT_ERROR;
+    atomic_store(&matcher->current, shared_ptr<const MatcherVersion>(move(next)));
+    return ATT_OK;
+}
+
+int att_matcher_remove(att_matcher* matcher, long long student_id, double compact_ratio) {
+    if (!matcher) return ATT_ERROR;
+    lock_guard<mutex> guard(matcher->writer);
+    GalleryStats stats;
+    bool compacted;
+    long long tombstoned = removeFromGallery(matcher->filename, student_id, compact_ratio, stats, compacted);
+    if (tombstoned < 0) return ATT_ERROR;
+
+    // The next version is a copy anyway, so in memory the templates go at once
+    auto next = make_shared<MatcherVersion>(*atomic_load(&matcher->current));
+    bool found = next->gallery.removeStudent(student_id) || tombstoned > 0;
+    atomic_store(&matcher->current, shared_ptr<const MatcherVersion>(move(next)));
+    return found ? ATT_OK : ATT_NOT_FOUND;
+}
+
+// ---- Name trie ----
+
+att_trie* att_trie_open(const char* trie_file) {
+    if (!trie_file) return nullptr;
+    unique_ptr<att_trie> trie(new att_trie());
+    trie->filename = trie_file;
+
+    if (!refreshTrie(trie.get())) {
+        return nullptr;
+    }
+    return trie.release();
+}
+
+void att_trie_close(att_trie* trie) {
+    if (trie && !trie->pending.empty()) {
+        att_trie_flush(trie);
+    }
+    delete trie;
+}
+
+int att_trie_insert(att_trie* trie, const char* name, const char* student_id) {
+    if (!trie || !name || !student_id) return ATT_ERROR;
+    lock_guard<mutex> guard(trie->writer);
+    auto next = make_shared<TrieVersion>(*atomic_load(&trie->current));
+    next->trie = next->trie.inserted(name, student_id);
+    trie->pending.push_back({false, name, student_id});
+    atomic_store(&trie->current, shared_ptr<const TrieVersion>(move(next)));
+    return ATT_OK;
+}
+
+int att_trie_remove(att_trie* trie, const char* name, const char* student_id) {
+    if (!trie || !name || !student_id) return ATT_ERROR;
+    lock_guard<mutex> guard(trie->writer);
+    auto current = atomic_load(&trie->current);
+    auto next = make_shared<TrieVersion>(*current);
+    next->trie = next->trie.removed(name, student_id);
+    // An unchanged trie shares its root with the current one
+    if (next->trie.sameRoot(current->trie)) return ATT_NOT_FOUND;
+    trie->pending.push_back({true, name, student_id});
+    atomic_store(&trie->current, shared_ptr<const TrieVersion>(move(next)));
+    return ATT_OK;
+}
+
+long long att_trie_search(att_trie* trie, const char* prefix, char* buffer, size_t capacity) {
+    if (!trie || !prefix) return ATT_ERROR;
+    metrics::ScopedTimer searchTimer(trieSearchPhase);
+    // Pick up a trie another process wrote, unless this handle's writer is busy
+    auto version = atomic_load(&trie->current);
+    if (fileStamp(trie->filename) != version->fileStamp) {
+        unique_lock<mutex> writer(trie->writer, try_to_lock);
+        if (writer.owns_lock() && refreshTrie(trie)) version = atomic_load(&trie->current);
+    }
+    vector<string> ids = version->trie.searchByPrefix(prefix);
+
+    string joined;
+    for (const auto& id : ids) {
+        if (!joined.empty()) joined += '\n';
+        joined += id;
+    }
+    if (buffer && capacity > 0) {
+        size_t copied = min(joined.size(), capacity - 1);
+        memcpy(buffer, joined.data(), copied);
+        buffer[copied] = '\0';
+    }
+    return static_cast<long long>(joined.size());
+}
+
+int att_trie_flush(att_trie* trie) {
+    if (!trie) return ATT_ERROR;
+    lock_guard<mutex> guard(trie->writer);
+    if (trie->pending.empty()) return ATT_OK;
+    metrics::ScopedTimer flushTimer(trieFlushPhase);
+
+    // Single writer across processes (insert_trie takes the same lock); merge
+    // anything another writer published before replacing the file
+    FileLock lock(trie->filename + ".lock", true);
+    if (!lock.isLocked() || !refreshTrie(trie)) return ATT_ERROR;
+
+    // Replace the file by rename so a concurrent search_trie never reads a partial trie
+    auto next = make_shared<TrieVersion>(*atomic_load(&trie->current));
+    const string tmpFilename = trie->filename + ".tmp";
+    if (!next->trie.serialize(tmpFilename) || !replaceFile(tmpFilename, trie->filename)) {
+        remove(tmpFilename.c_str());
+        return ATT_ERROR;
+    }
+    next->fileStamp = fileStamp(trie->filename);
+    bytesWritten.add(static_cast<uint64_t>(max(next->fileStamp.size, 0LL)));
+    atomic_store(&trie->current, shared_ptr<const TrieVersion>(move(next)));
+    trie->pending.clear();
+    return ATT_OK;
+}
+
+// ---- Attendance store ----
+
+att_store* att_store_open(const char* store_file) {
+    if (!store_file) return nullptr;
+    unique_ptr<att_store> store(new att_store());
+    store->filename = store_file;
+
+    FileLock lock(store->filename + ".lock", true);
+    if (!lock.isLocked() || !refreshStore(store.get())) {
+        cerr << "Failed to load the attendance store from " << store_file << endl;
+        return nullptr;
+    }
+    return store.release();
+}
+
+void att_store_close(att_store* store) {
+    delete store;
+}
+
+int att_store_add_student(att_store* store, int student_id) {
+    if (!store) return ATT_ERROR;
+    lock_guard<mutex> guard(store->writer);
+    FileLock lock(store->filename + ".lock", true);
+    auto version = lock.isLocked() ? refreshStore(store) : nullptr;
+    if (!version) return ATT_ERROR;
+
+    auto next = make_shared<StoreVersion>(*version);
+    if (!next->store.addStudent(student_id)) return ATT_NOT_FOUND;  // Already present
+    // Adding a row changes the snapshot layout, so fold everything in
+    if (!checkpoint(next->store, *store->wal, store->filename)) {
+        store->wal.reset();  // Force a reload; the log may have moved on
+        return ATT_ERROR;
+    }
+    next->logStamp = fileStamp(store->logFilename());
+    atomic_store(&store->current, shared_ptr<const StoreVersion>(move(next)));
+    return ATT_OK;
+}
+
+int att_store_remove_student(att_store* store, int student_id) {
+    if (!store) return ATT_ERROR;
+    lock_guard<mutex> guard(store->writer);
+    FileLock lock(store->filename + ".lock", true);
+    auto version = lock.isLocked() ? refreshStore(store) : nullptr;
+    if (!version) return ATT_ERROR;
+
+    auto next = make_shared<StoreVersion>(*version);
+    if (!next->store.removeStudent(student_id)) return ATT_NOT_FOUND;
+    // Removing a row changes the snapshot layout, so fold everything in
+    if (!checkpoint(next->store, *store->wal, store->filename)) {
+        store->wal.reset();  // Force a reload; the log may have moved on
+        return ATT_ERROR;
+    }
+    next->logStamp = fileStamp(store->logFilename());
+    atomic_store(&store->current, shared_ptr<const StoreVersion>(move(next)));
+    return ATT_OK;
+}
+
+int att_store_update(att_store* store, const char* subject, int student_id, int delta,
+                     int* subject_value, int* total_value) {
+    if (!store || !subject) return ATT_ERROR;
+    metrics::ScopedTimer updateTimer(storeUpdatePhase);
+    int subjectValue, totalValue;
+    uint64_t logGeneration;
+    long long logEnd;
+    {
+        lock_guard<mutex> guard(store->writer);
+        FileLock lock(store->filename + ".lock", true);
+        auto version = lock.isLocked() ? refreshStore(store) : nullptr;
+        if (!version) return ATT_ERROR;
+
+        // The next version shares the current one's columns and copies only the
+        // subject's and total_attendance's as it changes them; readers keep using
+        // the current one until it is published below
+        auto next = make_shared<StoreVersion>(*version);
+        if (!next->store.increment(subject, student_id, delta, subjectValue, totalValue)) {
+            return ATT_NOT_FOUND;  // Unknown student or subject, or count would go negative
+        }
+        long long logStart = store->wal->size();
+        store->wal->append(next->store.encodeIncrement(subject, student_id, delta));
+        if (!store->wal->flush()) {
+            store->wal.reset();  // Force a reload; the log may hold part of the record
+            return ATT_ERROR;
+        }
+        bytesWritten.add(static_cast<uint64_t>(store->wal->size() - logStart));
+        if (store->wal->size() >= CHECKPOINT_BYTES && !checkpoint(next->store, *store->wal, store->filename)) {
+            cerr << "Warning: checkpoint of " << store->filename << " failed" << endl;
+        }
+        next->logStamp = fileStamp(store->logFilename());
+        atomic_store(&store->current, shared_ptr<const StoreVersion>(move(next)));
+        // Where this record ends; a checkpoint above already made it durable
+        logGeneration = store->wal->getGeneration();
+        logEnd = store->wal->size();
+    }
+
+    // Group commit outside both the file lock and the writer mutex: the next
+    // writer, in this process or another, appends while this one waits, and
+    // whoever takes the sync lock first covers both with one fsync
+    updateTimer.stop();
+    metrics::ScopedTimer syncTimer(storeSyncPhase);
+    if (!WriteAheadLog::syncThrough(store->logFilename(), logGeneration, logEnd)) return ATT_ERROR;
+    if (subject_value) *subject_value = subjectValue;
+    if (total_value) *total_value = totalValue;
+    return ATT_OK;
+}
+
+long long att_store_threshold(att_store* store, const char* subject, int threshold, int direction,
+                              size_t limit, int* student_ids, size_t capacity) {
+    if (!store || !subject || (direction != 1 && direction != -1)) return ATT_ERROR;
+    metrics::ScopedTimer thresholdTimer(storeThresholdPhase);
+    auto version = readStore(store);
+    if (!version->store.hasSubject(subject)) return ATT_ERROR;
+
+    // A limited query walks only its first limit entries of the ordered index
+    vector<int> ids = direction > 0
+        ? version->store.getStudentIdsInRange(subject, threshold, INT_MAX, limit)
+        : version->store.getStudentIdsInRange(subject, INT_MIN, threshold, limit);
+    if (student_ids) {
+        copy_n(ids.begin(), min(ids.size(), capacity), student_ids);
+    }
+    return static_cast<long long>(ids.size());
+}
+
+int att_store_flush(att_store* store) {
+    if (!store) return ATT_ERROR;
+    lock_guard<mutex> guard(store->writer);
+    FileLock lock(store->filename + ".lock", true);
+    auto version = lock.isLocked() ? refreshStore(store) : nullptr;
+    if (!version) return ATT_ERROR;
+
+    // Only the log generation changes, but the published version must not be written to
+    auto next = make_shared<StoreVersion>(*version);
+    if (!checkpoint(next->store, *store->wal, store->filename)) {
+        store->wal.reset();
+        return ATT_ERROR;
+    }
+    next->logStamp = fileStamp(store->logFilename());
+    atomic_store(&store->current, shared_ptr<const StoreVersion>(move(next)));
+    return ATT_OK;
+}
+
+// ---- Attendance event log ----
+
+att_events* att_events_open(const char* event_dir) {
+    if (!event_dir) return nullptr;
+    error_code ec;
+    filesystem::create_directories(event_dir, ec);
+    if (!filesystem::is_directory(event_dir)) {
+        cerr << "Cannot create event log directory " << event_dir << endl;
+        return nullptr;
+    }
+    return new att_events(event_dir);
+}
+
+void att_events_close(att_events* events) {
+    delete events;
+}
+
+int att_events_record(att_events* events, const char* subject, int student_id, long long time) {
+    if (!events || !subject || !isValidSubject(subject)) return ATT_ERROR;
+    lock_guard<mutex> guard(events->lock);
+    metrics::ScopedTimer recordTimer(eventsRecordPhase);
+    FileLock lock(events->log.lockFilename(), true);
+    if (!lock.isLocked()) return ATT_ERROR;
+
+    // Another process may have added subjects since the last call
+    events->log.load();
+    int subjectIdx = events->log.subjectIndex(subject, true);
+    if (subjectIdx < 0) return ATT_ERROR;
+
+    vector<Event> batch(1);
+    batch[0].studentId = student_id;
+    batch[0].subject = static_cast<uint8_t>(subjectIdx);
+    batch[0].time = time != 0 ? time : static_cast<int64_t>(std::time(nullptr));
+    return events->log.append(batch) ? ATT_OK : ATT_ERROR;
+}
+
+// ---- Metrics ----
+
+long long att_metrics(int format, char* buffer, size_t capacity) {
+    metrics::Format fmt = format == ATT_METRICS_JSON ? metrics::Format::Json
+                        : format == ATT_METRICS_PROMETHEUS ? metrics::Format::Prometheus
+                        : metrics::Format::None;
+    if (fmt == metrics::Format::None) return ATT_ERROR;
+
+    string text = metrics::format(fmt, "libattendance");
+    if (buffer && capacity > 0) {
+        size_t copied = min(text.size(), capacity - 1);
+        memcpy(buffer, text.data(), copied);
+        buffer[copied] = '\0';
+    }
+    return static_cast<long long>(text.size());
+}
+
+} // extern "C"
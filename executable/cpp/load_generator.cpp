@@ -0,0 +1,469 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#include <dlfcn.h>
+
+#include "attendance_api.h"
+#include "bounded_queue.h"
+#include "child_process.h"
+#include "synthetic_roster.h"
+
+using namespace std;
+
+// Open-loop load generator for the attendance backends.
+//
+// Generates a synthetic roster in a work directory laid out like the server's
+// (executable/data, executable/serialized), builds its indexes with the
+// compiled tools, then replays a mix of server operations against a backend:
+//
+//   verify     match a face and mark one subject
+//   search     name prefix search
+//   threshold  students above or below an attendance threshold
+//   enroll     add a new student's name (and, in-process, face and counters)
+//
+// Backends:
+//   process  one tool process per request, like server.py before the
+//            library: distance + update_avl --batch, search_trie, threshold,
+//            insert_trie, run with the work directory as cwd
+//   library  libattendance.so loaded in this process, like server.py now
+//
+// Requests arrive on a Poisson schedule at the target rate regardless of how
+// fast earlier ones finish (open loop), so a slow backend builds a queue
+// instead of slowing the arrivals down. Latency is measured from a request's
+// scheduled arrival to its completion and so includes that queueing. The
+// report is one JSON object on stdout. POSIX only (fork/exec and dlopen).
+
+enum Operation { VERIFY, SEARCH, THRESHOLD, ENROLL, OPERATION_COUNT };
+const char* const OPERATION_NAMES[OPERATION_COUNT] = {"verify", "search", "threshold", "enroll"};
+
+struct Request {
+    Operation operation = VERIFY;
+    chrono::steady_clock::time_point scheduled;
+    uint64_t seed = 0;
+};
+
+struct Options {
+    string backend = "process";
+    string binDir = "./executable";
+    string libraryPath;
+    string workDir = "loadgen_work";
+    size_t roster = 1000;
+    double rate = 20;
+    double duration = 10;
+    unsigned concurrency = 8;
+    double mix[OPERATION_COUNT] = {60, 20, 15, 5};
+    uint64_t seed = 1;
+};
+
+// Everything the workers share: the roster they draw requests from and the
+// attendance counts the process backend turns into update_avl records
+struct Workload {
+    vector<SyntheticStudent> roster;
+    unique_ptr<atomic<int>[]> subjectCounts;  // roster.size() x subjects
+    unique_ptr<atomic<int>[]> totalCounts;
+    atomic<int> nextStudentId;
+
+    explicit Workload(vector<SyntheticStudent> students)
+        : roster(move(students)),
+          subjectCounts(new atomic<int>[roster.size() * SYNTHETIC_SUBJECTS.size()]),
+          totalCounts(new atomic<int>[roster.size()]),
+          nextStudentId(SYNTHETIC_FIRST_ID + static_cast<int>(roster.size())) {
+        for (size_t i = 0; i < roster.size(); ++i) {
+            int total = 0;
+            for (size_t s = 0; s < SYNTHETIC_SUBJECTS.size(); ++s) {
+                subjectCounts[i * SYNTHETIC_SUBJECTS.size() + s].store(roster[i].attendance[s]);
+                total += roster[i].attendance[s];
+            }
+            totalCounts[i].store(total);
+        }
+    }
+};
+
+class Backend {
+public:
+    virtual ~Backend() {}
+    // Each returns false on an error; a face that matches nobody is not one
+    virtual bool verify(const vector<double>& probe, size_t subject) = 0;
+    virtual bool search(const string& prefix) = 0;
+    virtual bool threshold(size_t subject, int threshold, int direction) = 0;
+    virtual bool enroll(int studentId, const string& name, const vector<double>& face) = 0;
+};
+
+class ProcessBackend : public Backend {
+private:
+    Workload& workload;
+    string workDir;
+    string distance, updateAvl, searchTrie, thresholdTool, insertTrie;
+
+public:
+    ProcessBackend(Workload& load, const string& binDir, const string& dir)
+        : workload(load), workDir(dir), distance(toolPath(binDir, "distance")),
+          updateAvl(toolPath(binDir, "update_avl")), searchTrie(toolPath(binDir, "search_trie")),
+          thresholdTool(toolPath(binDir, "threshold")), insertTrie(toolPath(binDir, "insert_trie")) {}
+
+    bool verify(const vector<double>& probe, size_t subject) override {
+        vector<string> args;
+        ostringstream value;
+        value.precision(17);
+        for (double v : probe) {
+            value.str("");
+            value << v;
+            args.push_back(value.str());
+        }
+        ProcessResult match = runProcess(distance, args, workDir);
+        if (match.status != 0) return false;
+        int studentId;
+        try {
+            studentId = stoi(match.output);
+        } catch (const exception&) {
+            return false;
+        }
+        size_t row = static_cast<size_t>(studentId - SYNTHETIC_FIRST_ID);
+        if (studentId < 0 || row >= workload.roster.size()) return true;  // Unmatched or newly enrolled
+
+        int subjectValue = workload.subjectCounts[row * SYNTHETIC_SUBJECTS.size() + subject].fetch_add(1) + 1;
+        int totalValue = workload.totalCounts[row].fetch_add(1) + 1;
+        string records = SYNTHETIC_SUBJECTS[subject] + " " + to_string(studentId) + " " + to_string(subjectValue) +
+                         "\ntotal_attendance " + to_string(studentId) + " " + to_string(totalValue) + "\n";
+        return runProcess(updateAvl, {"--batch", "executable/serialized"}, workDir, records).status == 0;
+    }
+
+    bool search(const string& prefix) override {
+        return runProcess(searchTrie, {prefix}, workDir).status == 0;
+    }
+
+    bool threshold(size_t subject, int threshold, int direction) override {
+        return runProcess(thresholdTool, {"executable/serialized/" + SYNTHETIC_SUBJECTS[subject] + ".dat",
+                                          to_string(threshold), to_string(direction)},
+                          workDir).status == 0;
+    }
+
+    bool enroll(int studentId, const string& name, const vector<double>&) override {
+        return runProcess(insertTrie, {name, to_string(studentId)}, workDir).status == 0;
+    }
+};
+
+class LibraryBackend : public Backend {
+private:
+    void* library = nullptr;
+    att_matcher* matcher = nullptr;
+    att_trie* trie = nullptr;
+    att_store* store = nullptr;
+
+    decltype(&att_api_version) apiVersion = nullptr;
+    decltype(&att_matcher_open) matcherOpen = nullptr;
+    decltype(&att_matcher_close) matcherClose = nullptr;
+    decltype(&att_matcher_match) matcherMatch = nullptr;
+    decltype(&att_matcher_register) matcherRegister = nullptr;
+    decltype(&att_trie_open) trieOpen = nullptr;
+    decltype(&att_trie_close) trieClose = nullptr;
+    decltype(&att_trie_insert) trieInsert = nullptr;
+    decltype(&att_trie_search) trieSearch = nullptr;
+    decltype(&att_store_open) storeOpen = nullptr;
+    decltype(&att_store_close) storeClose = nullptr;
+    decltype(&att_store_add_student) storeAddStudent = nullptr;
+    decltype(&att_store_update) storeUpdate = nullptr;
+    decltype(&att_store_threshold) storeThreshold = nullptr;
+
+    template <typename F>
+    bool bind(F& function, const char* name) {
+        function = reinterpret_cast<F>(dlsym(library, name));
+        if (!function) cerr << "Missing symbol " << name << " in libattendance" << endl;
+        return function != nullptr;
+    }
+
+public:
+    bool open(const string& libraryPath, const string& workDir) {
+        library = dlopen(filesystem::absolute(libraryPath).c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            cerr << "Failed to load " << libraryPath << ": " << dlerror() << endl;
+            return false;
+        }
+        if (!bind(apiVersion, "att_api_version") || !bind(matcherOpen, "att_matcher_open") ||
+            !bind(matcherClose, "att_matcher_close") || !bind(matcherMatch, "att_matcher_match") ||
+            !bind(matcherRegister, "att_matcher_register") || !bind(trieOpen, "att_trie_open") ||
+            !bind(trieClose, "att_trie_close") || !bind(trieInsert, "att_trie_insert") ||
+            !bind(trieSearch, "att_trie_search") || !bind(storeOpen, "att_store_open") ||
+            !bind(storeClose, "att_store_close") || !bind(storeAddStudent, "att_store_add_student") ||
+            !bind(storeUpdate, "att_store_update") || !bind(storeThreshold, "att_store_threshold")) {
+            return false;
+        }
+        if (apiVersion() != ATT_API_VERSION) {
+            cerr << "libattendance ABI version mismatch" << endl;
+            return false;
+        }
+        matcher = matcherOpen((workDir + "/executable/data/students.csv").c_str());
+        trie = trieOpen((workDir + "/executable/serialized/name.dat").c_str());
+        store = storeOpen((workDir + "/executable/serialized/attendance.store").c_str());
+        return matcher && trie && store;
+    }
+
+    ~LibraryBackend() override {
+        if (store) storeClose(store);
+        if (trie) trieClose(trie);
+        if (matcher) matcherClose(matcher);
+        if (library) dlclose(library);
+    }
+
+    bool verify(const vector<double>& probe, size_t subject) override {
+        long long studentId = matcherMatch(matcher, probe.data(), probe.size(), 0.6);
+        if (studentId < 0) return true;
+        int subjectValue, totalValue;
+        return storeUpdate(store, SYNTHETIC_SUBJECTS[subject].c_str(), static_cast<int>(studentId), 1,
+                           &subjectValue, &totalValue) >= 0;
+    }
+
+    bool search(const string& prefix) override {
+        char buffer[4096];
+        return trieSearch(trie, prefix.c_str(), buffer, sizeof(buffer)) >= 0;
+    }
+
+    bool threshold(size_t subject, int threshold, int direction) override {
+        vector<int> ids(1024);
+        return storeThreshold(store, SYNTHETIC_SUBJECTS[subject].c_str(), threshold, direction, 0,
+                              ids.data(), ids.size()) >= 0;
+    }
+
+    bool enroll(int studentId, const string& name, const vector<double>& face) override {
+        return trieInsert(trie, name.c_str(), to_string(studentId).c_str()) == ATT_OK &&
+               matcherRegister(matcher, studentId, name.c_str(), to_string(studentId).c_str(), face.data(), 1,
+                               face.size()) == ATT_OK &&
+               storeAddStudent(store, studentId) >= 0;
+    }
+};
+
+// Write the roster into the work directory and build its indexes with the tools
+bool setUp(const Options& options, const vector<SyntheticStudent>& roster) {
+    const string data = options.workDir + "/executable/data";
+    const string serialized = options.workDir + "/executable/serialized";
+    error_code ec;
+    filesystem::remove_all(serialized, ec);
+    filesystem::create_directories(data);
+    filesystem::create_directories(serialized);
+    if (!writeStudentsCSV(data + "/students.csv", roster) || !writeAttendanceCSV(data + "/attendance.csv", roster)) {
+        cerr << "Failed to write the synthetic roster to " << data << endl;
+        return false;
+    }
+
+    const vector<pair<string, vector<string>>> steps = {
+        {"create_avl", {"--csv", "executable/data/attendance.csv", "executable/serialized"}},
+        {"create_trie", {}},
+        {"attendance_store", {"build", "executable/data/attendance.csv", "executable/serialized/attendance.store"}},
+    };
+    for (const auto& [tool, args] : steps) {
+        ProcessResult build = runProcess(toolPath(options.binDir, tool), args, options.workDir);
+        if (build.status != 0) {
+            cerr << tool << " failed while building the synthetic indexes:\n" << build.errors << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run one request's operation with parameters drawn from its seed
+bool execute(Backend& backend, Workload& workload, const Request& request) {
+    mt19937_64 rng(request.seed);
+    const auto& roster = workload.roster;
+    size_t subject = uniform_int_distribution<size_t>(0, SYNTHETIC_SUBJECTS.size() - 1)(rng);
+    const SyntheticStudent& student = roster[uniform_int_distribution<size_t>(0, roster.size() - 1)(rng)];
+
+    switch (request.operation) {
+        case VERIFY: {
+            // Nine in ten faces belong to an enrolled student
+            bool known = uniform_int_distribution<int>(0, 9)(rng) != 0;
+            return backend.verify(known ? noisyCapture(student.face, rng) : syntheticFace(rng), subject);
+        }
+        case SEARCH: {
+            size_t length = uniform_int_distribution<size_t>(1, min<size_t>(4, student.name.size()))(rng);
+            return backend.search(student.name.substr(0, length));
+        }
+        case THRESHOLD: {
+            int threshold = uniform_int_distribution<int>(0, SYNTHETIC_LECTURES)(rng);
+            return backend.threshold(subject, threshold, uniform_int_distribution<int>(0, 1)(rng) ? 1 : -1);
+        }
+        default: {
+            int studentId = workload.nextStudentId.fetch_add(1);
+            return backend.enroll(studentId, student.name, syntheticFace(rng));
+        }
+    }
+}
+
+// Latency percentile by nearest rank, in milliseconds
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(ceil(p * static_cast<double>(sorted.size())));
+    return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [--backend process|library] [--bin <dir>] [--library <path>]" << endl;
+    cerr << "       [--work <dir>] [--roster <students>] [--rate <requests/s>] [--duration <seconds>]" << endl;
+    cerr << "       [--concurrency <in flight>] [--mix verify=60,search=20,threshold=15,enroll=5] [--seed <n>]" << endl;
+    cerr << "  --bin: directory of the compiled tools (default ./executable)" << endl;
+    cerr << "  --work: scratch directory for the synthetic roster (default loadgen_work)" << endl;
+}
+
+bool parseMix(const string& text, double mix[OPERATION_COUNT]) {
+    fill(mix, mix + OPERATION_COUNT, 0.0);
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == string::npos) return false;
+        const char* const* name = find(OPERATION_NAMES, OPERATION_NAMES + OPERATION_COUNT, item.substr(0, equals));
+        if (name == OPERATION_NAMES + OPERATION_COUNT) return false;
+        mix[name - OPERATION_NAMES] = stod(item.substr(equals + 1));
+        if (mix[name - OPERATION_NAMES] < 0) return false;
+    }
+    return any_of(mix, mix + OPERATION_COUNT, [](double weight) { return weight > 0; });
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string option = argv[i];
+            if (i + 1 >= argc) return false;
+            string value = argv[++i];
+            if (option == "--backend") options.backend = value;
+            else if (option == "--bin") options.binDir = value;
+            else if (option == "--library") options.libraryPath = value;
+            else if (option == "--work") options.workDir = value;
+            else if (option == "--roster") options.roster = stoul(value);
+            else if (option == "--rate") options.rate = stod(value);
+            else if (option == "--duration") options.duration = stod(value);
+            else if (option == "--concurrency") options.concurrency = static_cast<unsigned>(stoul(value));
+            else if (option == "--seed") options.seed = stoull(value);
+            else if (option == "--mix") {
+                if (!parseMix(value, options.mix)) return false;
+            } else return false;
+        }
+    } catch (const exception& e) {
+        cerr << "Error parsing arguments: " << e.what() << endl;
+        return false;
+    }
+    if (options.libraryPath.empty()) options.libraryPath = options.binDir + "/libattendance.so";
+    return (options.backend == "process" || options.backend == "library") && options.roster > 0 &&
+           options.rate > 0 && options.duration > 0 && options.concurrency > 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Workload workload(generateRoster(options.roster, options.seed));
+    if (!setUp(options, workload.roster)) {
+        return 1;
+    }
+
+    unique_ptr<Backend> backend;
+    if (options.backend == "library") {
+        auto library = make_unique<LibraryBackend>();
+        if (!library->open(options.libraryPath, options.workDir)) return 1;
+        backend = move(library);
+    } else {
+        backend = make_unique<ProcessBackend>(workload, options.binDir, options.workDir);
+    }
+
+    // Workers keep per-operation latencies of their own and merge them at the end
+    struct WorkerResults {
+        vector<double> latencies[OPERATION_COUNT];
+        size_t errors[OPERATION_COUNT] = {};
+        chrono::steady_clock::time_point lastCompletion;
+    };
+    BoundedQueue<Request> requests(1 << 16);
+    atomic<bool> scheduleDone(false);
+    vector<WorkerResults> results(options.concurrency);
+    vector<thread> workers;
+    for (unsigned w = 0; w < options.concurrency; ++w) {
+        workers.emplace_back([&, w] {
+            WorkerResults& mine = results[w];
+            Request request;
+            Backoff backoff;
+            for (;;) {
+                if (!requests.tryPop(request)) {
+                    if (!scheduleDone.load(memory_order_acquire)) {
+                        backoff.pause();
+                        continue;
+                    }
+                    if (!requests.tryPop(request)) break;
+                }
+                backoff.reset();
+                bool ok = execute(*backend, workload, request);
+                auto completed = chrono::steady_clock::now();
+                mine.latencies[request.operation].push_back(
+                    chrono::duration<double, milli>(completed - request.scheduled).count());
+                if (!ok) ++mine.errors[request.operation];
+                mine.lastCompletion = max(mine.lastCompletion, completed);
+            }
+        });
+    }
+
+    // Open-loop schedule: exponential gaps between arrivals at the target rate
+    mt19937_64 rng(options.seed ^ 0x9e3779b97f4a7c15ULL);
+    exponential_distribution<double> gap(options.rate);
+    discrete_distribution<int> pick(options.mix, options.mix + OPERATION_COUNT);
+    auto start = chrono::steady_clock::now();
+    auto end = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(options.duration));
+    auto next = start;
+    size_t scheduled = 0;
+    for (;;) {
+        next += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(gap(rng)));
+        if (next >= end) break;
+        this_thread::sleep_until(next);
+        Request request;
+        request.operation = static_cast<Operation>(pick(rng));
+        request.scheduled = next;
+        request.seed = rng();
+        requests.push(request);
+        ++scheduled;
+    }
+    scheduleDone.store(true, memory_order_release);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    auto lastCompletion = start;
+    for (const auto& mine : results) {
+        lastCompletion = max(lastCompletion, mine.lastCompletion);
+    }
+    double elapsed = max(chrono::duration<double>(lastCompletion - start).count(), 1e-9);
+
+    ostringstream json;
+    json << "{\"backend\":\"" << options.backend << "\",\"roster\":" << options.roster
+         << ",\"target_rate\":" << options.rate << ",\"duration_seconds\":" << options.duration
+         << ",\"concurrency\":" << options.concurrency << ",\"requests\":" << scheduled
+         << ",\"elapsed_seconds\":" << elapsed << ",\"throughput\":" << scheduled / elapsed << ",\"operations\":{";
+    bool first = true;
+    for (int op = 0; op < OPERATION_COUNT; ++op) {
+        vector<double> latencies;
+        size_t errors = 0;
+        for (const auto& mine : results) {
+            latencies.insert(latencies.end(), mine.latencies[op].begin(), mine.latencies[op].end());
+            errors += mine.errors[op];
+        }
+        if (latencies.empty()) continue;
+        sort(latencies.begin(), latencies.end());
+        json << (first ? "" : ",") << "\"" << OPERATION_NAMES[op] << "\":{\"count\":" << latencies.size()
+             << ",\"errors\":" << errors << ",\"throughput\":" << latencies.size() / elapsed
+             << ",\"latency_ms\":{\"p50\":" << percentile(latencies, 0.50) << ",\"p95\":" << percentile(latencies, 0.95)
+             << ",\"p99\":" << percentile(latencies, 0.99) << ",\"max\":" << latencies.back() << "}}";
+        first = false;
+    }
+    json << "}}";
+    cout << json.str() << endl;
+    return 0;
+}
@@ -0,0 +1,223 @@
+// Per-phase latency and counters for the attendance tools.
+//
+// A tool declares its phases and counters once, at namespace scope:
+//
+//   metrics::Phase loadPhase("load");
+//   metrics::Counter rowsScanned("rows_scanned");
+//
+// and measures a phase with a scoped timer on the monotonic clock:
+//
+//   { metrics::ScopedTimer timer(loadPhase); ... }
+//   rowsScanned.add(rows);
+//
+// Timers and counters are lock-free atomics, so libattendance records them
+// from every thread. A `metrics::Report report(argv[0]);` at the top of main
+// writes one summary to stderr when main returns, if ATTENDANCE_METRICS is set:
+//
+//   ATTENDANCE_METRICS=json        one JSON line
+//   ATTENDANCE_METRICS=prometheus  Prometheus text exposition format
+//
+// Nothing is written when the variable is unset, and the cost of an idle
+// timer is two clock reads. wall_seconds covers static initialization to
+// the report, so a caller's own measurement minus wall_seconds is the
+// process startup and teardown.
+
+#ifndef ATTENDANCE_METRICS_H
+#define ATTENDANCE_METRICS_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <cstdlib>
+#include <system_error>
+#include <filesystem>
+
+using namespace std;
+
+namespace metrics {
+
+class Phase;
+class Counter;
+
+enum class Format { None, Json, Prometheus };
+
+// Every phase and counter of the process, in declaration order
+struct Registry {
+    mutex lock;
+    vector<Phase*> phases;
+    vector<Counter*> counters;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+};
+
+inline Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+class Phase {
+private:
+    const char* phaseName;
+    atomic<uint64_t> nanos{0};
+    atomic<uint64_t> calls{0};
+
+public:
+    explicit Phase(const char* name) : phaseName(name) {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.phases.push_back(this);
+    }
+
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+    void record(uint64_t elapsedNanos) {
+        nanos.fetch_add(elapsedNanos, memory_order_relaxed);
+        calls.fetch_add(1, memory_order_relaxed);
+    }
+
+    const char* name() const { return phaseName; }
+    double seconds() const { return nanos.load(memory_order_relaxed) / 1e9; }
+    uint64_t count() const { return calls.load(memory_order_relaxed); }
+};
+
+class Counter {
+private:
+    const char* counterName;
+    atomic<uint64_t> value{0};
+
+public:
+    explicit Counter(const char* name) : counterName(name) {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.counters.push_back(this);
+    }
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void add(uint64_t amount = 1) {
+        value.fetch_add(amount, memory_order_relaxed);
+    }
+
+    // Add the size of a file just read or written (missing files add nothing)
+    void addFileSize(const string& filename) {
+        error_code ec;
+        uintmax_t size = filesystem::file_size(filename, ec);
+        if (!ec) add(static_cast<uint64_t>(size));
+    }
+
+    const char* name() const { return counterName; }
+    uint64_t get() const { return value.load(memory_order_relaxed); }
+};
+
+// Adds the time from construction to destruction to a phase
+class ScopedTimer {
+private:
+    Phase& phase;
+    chrono::steady_clock::time_point start;
+    bool running;
+
+public:
+    explicit ScopedTimer(Phase& p) : phase(p), start(chrono::steady_clock::now()), running(true) {}
+
+    ~ScopedTimer() {
+        stop();
+    }
+
+    // End the phase before the scope does; later calls do nothing
+    void stop() {
+        if (!running) return;
+        running = false;
+        auto elapsed = chrono::steady_clock::now() - start;
+        phase.record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+// Output format requested through ATTENDANCE_METRICS
+inline Format formatFromEnvironment() {
+    const char* value = getenv("ATTENDANCE_METRICS");
+    if (!value) return Format::None;
+    string text = value;
+    if (text == "json") return Format::Json;
+    if (text == "prometheus" || text == "prom") return Format::Prometheus;
+    return Format::None;
+}
+
+// Program name without its directory and extension, used as the tool label
+inline string toolName(const string& program) {
+    size_t slash = program.find_last_of("/\\");
+    string name = slash == string::npos ? program : program.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    return dot == string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// Current values of every phase and counter in the given format
+inline string format(Format fmt, const string& tool) {
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - r.start).count();
+
+    ostringstream out;
+    if (fmt == Format::Json) {
+        out << "{\"tool\":\"" << tool << "\",\"wall_seconds\":" << wall << ",\"phases\":{";
+        for (size_t i = 0; i < r.phases.size(); ++i) {
+            out << (i ? "," : "") << "\"" << r.phases[i]->name() << "\":{\"seconds\":"
+                << r.phases[i]->seconds() << ",\"calls\":" << r.phases[i]->count() << "}";
+        }
+        out << "},\"counters\":{";
+        for (size_t i = 0; i < r.counters.size(); ++i) {
+            out << (i ? "," : "") << "\"" << r.counters[i]->name() << "\":" << r.counters[i]->get();
+        }
+        out << "}}\n";
+    } else if (fmt == Format::Prometheus) {
+        const string label = "tool=\"" + tool + "\"";
+        out << "# TYPE attendance_wall_seconds gauge\n"
+            << "attendance_wall_seconds{" << label << "} " << wall << "\n"
+            << "# TYPE attendance_phase_seconds_total counter\n";
+        for (const Phase* phase : r.phases) {
+            out << "attendance_phase_seconds_total{" << label << ",phase=\"" << phase->name() << "\"} "
+                << phase->seconds() << "\n";
+        }
+        out << "# TYPE attendance_phase_calls_total counter\n";
+        for (const Phase* phase : r.phases) {
+            out << "attendance_phase_calls_total{" << label << ",phase=\"" << phase->name() << "\"} "
+                << phase->count() << "\n";
+        }
+        for (const Counter* counter : r.counters) {
+            out << "# TYPE attendance_" << counter->name() << "_total counter\n"
+                << "attendance_" << counter->name() << "_total{" << label << "} " << counter->get() << "\n";
+        }
+    }
+    return out.str();
+}
+
+// Writes the summary to stderr when main returns, if ATTENDANCE_METRICS asks for one
+class Report {
+private:
+    string tool;
+
+public:
+    explicit Report(const char* program) : tool(toolName(program ? program : "")) {}
+
+    ~Report() {
+        Format fmt = formatFromEnvironment();
+        if (fmt != Format::None) {
+            cerr << format(fmt, tool) << flush;
+        }
+    }
+
+    Report(const Report&) = delete;
+    Report& operator=(const Report&) = delete;
+};
+
+} // namespace metrics
+
+#endif // ATTENDANCE_METRICS_H
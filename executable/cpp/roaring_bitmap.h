@@ -0,0 +1,227 @@
+// Compressed bitmap of student IDs in the style of Roaring bitmaps.
+//
+// IDs are split on their high 16 bits into containers. A container with at
+// most 4096 members keeps them as a sorted uint16 array; a denser one keeps a
+// 65536-bit bitmap (1024 words), so set operations between dense containers
+// run one 64-bit word at a time.
+
+#ifndef ROARING_BITMAP_H
+#define ROARING_BITMAP_H
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+
+using namespace std;
+
+class RoaringBitmap {
+private:
+    static const size_t ARRAY_LIMIT = 4096;   // Largest container kept as an array
+    static const size_t BITMAP_WORDS = 1024;  // 65536 bits
+
+    struct Container {
+        uint16_t key;              // High 16 bits shared by every member
+        vector<uint16_t> array;    // Sorted low bits (array container)
+        vector<uint64_t> bits;     // Low-bit bitmap (bitmap container)
+        size_t cardinality;
+
+        bool isBitmap() const { return !bits.empty(); }
+    };
+
+    enum class Op { And, Or, AndNot };
+
+    vector<Container> containers;  // Sorted by key
+
+    static size_t popcount(uint64_t word) {
+#if defined(__GNUC__)
+        return static_cast<size_t>(__builtin_popcountll(word));
+#else
+        size_t count = 0;
+        for (; word; word &= word - 1) ++count;
+        return count;
+#endif
+    }
+
+    static int lowestBit(uint64_t word) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(word);
+#else
+        int bit = 0;
+        while (!((word >> bit) & 1)) ++bit;
+        return bit;
+#endif
+    }
+
+    static vector<uint64_t> toBits(const Container& c) {
+        if (c.isBitmap()) return c.bits;
+        vector<uint64_t> bits(BITMAP_WORDS, 0);
+        for (uint16_t low : c.array) {
+            bits[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+        return bits;
+    }
+
+    // Store a bitmap in whichever representation its cardinality calls for
+    static void setBits(Container& c, vector<uint64_t>&& bits, size_t cardinality) {
+        c.cardinality = cardinality;
+        c.array.clear();
+        c.bits.clear();
+        if (cardinality > ARRAY_LIMIT) {
+            c.bits = move(bits);
+            return;
+        }
+        c.array.reserve(cardinality);
+        for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                c.array.push_back(static_cast<uint16_t>((w << 6) | lowestBit(word)));
+            }
+        }
+    }
+
+    // Combine two containers with the same key; returns false if the result is empty
+    static bool combine(const Container& a, const Container& b, Op op, Container& out) {
+        out.key = a.key;
+
+        if (!a.isBitmap() && !b.isBitmap()) {
+            vector<uint16_t> merged;
+            if (op == Op::And) {
+                set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(merged));
+            } else if (op == Op::Or) {
+                set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(merged));
+            } else {
+                set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(merged));
+            }
+            if (merged.size() > ARRAY_LIMIT) {
+                Container wide{a.key, move(merged), {}, 0};
+                setBits(out, toBits(wide), wide.array.size());
+            } else {
+                out.cardinality = merged.size();
+                out.array = move(merged);
+            }
+            return out.cardinality > 0;
+        }
+
+        // An array filtered by a bitmap stays an array
+        if (op == Op::And && a.isBitmap() != b.isBitmap()) {
+            const Container& sparse = a.isBitmap() ? b : a;
+            const Container& dense = a.isBitmap() ? a : b;
+            for (uint16_t low : sparse.array) {
+                if ((dense.bits[low >> 6] >> (low & 63)) & 1) {
+                    out.array.push_back(low);
+                }
+            }
+            out.cardinality = out.array.size();
+            return out.cardinality > 0;
+        }
+
+        // Word-parallel bitmap operation
+        vector<uint64_t> bits = toBits(a);
+        vector<uint64_t> other = toBits(b);
+        size_t cardinality = 0;
+        for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+            if (op == Op::And) {
+                bits[w] &= other[w];
+            } else if (op == Op::Or) {
+                bits[w] |= other[w];
+            } else {
+                bits[w] &= ~other[w];
+            }
+            cardinality += popcount(bits[w]);
+        }
+        setBits(out, move(bits), cardinality);
+        return cardinality > 0;
+    }
+
+    static RoaringBitmap apply(const RoaringBitmap& a, const RoaringBitmap& b, Op op) {
+        RoaringBitmap result;
+        size_t i = 0, j = 0;
+        while (i < a.containers.size() || j < b.containers.size()) {
+            bool takeA = j == b.containers.size() ||
+                         (i < a.containers.size() && a.containers[i].key < b.containers[j].key);
+            bool takeB = i == a.containers.size() ||
+                         (j < b.containers.size() && b.containers[j].key < a.containers[i].key);
+            if (takeA) {
+                if (op != Op::And) result.containers.push_back(a.containers[i]);
+                ++i;
+            } else if (takeB) {
+                if (op == Op::Or) result.containers.push_back(b.containers[j]);
+                ++j;
+            } else {
+                Container out{};
+                if (combine(a.containers[i], b.containers[j], op, out)) {
+                    result.containers.push_back(move(out));
+                }
+                ++i;
+                ++j;
+            }
+        }
+        return result;
+    }
+
+public:
+    RoaringBitmap() = default;
+
+    // Build a bitmap from student IDs in any order (duplicates are ignored)
+    static RoaringBitmap fromIds(vector<int> ids) {
+        // Order by the unsigned value so containers come out sorted by key
+        sort(ids.begin(), ids.end(), [](int a, int b) {
+            return static_cast<uint32_t>(a) < static_cast<uint32_t>(b);
+        });
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+
+        RoaringBitmap result;
+        size_t start = 0;
+        while (start < ids.size()) {
+            uint16_t key = static_cast<uint16_t>(static_cast<uint32_t>(ids[start]) >> 16);
+            size_t end = start;
+            Container c{key, {}, {}, 0};
+            while (end < ids.size() && static_cast<uint16_t>(static_cast<uint32_t>(ids[end]) >> 16) == key) {
+                c.array.push_back(static_cast<uint16_t>(static_cast<uint32_t>(ids[end]) & 0xFFFF));
+                ++end;
+            }
+            c.cardinality = c.array.size();
+            if (c.cardinality > ARRAY_LIMIT) {
+                vector<uint64_t> bits = toBits(c);
+                c.array.clear();
+                c.array.shrink_to_fit();
+                c.bits = move(bits);
+            }
+            result.containers.push_back(move(c));
+            start = end;
+        }
+        return result;
+    }
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const { return apply(*this, other, Op::And); }
+    RoaringBitmap operator|(const RoaringBitmap& other) const { return apply(*this, other, Op::Or); }
+    RoaringBitmap operator-(const RoaringBitmap& other) const { return apply(*this, other, Op::AndNot); }
+
+    // Number of student IDs in the bitmap
+    size_t cardinality() const {
+        size_t total = 0;
+        for (const auto& c : containers) total += c.cardinality;
+        return total;
+    }
+
+    // Student IDs in ascending order
+    vector<int> toIds() const {
+        vector<int> ids;
+        ids.reserve(cardinality());
+        for (const auto& c : containers) {
+            uint32_t high = static_cast<uint32_t>(c.key) << 16;
+            if (!c.isBitmap()) {
+                for (uint16_t low : c.array) ids.push_back(static_cast<int>(high | low));
+                continue;
+            }
+            for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+                for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                    ids.push_back(static_cast<int>(high | (w << 6) | lowestBit(word)));
+                }
+            }
+        }
+        return ids;
+    }
+};
+
+#endif // ROARING_BITMAP_H
@@ -2,15 +2,23 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <memory>
 
+#include "art_children.h"
+#include "metrics.h"
+
 using namespace std;
 
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase outputPhase("output");
+metrics::Counter nodesVisited("nodes_visited");
+metrics::Counter bytesRead("bytes_read");
+
 // Trie node structure (same as in create_trie.cpp)
 struct TrieNode {
     bool isEndOfName;
-    unordered_map<char, shared_ptr<TrieNode>> children;
+    ArtChildren<shared_ptr<TrieNode>> children;  // Node4/16/48/256, see art_children.h
     vector<string> studentIds;
 
     TrieNode() : isEndOfName(false) {}
@@ -21,7 +29,7 @@ private:
     shared_ptr<TrieNode> root;
 
     // Helper function to deserialize the trie
-    shared_ptr<TrieNode> deserializeHelper(ifstream& inFile) {
+    shared_ptr<TrieNode> deserializeHelper(ifstream& inFile, bool withKinds) {
         auto node = make_shared<TrieNode>();
         
         // Read if this node marks the end of a name
@@ -41,17 +49,23 @@ private:
             node->studentIds.push_back(id);
         }
         
-        // Read number of children
+        // Read the node kind (absent from files older than node kinds) and
+        // number of children
+        uint8_t kind = 0;
+        if (withKinds) inFile.read(reinterpret_cast<char*>(&kind), sizeof(uint8_t));
         size_t numChildren;
         inFile.read(reinterpret_cast<char*>(&numChildren), sizeof(size_t));
+        if (withKinds && numChildren > 0 && kind <= static_cast<uint8_t>(ArtKind::Node256)) {
+            node->children.reserve(static_cast<ArtKind>(kind));
+        }
         
         // Read each child
-        for (size_t i = 0; i < numChildren; ++i) {
+        for (size_t i = 0; i < numChildren && inFile; ++i) {
             char ch;
             inFile.read(&ch, sizeof(char));
             
             // Recursively deserialize the child node
-            node->children[ch] = deserializeHelper(inFile);
+            node->children.set(ch, deserializeHelper(inFile, withKinds));
         }
         
         return node;
@@ -62,13 +76,14 @@ private:
                                   const string& prefix, 
                                   string currentPrefix,
                                   vector<pair<string, vector<string>>>& results) {
+        nodesVisited.add();
         if (node->isEndOfName) {
             results.push_back({currentPrefix, node->studentIds});
         }
         
-        for (const auto& [ch, childNode] : node->children) {
+        node->children.forEach([&](char ch, const shared_ptr<TrieNode>& childNode) {
             findStudentIdsWithPrefix(childNode, prefix, currentPrefix + ch, results);
-        }
+        });
     }
 
 public:
@@ -84,7 +99,15 @@ public:
             return false;
         }
 
-        root = deserializeHelper(inFile);
+        // Files written since node kinds were recorded start with a magic
+        char magic[sizeof(ART_TRIE_MAGIC)] = {};
+        inFile.read(magic, sizeof(magic));
+        bool withKinds = inFile && equal(magic, magic + sizeof(magic), ART_TRIE_MAGIC);
+        if (!withKinds) {
+            inFile.clear();
+            inFile.seekg(0);
+        }
+        root = deserializeHelper(inFile, withKinds);
         inFile.close();
         return true;
     }
@@ -96,11 +119,16 @@ public:
         // Navigate to the node corresponding to the prefix
         shared_ptr<TrieNode> current = root;
         for (char c : prefix) {
-            if (current->children.find(c) == current->children.end()) {
+            nodesVisited.add();
+            // A Node256 is indexed directly by the character
+            const shared_ptr<TrieNode>* dense = current->children.dense();
+            const shared_ptr<TrieNode>* child = dense ? &dense[static_cast<unsigned char>(c)]
+                                                      : current->children.find(c);
+            if (!child || !*child) {
                 // Prefix not found
                 return results;
             }
-            current = current->children[c];
+            current = *child;
         }
         
         // Collect all student IDs with the given prefix
@@ -110,6 +138,7 @@ public:
 };
 
 int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
     if (argc != 2) {
         cerr << "Usage: " << argv[0] << " <name_prefix>" << endl;
         return 1;
@@ -130,13 +159,20 @@ int main(int argc, char* argv[]) {
     Trie trie;
     
     // Deserialize the trie
+    metrics::ScopedTimer loadTimer(loadPhase);
     if (!trie.deserialize(trieFilename)) {
         cout << "-1" << endl; // Failed to deserialize
         return 1;
     }
+    bytesRead.addFileSize(trieFilename);
+    loadTimer.stop();
     
     // Search for student IDs with the given prefix
+    metrics::ScopedTimer computeTimer(computePhase);
     auto results = trie.searchByPrefix(prefix);
+    computeTimer.stop();
+    
+    metrics::ScopedTimer outputTimer(outputPhase);
     if (results.empty()) {
         cout << "0" << endl; // No students found with the given prefix
     } else {
@@ -0,0 +1,160 @@
+// Synthetic rosters for load and scale testing.
+//
+// generateRoster(n, seed) makes n students with
+//   - names drawn from first and last name lists with Zipfian popularity, half
+//     of them with a middle name, so prefixes are shared the way real class
+//     lists share them ("Aa", "Ar"...) and popular names repeat
+//   - random 128-d face descriptors, far apart from each other (about 1.4)
+//     compared with the 0.6 acceptance distance
+//   - per-subject attendance out of 100 lectures with a Zipfian number of
+//     missed lectures: most students miss a few, a long tail misses many
+// The same n, seed and dimension always give the same roster. writeStudentsCSV and
+// writeAttendanceCSV write it in the layout of executable/data.
+
+#ifndef SYNTHETIC_ROSTER_H
+#define SYNTHETIC_ROSTER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+
+using namespace std;
+
+const vector<string> SYNTHETIC_SUBJECTS = {"maths", "english", "chemistry", "physics", "datastructure"};
+const int SYNTHETIC_LECTURES = 100;
+const int SYNTHETIC_FIRST_ID = 100000;
+
+struct SyntheticStudent {
+    int studentId;
+    string name;
+    vector<double> face;
+    vector<int> attendance;  // One count per SYNTHETIC_SUBJECTS entry
+};
+
+// Ranks 0..n-1 with P(rank k) proportional to 1 / (k + 1)^exponent
+class ZipfSampler {
+private:
+    vector<double> cdf;
+
+public:
+    ZipfSampler(size_t n, double exponent) : cdf(max<size_t>(1, n)) {
+        double sum = 0;
+        for (size_t k = 0; k < cdf.size(); ++k) {
+            sum += 1.0 / pow(static_cast<double>(k + 1), exponent);
+            cdf[k] = sum;
+        }
+        for (double& c : cdf) c /= sum;
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) const {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        size_t k = static_cast<size_t>(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+        return min(k, cdf.size() - 1);
+    }
+};
+
+namespace synthetic_detail {
+
+const char* const FIRST_NAMES[] = {
+    "Aarav", "Aarohi", "Aditya", "Advik", "Ananya", "Anika", "Arjun", "Arnav", "Avni", "Ayaan",
+    "Bhavya", "Chaitanya", "Dev", "Dhruv", "Diya", "Gauri", "Ishaan", "Isha", "Kabir", "Kavya",
+    "Krish", "Meera", "Mihir", "Myra", "Neha", "Nikhil", "Pari", "Pranav", "Riya", "Rohan",
+    "Saanvi", "Sai", "Sara", "Shaurya", "Siya", "Tara", "Vihaan", "Vivaan", "Yash", "Zara"};
+const char* const LAST_NAMES[] = {
+    "Agarwal", "Bansal", "Bhatt", "Chopra", "Das", "Desai", "Gupta", "Iyer", "Jain", "Joshi",
+    "Kapoor", "Khan", "Kulkarni", "Kumar", "Malhotra", "Mehta", "Menon", "Mishra", "Nair", "Patel",
+    "Pillai", "Rao", "Reddy", "Saxena", "Shah", "Sharma", "Singh", "Sinha", "Verma", "Yadav"};
+
+} // namespace synthetic_detail
+
+// A random face descriptor
+template <typename Rng>
+vector<double> syntheticFace(Rng& rng, size_t dimension = 128) {
+    normal_distribution<double> component(0.0, 0.09);
+    vector<double> face(dimension);
+    for (double& v : face) v = component(rng);
+    return face;
+}
+
+// Another capture of the same face: the descriptor plus per-component noise
+template <typename Rng>
+vector<double> noisyCapture(const vector<double>& face, Rng& rng, double sigma = 0.02) {
+    normal_distribution<double> noise(0.0, sigma);
+    vector<double> capture(face);
+    for (double& v : capture) v += noise(rng);
+    return capture;
+}
+
+// dimension 0 leaves the faces empty, for rosters only the name and
+// attendance indexes will see
+inline vector<SyntheticStudent> generateRoster(size_t n, uint64_t seed, size_t dimension = 128) {
+    using namespace synthetic_detail;
+    const size_t firstCount = sizeof(FIRST_NAMES) / sizeof(FIRST_NAMES[0]);
+    const size_t lastCount = sizeof(LAST_NAMES) / sizeof(LAST_NAMES[0]);
+
+    mt19937_64 rng(seed);
+    ZipfSampler firstName(firstCount, 1.0);
+    ZipfSampler middleName(firstCount, 0.6);
+    ZipfSampler lastName(lastCount, 0.8);
+    ZipfSampler missed(SYNTHETIC_LECTURES + 1, 1.2);
+
+    vector<SyntheticStudent> roster(n);
+    for (size_t i = 0; i < n; ++i) {
+        SyntheticStudent& student = roster[i];
+        student.studentId = SYNTHETIC_FIRST_ID + static_cast<int>(i);
+        student.name = FIRST_NAMES[firstName(rng)];
+        if (rng() % 2) {
+            student.name += string(" ") + FIRST_NAMES[middleName(rng)];
+        }
+        student.name += string(" ") + LAST_NAMES[lastName(rng)];
+        student.face = syntheticFace(rng, dimension);
+        for (size_t s = 0; s < SYNTHETIC_SUBJECTS.size(); ++s) {
+            student.attendance.push_back(SYNTHETIC_LECTURES - static_cast<int>(missed(rng)));
+        }
+    }
+    return roster;
+}
+
+// student_id,name,rn,"v1,...,v128"
+inline bool writeStudentsCSV(const string& filename, const vector<SyntheticStudent>& roster) {
+    ofstream out(filename);
+    if (!out) return false;
+    out << "student_id,name,rn,facial_vector\n" << setprecision(17);
+    for (size_t i = 0; i < roster.size(); ++i) {
+        out << roster[i].studentId << "," << roster[i].name << "," << i + 1 << ",\"";
+        for (size_t d = 0; d < roster[i].face.size(); ++d) {
+            out << (d ? "," : "") << roster[i].face[d];
+        }
+        out << "\"\n";
+    }
+    return static_cast<bool>(out);
+}
+
+// student_id,name,<subject>...,total_attendance
+inline bool writeAttendanceCSV(const string& filename, const vector<SyntheticStudent>& roster) {
+    ofstream out(filename);
+    if (!out) return false;
+    out << "student_id,name";
+    for (const auto& subject : SYNTHETIC_SUBJECTS) {
+        out << "," << subject;
+    }
+    out << ",total_attendance\n";
+    for (const auto& student : roster) {
+        int total = 0;
+        out << student.studentId << "," << student.name;
+        for (int count : student.attendance) {
+            out << "," << count;
+            total += count;
+        }
+        out << "," << total << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+#endif // SYNTHETIC_ROSTER_H
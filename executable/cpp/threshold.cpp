@@ -4,34 +4,83 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <climits>
 #include <map>
+#include <set>
+#include <cctype>
+#include <stdexcept>
+#include <filesystem>
+#include <cstdint>
+
+#include "metrics.h"
 
 using namespace std;
 
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase outputPhase("output");
+metrics::Counter nodesVisited("nodes_visited");
+metrics::Counter bytesRead("bytes_read");
+
+// Largest attendance value the histogram backend keeps a bucket for
+const int MAX_ATTENDANCE = 1000;
+
 // AVL Tree Node structure (same as in create_attendance_avl.cpp)
 struct AVLNode {
     int attendance;     // Key by which the tree is balanced
     vector<int> studentIds;  // Student IDs with this attendance
     int height;
+    int count;          // Number of student IDs in this subtree (order statistics)
     shared_ptr<AVLNode> left;
     shared_ptr<AVLNode> right;
 
     AVLNode(int attend) 
-        : attendance(attend), height(1), left(nullptr), right(nullptr) {}
+        : attendance(attend), height(1), count(0), left(nullptr), right(nullptr) {}
 };
 
 class AVLTree {
 private:
     shared_ptr<AVLNode> root;
+    vector<pair<int, int>> index;  // (student ID, attendance) pairs sorted by student ID
+
+    // Files start with a magic and layout version. Version 1 is the original
+    // layout, written with no header and no subtree counts; it is still read,
+    // and the counts are recomputed on load.
+    static constexpr uint32_t MAGIC = 0x4c564141;  // "AAVL"
+    static constexpr uint32_t VERSION = 2;
+
+    // Get number of student IDs in a subtree
+    int getCount(const shared_ptr<AVLNode>& node) {
+        if (!node) return 0;
+        return node->count;
+    }
+
+    // Bytes between the read position and the end of the file, so that a
+    // corrupt length is rejected instead of turned into an allocation
+    static size_t bytesLeft(ifstream& inFile) {
+        streampos here = inFile.tellg();
+        inFile.seekg(0, ios::end);
+        streampos end = inFile.tellg();
+        inFile.seekg(here);
+        return end > here ? static_cast<size_t>(end - here) : 0;
+    }
+
+    // Recompute subtree counts bottom-up (version 1 files)
+    int restoreCounts(const shared_ptr<AVLNode>& node) {
+        if (!node) return 0;
+        node->count = static_cast<int>(node->studentIds.size()) + restoreCounts(node->left) +
+                      restoreCounts(node->right);
+        return node->count;
+    }
 
     // Helper function to deserialize the AVL tree
-    shared_ptr<AVLNode> deserializeHelper(ifstream& inFile) {
+    shared_ptr<AVLNode> deserializeHelper(ifstream& inFile, bool withCounts) {
         // Read attendance value
-        int attendance;
+        int attendance = -1;
         inFile.read(reinterpret_cast<char*>(&attendance), sizeof(int));
         
-        // Check for null node marker
-        if (attendance == -1) {
+        // Check for null node marker (or a truncated file, reported by the caller)
+        if (!inFile || attendance == -1) {
             return nullptr;
         }
         
@@ -43,7 +92,7 @@ private:
         inFile.read(reinterpret_cast<char*>(&numIds), sizeof(size_t));
         
         // Read student IDs
-        for (size_t i = 0; i < numIds; ++i) {
+        for (size_t i = 0; i < numIds && inFile; ++i) {
             int studentId;
             inFile.read(reinterpret_cast<char*>(&studentId), sizeof(int));
             node->studentIds.push_back(studentId);
@@ -52,91 +101,573 @@ private:
         // Read node height
         inFile.read(reinterpret_cast<char*>(&node->height), sizeof(int));
         
+        // Read subtree student count (version 1 files have none)
+        if (withCounts) {
+            inFile.read(reinterpret_cast<char*>(&node->count), sizeof(int));
+        }
+        
         // Recursively deserialize left and right subtrees
-        node->left = deserializeHelper(inFile);
-        node->right = deserializeHelper(inFile);
+        node->left = deserializeHelper(inFile, withCounts);
+        node->right = deserializeHelper(inFile, withCounts);
         
         return node;
     }
 
-    // Helper function to collect student IDs based on threshold
+    // Helper function to collect student IDs with attendance in [lo, hi] in descending
+    // order of attendance (reverse in-order walk). Subtrees that lie entirely outside
+    // the range are never entered, and the walk stops once limit IDs are collected.
     void collectStudentIds(const shared_ptr<AVLNode>& node, 
-                          int threshold, 
-                          int direction, 
-                          map<int, vector<int>, greater<int>>& result) {
-        if (!node) return;
+                          int lo, 
+                          int hi, 
+                          size_t limit, 
+                          vector<int>& result) {
+        if (!node || (limit > 0 && result.size() >= limit)) return;
+        nodesVisited.add();
         
-        // Process this node if it meets the condition
-        if ((direction > 0 && node->attendance >= threshold) || 
-            (direction < 0 && node->attendance <= threshold)) {
-            result[node->attendance].insert(result[node->attendance].end(), 
-                                           node->studentIds.begin(), 
-                                           node->studentIds.end());
+        // Larger attendance values first
+        if (node->attendance < hi) {
+            collectStudentIds(node->right, lo, hi, limit, result);
         }
         
-        // Traverse the tree - in-order traversal
-        collectStudentIds(node->left, threshold, direction, result);
-        collectStudentIds(node->right, threshold, direction, result);
+        if (node->attendance >= lo && node->attendance <= hi) {
+            for (const auto& id : node->studentIds) {
+                if (limit > 0 && result.size() >= limit) return;
+                result.push_back(id);
+            }
+        }
+        
+        if (node->attendance > lo) {
+            collectStudentIds(node->left, lo, hi, limit, result);
+        }
+    }
+
+    // Helper function to read the student ID index stored after the tree
+    bool deserializeIndex(ifstream& inFile) {
+        size_t numEntries;
+        if (!inFile.read(reinterpret_cast<char*>(&numEntries), sizeof(size_t))) {
+            return false;
+        }
+        if (numEntries > bytesLeft(inFile) / sizeof(pair<int, int>)) {
+            return false;
+        }
+        
+        index.resize(numEntries);
+        if (numEntries > 0 &&
+            !inFile.read(reinterpret_cast<char*>(index.data()), numEntries * sizeof(pair<int, int>))) {
+            index.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Collect (student ID, attendance) pairs from the tree, for files without an index
+    void buildIndex(const shared_ptr<AVLNode>& node) {
+        if (!node) return;
+        for (const auto& id : node->studentIds) {
+            index.push_back({id, node->attendance});
+        }
+        buildIndex(node->left);
+        buildIndex(node->right);
+    }
+
+    // Number of student IDs with attendance strictly below (or, if inclusive, at most) a value
+    int countBelow(int attendance, bool inclusive) {
+        int result = 0;
+        shared_ptr<AVLNode> node = root;
+        while (node) {
+            nodesVisited.add();
+            if (node->attendance < attendance || (inclusive && node->attendance == attendance)) {
+                result += getCount(node->left) + static_cast<int>(node->studentIds.size());
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return result;
     }
 
 public:
     AVLTree() : root(nullptr) {}
 
     // Deserialize the AVL tree from a binary file
-    bool deserialize(const string& filename) {
+    // (the student ID index is only needed for rank queries)
+    bool deserialize(const string& filename, bool withIndex = false) {
         ifstream inFile(filename, ios::binary);
         if (!inFile) {
             cerr << "Error opening file for reading: " << filename << endl;
             return false;
         }
 
-        root = deserializeHelper(inFile);
+        // Version 1 files have no header and start with the root's attendance,
+        // which is never the magic
+        uint32_t header[2] = {0, 0};
+        inFile.read(reinterpret_cast<char*>(header), sizeof(header));
+        bool withCounts = inFile && header[0] == MAGIC;
+        if (withCounts && header[1] != VERSION) {
+            cerr << "Unsupported attendance index version " << header[1] << ": " << filename << endl;
+            return false;
+        }
+        if (!withCounts) {
+            inFile.clear();
+            inFile.seekg(0);
+        }
+
+        root = deserializeHelper(inFile, withCounts);
+        if (!inFile) {
+            cerr << "Truncated attendance index: " << filename << endl;
+            return false;
+        }
+        if (!withCounts) {
+            restoreCounts(root);
+        }
+        // Version 1 files carry only the tree, so derive the index from it
+        if (withIndex && !deserializeIndex(inFile)) {
+            if (withCounts) {
+                cerr << "Truncated student ID index in " << filename << endl;
+                return false;
+            }
+            buildIndex(root);
+            sort(index.begin(), index.end());
+        }
         inFile.close();
         
         return true;
     }
 
-    // Get student IDs above or below a threshold in descending order of attendance
-    vector<int> getStudentIdsByThreshold(int threshold, int direction) {
-        map<int, vector<int>, greater<int>> attendanceMap; // Uses descending order
-        collectStudentIds(root, threshold, direction, attendanceMap);
-        
-        // Flatten the map into a vector of student IDs
+    // Get student IDs with attendance in [lo, hi] in descending order of attendance
+    // (limit 0 means no limit)
+    vector<int> getStudentIdsInRange(int lo, int hi, size_t limit = 0) {
         vector<int> result;
-        for (const auto& [attendance, ids] : attendanceMap) {
-            result.insert(result.end(), ids.begin(), ids.end());
+        if (lo <= hi) {
+            collectStudentIds(root, lo, hi, limit, result);
+        }
+        return result;
+    }
+
+    // Get student IDs above or below a threshold in descending order of attendance
+    vector<int> getStudentIdsByThreshold(int threshold, int direction, size_t limit = 0) {
+        if (direction > 0) {
+            return getStudentIdsInRange(threshold, INT_MAX, limit);
+        }
+        return getStudentIdsInRange(INT_MIN, threshold, limit);
+    }
+
+    // Total number of student IDs in the tree
+    int size() {
+        return getCount(root);
+    }
+
+    // Number of student IDs with attendance in [lo, hi]
+    int countInRange(int lo, int hi) {
+        if (lo > hi) return 0;
+        return countBelow(hi, true) - countBelow(lo, false);
+    }
+
+    // Find the k-th smallest (direction -1) or k-th largest (direction 1) entry, 1-based
+    bool kthStudent(int k, int direction, int& studentId, int& attendance) {
+        if (k < 1 || k > size()) return false;
+        if (direction > 0) {
+            k = size() - k + 1;
         }
         
+        shared_ptr<AVLNode> node = root;
+        while (node) {
+            nodesVisited.add();
+            int leftCount = getCount(node->left);
+            int here = static_cast<int>(node->studentIds.size());
+            if (k <= leftCount) {
+                node = node->left;
+            } else if (k <= leftCount + here) {
+                studentId = node->studentIds[k - leftCount - 1];
+                attendance = node->attendance;
+                return true;
+            } else {
+                k -= leftCount + here;
+                node = node->right;
+            }
+        }
+        return false;
+    }
+
+    // Look up a student's attendance through the ID index
+    bool findAttendance(int studentId, int& attendance) {
+        auto it = lower_bound(index.begin(), index.end(), make_pair(studentId, INT_MIN));
+        if (it == index.end() || it->first != studentId) return false;
+        attendance = it->second;
+        return true;
+    }
+};
+
+#ifdef ATTENDANCE_HISTOGRAM
+#include "attendance_histogram.h"
+using AttendanceIndex = AttendanceHistogram;
+#else
+using AttendanceIndex = AVLTree;
+#endif
+
+#include "attendance_snapshot.h"
+#include "roaring_bitmap.h"
+
+// One subject's index for compound queries: its mapped snapshot when there is
+// one, otherwise the deserialized .dat
+struct SubjectIndex {
+    unique_ptr<AttendanceSnapshot> snapshot;
+    unique_ptr<AttendanceIndex> tree;
+
+    vector<int> getStudentIdsInRange(int lo, int hi) {
+        return snapshot ? snapshot->getStudentIdsInRange(lo, hi) : tree->getStudentIdsInRange(lo, hi);
+    }
+};
+
+// Evaluates boolean expressions over per-subject attendance ranges with bitmaps:
+//   expr      := term { ('|' | OR) term }
+//   term      := factor { ('&' | AND) factor }
+//   factor    := ('!' | NOT) factor | '(' expr ')' | predicate
+//   predicate := subject ('<' | '<=' | '>' | '>=' | '=') number
+// The subject 'any' ORs the predicate over every subject in the directory and
+// 'all' ANDs it. NOT is taken relative to every student in any subject.
+// Throws invalid_argument on malformed expressions or unknown subjects.
+class CompoundQuery {
+private:
+    string dir;
+    string text;
+    size_t pos;
+    map<string, SubjectIndex> subjects;
+    unique_ptr<RoaringBitmap> universe;
+
+    // Subjects with a snapshot or a .dat index in the directory (total_attendance
+    // is not a subject, and name.dat is the name trie)
+    vector<string> listSubjects() {
+        set<string> names;
+        for (const auto& entry : filesystem::directory_iterator(dir)) {
+            const string extension = entry.path().extension().string();
+            const string stem = entry.path().stem().string();
+            if ((extension == ".snap" || extension == ".dat") && stem != "total_attendance" && stem != "name") {
+                names.insert(stem);
+            }
+        }
+        return vector<string>(names.begin(), names.end());
+    }
+
+    SubjectIndex& loadSubject(const string& subject) {
+        auto it = subjects.find(subject);
+        if (it != subjects.end()) return it->second;
+
+        SubjectIndex index;
+        const string base = dir + "/" + subject;
+        ifstream snapshotCheck(base + ".snap");
+        if (snapshotCheck.good()) {
+            index.snapshot.reset(new AttendanceSnapshot());
+            if (!index.snapshot->deserialize(base + ".snap")) {
+                throw invalid_argument("cannot map " + base + ".snap");
+            }
+            bytesRead.addFileSize(base + ".snap");
+        } else {
+            ifstream datCheck(base + ".dat");
+            if (!datCheck.good()) {
+                throw invalid_argument("unknown subject '" + subject + "'");
+            }
+            index.tree.reset(new AttendanceIndex());
+            if (!index.tree->deserialize(base + ".dat")) {
+                throw invalid_argument("cannot read " + base + ".dat");
+            }
+            bytesRead.addFileSize(base + ".dat");
+        }
+        return subjects.emplace(subject, move(index)).first->second;
+    }
+
+    RoaringBitmap& getUniverse() {
+        if (!universe) {
+            universe.reset(new RoaringBitmap());
+            for (const auto& subject : listSubjects()) {
+                *universe = *universe | RoaringBitmap::fromIds(loadSubject(subject).getStudentIdsInRange(INT_MIN, INT_MAX));
+            }
+        }
+        return *universe;
+    }
+
+    void skipSpaces() {
+        while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) ++pos;
+    }
+
+    // Consume a symbol or a case-insensitive keyword if it comes next
+    bool accept(const string& token) {
+        skipSpaces();
+        if (text.size() - pos < token.size()) return false;
+        for (size_t i = 0; i < token.size(); ++i) {
+            if (toupper(static_cast<unsigned char>(text[pos + i])) != toupper(static_cast<unsigned char>(token[i]))) {
+                return false;
+            }
+        }
+        // Keywords must not run into a following identifier (e.g. "ORdinal")
+        size_t end = pos + token.size();
+        if (isalpha(static_cast<unsigned char>(token[0])) && end < text.size() &&
+            (isalnum(static_cast<unsigned char>(text[end])) || text[end] == '_')) {
+            return false;
+        }
+        pos = end;
+        return true;
+    }
+
+    string readIdentifier() {
+        skipSpaces();
+        size_t start = pos;
+        while (pos < text.size() && (isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) ++pos;
+        if (start == pos) {
+            throw invalid_argument("expected a subject at position " + to_string(start));
+        }
+        return text.substr(start, pos - start);
+    }
+
+    int readNumber() {
+        skipSpaces();
+        size_t used = 0;
+        int value;
+        try {
+            value = stoi(text.substr(pos), &used);
+        } catch (const exception&) {
+            throw invalid_argument("expected a number at position " + to_string(pos));
+        }
+        pos += used;
+        return value;
+    }
+
+    RoaringBitmap parsePredicate() {
+        string subject = readIdentifier();
+        int lo = INT_MIN, hi = INT_MAX;
+        if (accept("<=")) {
+            hi = readNumber();
+        } else if (accept(">=")) {
+            lo = readNumber();
+        } else if (accept("<")) {
+            hi = readNumber();
+            if (hi == INT_MIN) return RoaringBitmap();
+            --hi;
+        } else if (accept(">")) {
+            lo = readNumber();
+            if (lo == INT_MAX) return RoaringBitmap();
+            ++lo;
+        } else if (accept("=")) {
+            accept("=");
+            lo = hi = readNumber();
+        } else {
+            throw invalid_argument("expected a comparison after '" + subject + "'");
+        }
+
+        if (subject == "any" || subject == "all") {
+            vector<string> names = listSubjects();
+            if (names.empty()) {
+                throw invalid_argument("no subject indexes in " + dir);
+            }
+            RoaringBitmap result = RoaringBitmap::fromIds(loadSubject(names[0]).getStudentIdsInRange(lo, hi));
+            for (size_t i = 1; i < names.size(); ++i) {
+                RoaringBitmap next = RoaringBitmap::fromIds(loadSubject(names[i]).getStudentIdsInRange(lo, hi));
+                result = subject == "any" ? result | next : result & next;
+            }
+            return result;
+        }
+        return RoaringBitmap::fromIds(loadSubject(subject).getStudentIdsInRange(lo, hi));
+    }
+
+    RoaringBitmap parseFactor() {
+        if (accept("!") || accept("NOT")) {
+            return getUniverse() - parseFactor();
+        }
+        if (accept("(")) {
+            RoaringBitmap result = parseExpression();
+            if (!accept(")")) {
+                throw invalid_argument("expected ')' at position " + to_string(pos));
+            }
+            return result;
+        }
+        return parsePredicate();
+    }
+
+    RoaringBitmap parseTerm() {
+        RoaringBitmap result = parseFactor();
+        while (accept("&") || accept("AND")) {
+            result = result & parseFactor();
+        }
         return result;
     }
+
+    RoaringBitmap parseExpression() {
+        RoaringBitmap result = parseTerm();
+        while (accept("|") || accept("OR")) {
+            result = result | parseTerm();
+        }
+        return result;
+    }
+
+public:
+    explicit CompoundQuery(const string& serializedDir) : dir(serializedDir), pos(0) {}
+
+    // Student IDs matching an expression, in ascending order
+    vector<int> evaluate(const string& expression) {
+        text = expression;
+        pos = 0;
+        RoaringBitmap result = parseExpression();
+        skipSpaces();
+        if (pos != text.size()) {
+            throw invalid_argument("unexpected '" + text.substr(pos) + "'");
+        }
+        return result.toIds();
+    }
+};
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " <dat_file_name> <threshold> <direction> [limit]" << endl;
+    cerr << "       " << program << " <dat_file_name> --range <lo> <hi> [limit]" << endl;
+    cerr << "       " << program << " <dat_file_name> --count <lo> <hi>" << endl;
+    cerr << "       " << program << " <dat_file_name> --kth <k> <direction>" << endl;
+    cerr << "       " << program << " <dat_file_name> --rank <student_id>" << endl;
+    cerr << "       " << program << " --query <serialized_dir> <expression>" << endl;
+    cerr << "  dat_file_name: a <subject>.dat index or its memory-mapped <subject>.snap snapshot" << endl;
+    cerr << "  direction: 1 for above threshold / k-th largest, -1 for below threshold / k-th smallest" << endl;
+    cerr << "  limit: maximum number of student IDs to print (0 for all)" << endl;
+    cerr << "  expression: e.g. \"maths < 70 AND physics < 70\", \"any > 90\", \"!(all >= 75)\"" << endl;
+}
+
+// Parsed command line query
+struct Query {
+    string mode;
+    int lo = 0, hi = 0, k = 0, direction = 0, studentId = 0;
+    long long limit = 0;
 };
 
+// Answer a query against a loaded index (tree, histogram or mapped snapshot)
+template <typename Index>
+int runQuery(Index& avlTree, const Query& query) {
+    metrics::ScopedTimer computeTimer(computePhase);
+    if (query.mode == "--count") {
+        int count = avlTree.countInRange(query.lo, query.hi);
+        computeTimer.stop();
+        metrics::ScopedTimer outputTimer(outputPhase);
+        cout << count << endl;
+        return 0;
+    }
+    
+    if (query.mode == "--kth") {
+        int studentId, attendance;
+        bool found = avlTree.kthStudent(query.k, query.direction, studentId, attendance);
+        computeTimer.stop();
+        metrics::ScopedTimer outputTimer(outputPhase);
+        if (!found) {
+            cout << "-1" << endl; // k is out of range
+            return 1;
+        }
+        cout << studentId << " " << attendance << endl;
+        return 0;
+    }
+    
+    if (query.mode == "--rank") {
+        int attendance;
+        if (!avlTree.findAttendance(query.studentId, attendance)) {
+            cout << "-1" << endl; // Student not in this tree
+            return 1;
+        }
+        // Output: attendance, rank from the top (1 = highest), total, percentile
+        int total = avlTree.size();
+        int below = avlTree.countInRange(INT_MIN, attendance - 1);
+        int above = avlTree.countInRange(attendance + 1, INT_MAX);
+        computeTimer.stop();
+        metrics::ScopedTimer outputTimer(outputPhase);
+        cout << attendance << " " << above + 1 << " " << total << " "
+             << (total > 0 ? 100.0 * below / total : 0.0) << endl;
+        return 0;
+    }
+    
+    // Get student IDs in the requested attendance range
+    vector<int> studentIds = avlTree.getStudentIdsInRange(query.lo, query.hi, static_cast<size_t>(query.limit));
+    computeTimer.stop();
+    
+    // Output student IDs
+    metrics::ScopedTimer outputTimer(outputPhase);
+    if (studentIds.empty()) {
+        cout << "0" << endl; // No students meet the criteria
+    } else {
+        for (const auto& id : studentIds) {
+            cout << id << endl;
+        }
+    }
+    
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        cerr << "Usage: " << argv[0] << " <dat_file_name> <threshold> <direction>" << endl;
-        cerr << "  direction: 1 for above threshold, -1 for below threshold" << endl;
+    metrics::Report report(argv[0]);
+    if (argc >= 2 && string(argv[1]) == "--query") {
+        if (argc != 4) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        vector<int> studentIds;
+        try {
+            // Subjects are loaded lazily while the expression is evaluated, so
+            // their load time is part of compute here
+            metrics::ScopedTimer computeTimer(computePhase);
+            CompoundQuery compoundQuery(argv[2]);
+            studentIds = compoundQuery.evaluate(argv[3]);
+        } catch (const exception& e) {
+            cerr << "Error evaluating query: " << e.what() << endl;
+            return 1;
+        }
+        metrics::ScopedTimer outputTimer(outputPhase);
+        if (studentIds.empty()) {
+            cout << "0" << endl; // No students meet the criteria
+        }
+        for (const auto& id : studentIds) {
+            cout << id << '\n';
+        }
+        return 0;
+    }
+
+    Query query;
+    query.mode = argc >= 3 ? argv[2] : "";
+    const string& mode = query.mode;
+    bool rangeMode = mode == "--range";
+    bool statMode = mode == "--count" || mode == "--kth" || mode == "--rank";
+    
+    if ((rangeMode && argc != 5 && argc != 6) ||
+        (mode == "--count" && argc != 5) || (mode == "--kth" && argc != 5) || (mode == "--rank" && argc != 4) ||
+        (!rangeMode && !statMode && argc != 4 && argc != 5)) {
+        printUsage(argv[0]);
         return 1;
     }
 
     const string datFilename = argv[1];
-    int threshold;
-    int direction;
     
     try {
-        threshold = stoi(argv[2]);
-        direction = stoi(argv[3]);
+        if (rangeMode || mode == "--count") {
+            query.lo = stoi(argv[3]);
+            query.hi = stoi(argv[4]);
+            if (argc == 6) query.limit = stoll(argv[5]);
+        } else if (mode == "--kth") {
+            query.k = stoi(argv[3]);
+            query.direction = stoi(argv[4]);
+        } else if (mode == "--rank") {
+            query.studentId = stoi(argv[3]);
+        } else {
+            int threshold = stoi(argv[2]);
+            query.direction = stoi(argv[3]);
+            if (argc == 5) query.limit = stoll(argv[4]);
+            query.lo = query.direction > 0 ? threshold : INT_MIN;
+            query.hi = query.direction > 0 ? INT_MAX : threshold;
+        }
         
-        if (direction != 1 && direction != -1) {
+        if (!rangeMode && mode != "--count" && mode != "--rank" && query.direction != 1 && query.direction != -1) {
             cerr << "Direction must be 1 (above) or -1 (below)" << endl;
             return 1;
         }
+        if (query.limit < 0) {
+            cerr << "Limit must not be negative" << endl;
+            return 1;
+        }
     } catch (const exception& e) {
         cerr << "Error parsing arguments: " << e.what() << endl;
         return 1;
     }
     
-    AVLTree avlTree;
-    
     // Check if the file exists
     ifstream fileCheck(datFilename);
     if (!fileCheck) {
@@ -145,23 +676,29 @@ int main(int argc, char* argv[]) {
     }
     fileCheck.close();
     
-    // Deserialize the AVL tree
-    if (!avlTree.deserialize(datFilename)) {
-        cerr << "Failed to deserialize the AVL tree from " << datFilename << endl;
-        return 1;
+    // Snapshots are mapped and queried in place
+    if (isSnapshotFile(datFilename)) {
+        AttendanceSnapshot snapshot;
+        metrics::ScopedTimer loadTimer(loadPhase);
+        if (!snapshot.deserialize(datFilename)) {
+            cerr << "Failed to map the attendance snapshot " << datFilename << endl;
+            return 1;
+        }
+        bytesRead.addFileSize(datFilename);  // Mapped; pages are read on first touch
+        loadTimer.stop();
+        return runQuery(snapshot, query);
     }
     
-    // Get student IDs based on threshold and direction
-    vector<int> studentIds = avlTree.getStudentIdsByThreshold(threshold, direction);
+    AttendanceIndex avlTree;
     
-    // Output student IDs
-    if (studentIds.empty()) {
-        cout << "0" << endl; // No students meet the criteria
-    } else {
-        for (const auto& id : studentIds) {
-            cout << id << endl;
-        }
+    // Deserialize the AVL tree
+    metrics::ScopedTimer loadTimer(loadPhase);
+    if (!avlTree.deserialize(datFilename, mode == "--rank")) {
+        cerr << "Failed to deserialize the AVL tree from " << datFilename << endl;
+        return 1;
     }
+    bytesRead.addFileSize(datFilename);
+    loadTimer.stop();
     
-    return 0;
-}
\ No newline at end of file
+    return runQuery(avlTree, query);
+}
@@ -4,22 +4,35 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <unordered_map>
+#include <sstream>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 using namespace std;
 
+// Largest accepted attendance value (total_attendance runs well past 100)
+const int MAX_ATTENDANCE = 1000;
+
 // AVL Tree Node structure (same as in previous programs)
 struct AVLNode {
     int attendance;     // Key by which the tree is balanced
     vector<int> studentIds;  // Student IDs with this attendance
     int height;
+    int count;          // Number of student IDs in this subtree (order statistics)
     shared_ptr<AVLNode> left;
     shared_ptr<AVLNode> right;
 
     AVLNode(int attend) 
-        : attendance(attend), height(1), left(nullptr), right(nullptr) {}
+        : attendance(attend), height(1), count(0), left(nullptr), right(nullptr) {}
         
     AVLNode(int attend, int studentId) 
-        : attendance(attend), height(1), left(nullptr), right(nullptr) {
+        : attendance(attend), height(1), count(1), left(nullptr), right(nullptr) {
         studentIds.push_back(studentId);
     }
 };
@@ -27,7 +40,13 @@ struct AVLNode {
 class AVLTree {
 private:
     shared_ptr<AVLNode> root;
-    bool studentFound;  // Flag to track if student ID was found during update
+    unordered_map<int, int> attendanceOf;  // Student ID -> attendance bucket it lives in
+
+    // Files start with a magic and layout version. Version 1 is the original
+    // layout, written with no header and no subtree counts; it is still read,
+    // and the counts are recomputed on load.
+    static constexpr uint32_t MAGIC = 0x4c564141;  // "AAVL"
+    static constexpr uint32_t VERSION = 2;
 
     // Get height of a node
     int getHeight(const shared_ptr<AVLNode>& node) {
@@ -41,10 +60,17 @@ private:
         return getHeight(node->left) - getHeight(node->right);
     }
 
-    // Update height of a node
+    // Get number of student IDs in a subtree
+    int getCount(const shared_ptr<AVLNode>& node) {
+        if (!node) return 0;
+        return node->count;
+    }
+
+    // Update height and subtree student count of a node
     void updateHeight(shared_ptr<AVLNode>& node) {
         if (!node) return;
         node->height = 1 + max(getHeight(node->left), getHeight(node->right));
+        node->count = static_cast<int>(node->studentIds.size()) + getCount(node->left) + getCount(node->right);
     }
 
     // Right rotation
@@ -79,14 +105,32 @@ private:
         return y;
     }
 
+    // Bytes between the read position and the end of the file, so that a
+    // corrupt length is rejected instead of turned into an allocation
+    static size_t bytesLeft(ifstream& inFile) {
+        streampos here = inFile.tellg();
+        inFile.seekg(0, ios::end);
+        streampos end = inFile.tellg();
+        inFile.seekg(here);
+        return end > here ? static_cast<size_t>(end - here) : 0;
+    }
+
+    // Recompute heights and subtree counts bottom-up (version 1 files)
+    void restoreCounts(shared_ptr<AVLNode>& node) {
+        if (!node) return;
+        restoreCounts(node->left);
+        restoreCounts(node->right);
+        updateHeight(node);
+    }
+
     // Helper function to deserialize the AVL tree
-    shared_ptr<AVLNode> deserializeHelper(ifstream& inFile) {
+    shared_ptr<AVLNode> deserializeHelper(ifstream& inFile, bool withCounts) {
         // Read attendance value
-        int attendance;
+        int attendance = -1;
         inFile.read(reinterpret_cast<char*>(&attendance), sizeof(int));
         
-        // Check for null node marker
-        if (attendance == -1) {
+        // Check for null node marker (or a truncated file, reported by the caller)
+        if (!inFile || attendance == -1) {
             return nullptr;
         }
         
@@ -98,7 +142,7 @@ private:
         inFile.read(reinterpret_cast<char*>(&numIds), sizeof(size_t));
         
         // Read student IDs
-        for (size_t i = 0; i < numIds; ++i) {
+        for (size_t i = 0; i < numIds && inFile; ++i) {
             int studentId;
             inFile.read(reinterpret_cast<char*>(&studentId), sizeof(int));
             node->studentIds.push_back(studentId);
@@ -107,9 +151,14 @@ private:
         // Read node height
         inFile.read(reinterpret_cast<char*>(&node->height), sizeof(int));
         
+        // Read subtree student count (version 1 files have none)
+        if (withCounts) {
+            inFile.read(reinterpret_cast<char*>(&node->count), sizeof(int));
+        }
+        
         // Recursively deserialize left and right subtrees
-        node->left = deserializeHelper(inFile);
-        node->right = deserializeHelper(inFile);
+        node->left = deserializeHelper(inFile, withCounts);
+        node->right = deserializeHelper(inFile, withCounts);
         
         return node;
     }
@@ -138,20 +187,73 @@ private:
         // Write node height
         outFile.write(reinterpret_cast<const char*>(&node->height), sizeof(int));
         
+        // Write subtree student count
+        outFile.write(reinterpret_cast<const char*>(&node->count), sizeof(int));
+        
         // Recursively serialize left and right subtrees
         serializeHelper(outFile, node->left);
         serializeHelper(outFile, node->right);
     }
 
-    // Helper function to find and remove a student ID from the tree
-    shared_ptr<AVLNode> removeStudentId(shared_ptr<AVLNode> node, int studentId) {
+    // Rebuild the student ID index from the tree (for files written without one)
+    void buildIndex(const shared_ptr<AVLNode>& node) {
+        if (!node) return;
+        for (const auto& id : node->studentIds) {
+            attendanceOf[id] = node->attendance;
+        }
+        buildIndex(node->left);
+        buildIndex(node->right);
+    }
+
+    // Helper function to read the student ID index stored after the tree
+    bool deserializeIndex(ifstream& inFile) {
+        size_t numEntries;
+        if (!inFile.read(reinterpret_cast<char*>(&numEntries), sizeof(size_t))) {
+            return false;
+        }
+        if (numEntries > bytesLeft(inFile) / sizeof(pair<int, int>)) {
+            return false;
+        }
+        
+        vector<pair<int, int>> entries(numEntries);
+        if (numEntries > 0 &&
+            !inFile.read(reinterpret_cast<char*>(entries.data()), numEntries * sizeof(pair<int, int>))) {
+            return false;
+        }
+        
+        attendanceOf.reserve(numEntries);
+        for (const auto& [id, attendance] : entries) {
+            attendanceOf[id] = attendance;
+        }
+        return true;
+    }
+
+    // Helper function to write the student ID index as an array sorted by ID
+    void serializeIndex(ofstream& outFile) {
+        vector<pair<int, int>> entries(attendanceOf.begin(), attendanceOf.end());
+        sort(entries.begin(), entries.end());
+        
+        size_t numEntries = entries.size();
+        outFile.write(reinterpret_cast<const char*>(&numEntries), sizeof(size_t));
+        if (numEntries > 0) {
+            outFile.write(reinterpret_cast<const char*>(entries.data()), numEntries * sizeof(pair<int, int>));
+        }
+    }
+
+    // Helper function to remove a student ID from the node keyed by its attendance
+    shared_ptr<AVLNode> removeStudentId(shared_ptr<AVLNode> node, int attendance, int studentId) {
         if (!node) return nullptr;
         
-        // Check current node
-        auto it = find(node->studentIds.begin(), node->studentIds.end(), studentId);
-        if (it != node->studentIds.end()) {
-            studentFound = true;
-            node->studentIds.erase(it);
+        if (attendance < node->attendance) {
+            node->left = removeStudentId(node->left, attendance, studentId);
+        } else if (attendance > node->attendance) {
+            node->right = removeStudentId(node->right, attendance, studentId);
+        } else {
+            auto it = find(node->studentIds.begin(), node->studentIds.end(), studentId);
+            if (it != node->studentIds.end()) {
+                node->studentIds.erase(it);
+                node->count--;
+            }
             
             // If this node has no more student IDs, remove it from the tree
             if (node->studentIds.empty()) {
@@ -160,11 +262,7 @@ private:
             return node;
         }
         
-        // Search both subtrees
-        node->left = removeStudentId(node->left, studentId);
-        node->right = removeStudentId(node->right, studentId);
-        
-        // Rebalance the tree if needed
+        // Only nodes on the search path can have changed, rebalance them
         return balanceNode(node);
     }
 
@@ -182,12 +280,19 @@ private:
         node->studentIds = successor->studentIds;
         
         // Delete the successor
-        node->right = removeNode(successor);
+        node->right = removeMin(node->right);
         
         // Update height and balance
         return balanceNode(node);
     }
 
+    // Unlink the node with minimum attendance from a subtree
+    shared_ptr<AVLNode> removeMin(shared_ptr<AVLNode> node) {
+        if (!node->left) return node->right;
+        node->left = removeMin(node->left);
+        return balanceNode(node);
+    }
+
     // Find the node with minimum attendance in a subtree
     shared_ptr<AVLNode> findMin(shared_ptr<AVLNode> node) {
         if (!node) return nullptr;
@@ -248,6 +353,7 @@ private:
             // Check if student ID already exists to avoid duplicates
             if (find(node->studentIds.begin(), node->studentIds.end(), studentId) == node->studentIds.end()) {
                 node->studentIds.push_back(studentId);
+                node->count++;
             }
             return node;
         }
@@ -260,7 +366,7 @@ private:
     }
 
 public:
-    AVLTree() : root(nullptr), studentFound(false) {}
+    AVLTree() : root(nullptr) {}
 
     // Deserialize the AVL tree from a binary file
     bool deserialize(const string& filename) {
@@ -270,7 +376,34 @@ public:
             return false;
         }
 
-        root = deserializeHelper(inFile);
+        // Version 1 files have no header and start with the root's attendance,
+        // which is never the magic
+        uint32_t header[2] = {0, 0};
+        inFile.read(reinterpret_cast<char*>(header), sizeof(header));
+        bool withCounts = inFile && header[0] == MAGIC;
+        if (withCounts && header[1] != VERSION) {
+            cerr << "Unsupported attendance index version " << header[1] << ": " << filename << endl;
+            return false;
+        }
+        if (!withCounts) {
+            inFile.clear();
+            inFile.seekg(0);
+        }
+
+        root = deserializeHelper(inFile, withCounts);
+        if (!inFile) {
+            cerr << "Truncated attendance index: " << filename << endl;
+            return false;
+        }
+        if (!withCounts) {
+            restoreCounts(root);
+        }
+        
+        // Older files carry only the tree, so derive the index from it
+        if (!deserializeIndex(inFile)) {
+            attendanceOf.clear();
+            buildIndex(root);
+        }
         inFile.close();
         
         return true;
@@ -284,7 +417,10 @@ public:
             return false;
         }
 
+        uint32_t header[2] = {MAGIC, VERSION};
+        outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
         serializeHelper(outFile, root);
+        serializeIndex(outFile);
         outFile.close();
         
         return true;
@@ -292,17 +428,54 @@ public:
 
     // Update the attendance for a student ID
     bool updateAttendance(int studentId, int newAttendance) {
-        studentFound = false;
+        auto it = attendanceOf.find(studentId);
+        bool studentFound = it != attendanceOf.end();
         
-        // First, remove the student ID from its current location
-        root = removeStudentId(root, studentId);
+        if (studentFound) {
+            if (it->second == newAttendance) {
+                return true;
+            }
+            
+            // First, remove the student ID from the bucket the index points at
+            root = removeStudentId(root, it->second, studentId);
+        }
         
         // Insert the student ID with the new attendance
         root = insertNode(root, newAttendance, studentId);
+        attendanceOf[studentId] = newAttendance;
         
         return studentFound;
     }
 
+    // Remove a student ID from the tree; returns whether it was there
+    bool removeStudent(int studentId) {
+        auto it = attendanceOf.find(studentId);
+        if (it == attendanceOf.end()) {
+            return false;
+        }
+        
+        root = removeStudentId(root, it->second, studentId);
+        attendanceOf.erase(it);
+        return true;
+    }
+
+    // Collect (attendance, student ID) pairs in ascending attendance order
+    void collectEntries(const shared_ptr<AVLNode>& node, vector<pair<int, int>>& entries) {
+        if (!node) return;
+        collectEntries(node->left, entries);
+        for (const auto& id : node->studentIds) {
+            entries.push_back({node->attendance, id});
+        }
+        collectEntries(node->right, entries);
+    }
+
+    // (attendance, student ID) pairs in ascending attendance order, for the read snapshot
+    vector<pair<int, int>> getEntries() {
+        vector<pair<int, int>> entries;
+        collectEntries(root, entries);
+        return entries;
+    }
+
     // Print the AVL tree (in-order traversal) - for debugging purposes
     void printInOrder(const shared_ptr<AVLNode>& node) {
         if (!node) return;
@@ -327,9 +500,231 @@ public:
     }
 };
 
+#ifdef ATTENDANCE_HISTOGRAM
+#include "attendance_histogram.h"
+using AttendanceIndex = AttendanceHistogram;
+#else
+using AttendanceIndex = AVLTree;
+#endif
+
+#include "attendance_snapshot.h"
+#include "write_ahead_log.h"
+#include "metrics.h"
+
+metrics::Phase parsePhase("parse");
+metrics::Phase loadPhase("load");
+metrics::Phase computePhase("compute");
+metrics::Phase serializePhase("serialize");
+metrics::Phase outputPhase("output");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter bytesWritten("bytes_written");
+
+// Write the index to a temporary file and rename it over the .dat, so a crash
+// mid-write leaves the previous file intact and readers never see a partial one.
+// The read snapshot is republished afterwards so threshold sees the update.
+// Callers hold the subject's writer lock (see writerLockFilename).
+bool saveAtomically(AttendanceIndex& index, const string& datFilename) {
+    metrics::ScopedTimer serializeTimer(serializePhase);
+    const string tmpFilename = datFilename + ".tmp";
+    if (!index.serialize(tmpFilename)) {
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    if (!replaceFile(tmpFilename, datFilename)) {
+        cerr << "Error replacing " << datFilename << endl;
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    bytesWritten.addFileSize(datFilename);
+    if (!writeSnapshot(snapshotFilename(datFilename), index.getEntries())) {
+        return false;
+    }
+    bytesWritten.addFileSize(snapshotFilename(datFilename));
+    return true;
+}
+
+// Deserialize an index, timed as the load phase
+bool loadIndex(AttendanceIndex& index, const string& datFilename) {
+    metrics::ScopedTimer loadTimer(loadPhase);
+    if (!index.deserialize(datFilename)) {
+        return false;
+    }
+    bytesRead.addFileSize(datFilename);
+    return true;
+}
+
+// Writers of a subject index (update_avl, create_avl) take an exclusive lock on
+// <subject>.dat.lock from load to rename, so concurrent updates never lose each
+// other's changes. Readers such as threshold take no lock: they open whichever
+// complete version the last rename published.
+string writerLockFilename(const string& datFilename) {
+    return datFilename + ".lock";
+}
+
+// A single (subject, student_id, new_attendance) record read in batch mode
+struct UpdateRecord {
+    string subject;
+    int studentId;
+    int newAttendance;
+    string status;  // Per-record status line printed once the batch is applied
+};
+
+// Subject names become file names, so only accept plain identifiers
+bool isValidSubject(const string& subject) {
+    if (subject.empty()) return false;
+    for (char c : subject) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+    }
+    return true;
+}
+
+// Read records from stdin, group them by subject file and apply each group
+// with one load and one save, then print one status line per record
+int runBatch(const string& serializedDir) {
+    vector<UpdateRecord> records;
+    vector<string> subjectOrder;
+    unordered_map<string, vector<size_t>> recordsBySubject;
+    
+    metrics::ScopedTimer parseTimer(parsePhase);
+    string line;
+    while (getline(cin, line)) {
+        if (line.empty()) continue;
+        
+        UpdateRecord record;
+        istringstream fields(line);
+        if (!(fields >> record.subject >> record.studentId >> record.newAttendance) ||
+            !isValidSubject(record.subject)) {
+            record.status = "ERR invalid record: " + line;
+        } else if (record.newAttendance < 0 || record.newAttendance > MAX_ATTENDANCE) {
+            record.status = "ERR " + record.subject + " " + to_string(record.studentId) +
+                            " attendance should be between 0 and " + to_string(MAX_ATTENDANCE);
+        } else {
+            if (recordsBySubject.find(record.subject) == recordsBySubject.end()) {
+                subjectOrder.push_back(record.subject);
+            }
+            recordsBySubject[record.subject].push_back(records.size());
+        }
+        records.push_back(record);
+    }
+    parseTimer.stop();
+    
+    for (const auto& subject : subjectOrder) {
+        const string datFilename = serializedDir + "/" + subject + ".dat";
+        const auto& indices = recordsBySubject[subject];
+        AttendanceIndex avlTree;
+        
+        FileLock lock(writerLockFilename(datFilename), true);
+        if (!lock.isLocked()) {
+            for (size_t i : indices) {
+                records[i].status = "ERR " + subject + " " + to_string(records[i].studentId) +
+                                    " failed to lock " + datFilename;
+            }
+            continue;
+        }
+        
+        ifstream fileCheck(datFilename);
+        bool fileExists = fileCheck.good();
+        fileCheck.close();
+        
+        if (fileExists && !loadIndex(avlTree, datFilename)) {
+            for (size_t i : indices) {
+                records[i].status = "ERR " + subject + " " + to_string(records[i].studentId) +
+                                    " failed to load " + datFilename;
+            }
+            continue;
+        }
+        
+        {
+            metrics::ScopedTimer computeTimer(computePhase);
+            for (size_t i : indices) {
+                bool studentUpdated = avlTree.updateAttendance(records[i].studentId, records[i].newAttendance);
+                records[i].status = string(studentUpdated ? "OK " : "NEW ") + subject + " " +
+                                    to_string(records[i].studentId) + " " + to_string(records[i].newAttendance);
+            }
+        }
+        
+        if (!saveAtomically(avlTree, datFilename)) {
+            for (size_t i : indices) {
+                records[i].status = "ERR " + subject + " " + to_string(records[i].studentId) +
+                                    " failed to write " + datFilename;
+            }
+        }
+    }
+    
+    metrics::ScopedTimer outputTimer(outputPhase);
+    bool allApplied = true;
+    for (const auto& record : records) {
+        cout << record.status << '\n';
+        if (record.status.compare(0, 4, "ERR ") == 0) {
+            allApplied = false;
+        }
+    }
+    
+    return allApplied ? 0 : 1;
+}
+
+// Drop a student from every subject index in the directory (every .dat but
+// the name trie), each under its writer lock, and print one line per subject
+int runDelete(const string& serializedDir, int studentId) {
+    vector<string> datFilenames;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(serializedDir, ec)) {
+        if (entry.path().extension() == ".dat" && entry.path().filename() != "name.dat") {
+            datFilenames.push_back(entry.path().string());
+        }
+    }
+    if (ec) {
+        cerr << "Cannot read " << serializedDir << endl;
+        return 1;
+    }
+    sort(datFilenames.begin(), datFilenames.end());
+    
+    bool allApplied = true;
+    for (const auto& datFilename : datFilenames) {
+        const string subject = filesystem::path(datFilename).stem().string();
+        AttendanceIndex avlTree;
+        
+        FileLock lock(writerLockFilename(datFilename), true);
+        if (!lock.isLocked() || !loadIndex(avlTree, datFilename)) {
+            cout << "ERR " << subject << " " << studentId << " failed to load " << datFilename << endl;
+            allApplied = false;
+            continue;
+        }
+        
+        metrics::ScopedTimer computeTimer(computePhase);
+        bool removed = avlTree.removeStudent(studentId);
+        computeTimer.stop();
+        if (!removed) {
+            cout << "MISSING " << subject << " " << studentId << endl;
+        } else if (saveAtomically(avlTree, datFilename)) {
+            cout << "DELETED " << subject << " " << studentId << endl;
+        } else {
+            cout << "ERR " << subject << " " << studentId << " failed to write " << datFilename << endl;
+            allApplied = false;
+        }
+    }
+    
+    return allApplied ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
+    metrics::Report report(argv[0]);
+    if (argc == 3 && string(argv[1]) == "--batch") {
+        return runBatch(argv[2]);
+    }
+    if (argc == 4 && string(argv[1]) == "--delete") {
+        try {
+            return runDelete(argv[2], stoi(argv[3]));
+        } catch (const exception& e) {
+            cerr << "Error parsing arguments: " << e.what() << endl;
+            return 1;
+        }
+    }
+
     if (argc != 4) {
         cerr << "Usage: " << argv[0] << " <dat_file_name> <new_attendance> <student_id>" << endl;
+        cerr << "       " << argv[0] << " --batch <serialized_dir>  (reads '<subject> <student_id> <new_attendance>' lines from stdin)" << endl;
+        cerr << "       " << argv[0] << " --delete <serialized_dir> <student_id>  (removes the student from every subject)" << endl;
         return 1;
     }
 
@@ -340,8 +735,8 @@ int main(int argc, char* argv[]) {
         newAttendance = stoi(argv[2]);
         studentId = stoi(argv[3]);
         
-        if (newAttendance < 0 || newAttendance > 100) {
-            cerr << "Attendance should be between 0 and 100" << endl;
+        if (newAttendance < 0 || newAttendance > MAX_ATTENDANCE) {
+            cerr << "Attendance should be between 0 and " << MAX_ATTENDANCE << endl;
             return 1;
         }
     } catch (const exception& e) {
@@ -349,7 +744,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    AVLTree avlTree;
+    AttendanceIndex avlTree;
+    
+    FileLock lock(writerLockFilename(datFilename), true);
+    if (!lock.isLocked()) {
+        cerr << "Failed to lock " << writerLockFilename(datFilename) << endl;
+        return 1;
+    }
     
     // Check if the file exists
     ifstream fileCheck(datFilename);
@@ -358,13 +759,15 @@ int main(int argc, char* argv[]) {
     
     if (fileExists) {
         // Deserialize the AVL tree
-        if (!avlTree.deserialize(datFilename)) {
+        if (!loadIndex(avlTree, datFilename)) {
             cerr << "Failed to deserialize the AVL tree from " << datFilename << endl;
             return 1;
         }
         
         // Update the attendance for the student ID
+        metrics::ScopedTimer computeTimer(computePhase);
         bool studentUpdated = avlTree.updateAttendance(studentId, newAttendance);
+        computeTimer.stop();
         
         if (studentUpdated) {
             cout << "Updated attendance for student ID " << studentId << " to " << newAttendance << endl;
@@ -374,12 +777,14 @@ int main(int argc, char* argv[]) {
     } else {
         // File doesn't exist, create a new tree and insert the student
         cout << "File not found. Creating new AVL tree." << endl;
+        metrics::ScopedTimer computeTimer(computePhase);
         avlTree.updateAttendance(studentId, newAttendance);
+        computeTimer.stop();
         cout << "Inserted student ID " << studentId << " with attendance " << newAttendance << endl;
     }
     
     // Serialize the updated AVL tree
-    if (avlTree.serialize(datFilename)) {
+    if (saveAtomically(avlTree, datFilename)) {
         cout << "AVL tree successfully serialized to " << datFilename << endl;
     } else {
         cerr << "Failed to serialize the updated AVL tree" << endl;
@@ -387,7 +792,7 @@ int main(int argc, char* argv[]) {
     }
     
     // Uncomment for debugging
-    avlTree.printTree();
+    // avlTree.printTree();
     
     return 0;
 }
\ No newline at end of file
@@ -4,54 +4,64 @@
 #include <vector>
 #include <cmath>
 #include <string>
-#include <unordered_map>
 #include <limits>
 
+#include "face_gallery.h"
+#include "metrics.h"
+
 using namespace std;
 
-float smallestDistance = numeric_limits<float>::max(); 
+metrics::Phase parsePhase("parse");
+metrics::Phase computePhase("compute");
+metrics::Phase outputPhase("output");
+metrics::Counter rowsScanned("rows_scanned");
+metrics::Counter bytesRead("bytes_read");
+metrics::Counter dimensionsEvaluated("dimensions_evaluated");  // Over rows_scanned: the average per row
 
-// Euclidean distance
-double calculateDistance(const vector<double>& v1, const vector<double>& v2) {
-    double sum = 0.0;
-    for (size_t i = 0; i < v1.size(); ++i){
-        double diff = v1[i] - v2[i];
-        sum += diff * diff;
-    }
-    return sqrt(sum);
+// Squared distance kernel for the probe's dimension, picked in main
+BoundedMinDistanceKernel distanceKernel = boundedMinDistanceKernel(0);
+
+// Squared Euclidean distance, abandoned once the partial sum passes bound
+// (the result is then above bound); dimensions counts the elements summed
+double calculateDistance(const vector<double>& v1, const vector<double>& v2, double bound, size_t& dimensions) {
+    return distanceKernel(v1.data(), v2.data(), 1, v1.size(), bound, &dimensions);
 }
 
-// Hashmap
-unordered_map<double, string> computeDistances(const vector<double>& inputVector, const vector<vector<double>>& faceVectors, const vector<string>& studentIds) {
-    unordered_map<double, string> distancesMap;
-    int i = 0;
-    float n;
-    for (const auto& vec : faceVectors) {
-        if (vec.size() != inputVector.size()) {
-            distancesMap.insert({-1, "Error"}); 
-        } else {
-            n = calculateDistance(inputVector, vec);
-            if (n < smallestDistance) {
-                smallestDistance = n;
-            }
-            distancesMap.insert({n, studentIds[i]});
+// Row of the nearest face vector closer than maxDistance, or -1. A row is
+// abandoned once its partial distance passes the nearest row so far or
+// maxDistance, so only rows that cannot win are cut short; on a tie the
+// first row wins, as in a full scan.
+long nearestRow(const vector<double>& inputVector, const vector<vector<double>>& faceVectors, double maxDistance,
+                size_t& dimensions) {
+    const double limit = squaredLimit(maxDistance);
+    double smallest = numeric_limits<double>::max();
+    long match = -1;
+    for (size_t i = 0; i < faceVectors.size(); ++i) {
+        if (faceVectors[i].size() != inputVector.size()) continue;
+        double d = calculateDistance(inputVector, faceVectors[i], min(smallest, limit), dimensions);
+        if (d < smallest && d <= limit) {
+            smallest = d;
+            match = static_cast<long>(i);
         }
-        i++;
     }
-    return distancesMap;
+    return sqrt(smallest) < maxDistance ? match : -1;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 129) {
-        cerr << "Usage: " << argv[0] << " <128 double values>\n";
+    metrics::Report report(argv[0]);
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <v1> ... <vN>\n";
+        cerr << "  One value per dimension of the face descriptors in students.csv (128 for dlib)\n";
         return 1;
     }
 
+    metrics::ScopedTimer parseTimer(parsePhase);
     ifstream file("executable/data/students.csv");
     if (!file.is_open()) {
         cerr << "Could not open students.csv file.\n";
         return 1;
     }
+    bytesRead.addFileSize("executable/data/students.csv");
 
     string line;
     vector<string> studentIds;
@@ -59,7 +69,10 @@ int main(int argc, char* argv[]) {
 
     getline(file, line); 
 
-    while (getline(file, line)) {
+    // Rows of removed students stay in the file until it is compacted
+    GalleryTombstones tombstones = loadTombstones("executable/data/students.csv");
+    for (size_t row = 0; getline(file, line); ++row) {
+        if (!tombstones.empty() && isTombstoned(tombstones, row, rowStudentId(line))) continue;
         stringstream ss(line);
         string name, rn, student_id, vector_str;
         
@@ -85,7 +98,7 @@ int main(int argc, char* argv[]) {
     file.close();
 
     vector<double> inputVector;
-    for (int i = 1; i <= 128; ++i) {
+    for (int i = 1; i < argc; ++i) {
         try {
             inputVector.push_back(stod(argv[i]));
         } catch (invalid_argument& e) {
@@ -93,13 +106,22 @@ int main(int argc, char* argv[]) {
             return 1;
         }
     }
-
-    // distance function
-    unordered_map<double, string> distances = computeDistances(inputVector, faceVectors, studentIds);
+    distanceKernel = boundedMinDistanceKernel(inputVector.size());
+    parseTimer.stop();
+
+    long match;
+    {
+        metrics::ScopedTimer computeTimer(computePhase);
+        size_t dimensions = 0;
+        match = nearestRow(inputVector, faceVectors, MATCH_DISTANCE, dimensions);
+        rowsScanned.add(faceVectors.size());
+        dimensionsEvaluated.add(dimensions);
+    }
 
     // Print results
-    if(smallestDistance < 0.6){
-        cout << distances[smallestDistance];
+    metrics::ScopedTimer outputTimer(outputPhase);
+    if (match >= 0) {
+        cout << studentIds[static_cast<size_t>(match)];
     }
     else{
         cout << "-1";
@@ -0,0 +1,443 @@
+// Append-only write-ahead log with checksummed records and group commit.
+//
+// File layout:
+//   header:  char magic[4] = "AWAL", uint64 generation
+//   records: uint32 payloadLength, uint32 crc32(payload), payload bytes
+//
+// The generation ties a log to the snapshot it extends: a snapshot written
+// with generation g expects the log to have generation g, and a log with an
+// older generation only holds records the snapshot already contains.
+// A record whose length or checksum does not match marks the end of the log
+// (a torn write from a crash); it and anything after it are discarded.
+//
+// Group commit: append() only buffers, flush() writes every buffered record
+// with one write, and sync() makes the log durable with one fsync. sync()
+// records the durable end offset in <log>.sync, so when several processes
+// or threads flush concurrently only the first one to take the sync lock
+// pays for the fsync and the others find their records already covered.
+// syncThrough() does the same from the log's name and the end offset a
+// writer captured under its lock, so the writer can release that lock
+// before waiting for the fsync.
+
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace wal_detail {
+
+#ifdef _WIN32
+inline int openFile(const string& path, bool create) {
+    return _open(path.c_str(), _O_RDWR | _O_BINARY | (create ? _O_CREAT : 0), _S_IREAD | _S_IWRITE);
+}
+inline int openReadOnly(const string& path) { return _open(path.c_str(), _O_RDONLY | _O_BINARY); }
+inline int closeFile(int fd) { return _close(fd); }
+inline long long readAt(int fd, char* buffer, size_t size, long long offset) {
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+    return _read(fd, buffer, static_cast<unsigned>(size));
+}
+inline long long writeAt(int fd, const char* buffer, size_t size, long long offset) {
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+    return _write(fd, buffer, static_cast<unsigned>(size));
+}
+inline int syncFd(int fd) { return _commit(fd); }
+inline int truncateFd(int fd, long long size) { return _chsize_s(fd, size); }
+inline long long fileSize(int fd) { return _filelengthi64(fd); }
+inline bool lockFd(int fd, bool exclusive, bool wait) {
+    OVERLAPPED overlapped = {};
+    return LockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(fd)),
+                      (exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0) | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY), 0, 1, 0,
+                      &overlapped) != 0;
+}
+#else
+inline int openFile(const string& path, bool create) {
+    return open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+}
+inline int openReadOnly(const string& path) { return open(path.c_str(), O_RDONLY); }
+inline int closeFile(int fd) { return close(fd); }
+inline long long readAt(int fd, char* buffer, size_t size, long long offset) {
+    return pread(fd, buffer, size, offset);
+}
+inline long long writeAt(int fd, const char* buffer, size_t size, long long offset) {
+    return pwrite(fd, buffer, size, offset);
+}
+inline int syncFd(int fd) { return fsync(fd); }
+inline int truncateFd(int fd, long long size) { return ftruncate(fd, size); }
+inline long long fileSize(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+}
+inline bool lockFd(int fd, bool exclusive, bool wait) {
+    return flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB)) == 0;
+}
+#endif
+
+// Write a whole buffer at an offset, retrying short writes
+inline bool writeAll(int fd, const char* buffer, size_t size, long long offset) {
+    while (size > 0) {
+        long long written = writeAt(fd, buffer, size, offset);
+        if (written <= 0) return false;
+        buffer += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+    return true;
+}
+
+// Read the bytes of a file in [from, to) into memory
+inline bool readRange(int fd, long long from, long long to, string& contents) {
+    contents.assign(static_cast<size_t>(to - from), '\0');
+    long long offset = 0;
+    while (offset < to - from) {
+        long long got = readAt(fd, &contents[offset], static_cast<size_t>(to - from - offset), from + offset);
+        if (got <= 0) return false;
+        offset += got;
+    }
+    return true;
+}
+
+// Read a whole file into memory
+inline bool readAll(int fd, string& contents) {
+    long long size = fileSize(fd);
+    return size >= 0 && readRange(fd, 0, size, contents);
+}
+
+struct Crc32Table {
+    uint32_t entries[256];
+
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+// Standard CRC-32 (IEEE 802.3), table driven. Passing the CRC of the bytes
+// before as previous continues it over data, as if both were one buffer.
+inline uint32_t crc32(const char* data, size_t size, uint32_t previous = 0) {
+    static const Crc32Table table;  // Initialized once, even with several threads
+    uint32_t crc = previous ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+} // namespace wal_detail
+
+// Advisory lock on a file, shared or exclusive, released when the object goes
+// away. With wait false the lock is only tried: isLocked() is false if another
+// holder has it.
+class FileLock {
+private:
+    int fd;
+    bool locked;
+
+public:
+    FileLock(const string& lockFilename, bool exclusive, bool wait = true) : fd(-1), locked(false) {
+        fd = wal_detail::openFile(lockFilename, true);
+        if (fd >= 0) {
+            locked = wal_detail::lockFd(fd, exclusive, wait);
+        }
+    }
+
+    ~FileLock() {
+        if (fd >= 0) wal_detail::closeFile(fd);
+    }
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    bool isLocked() const {
+        return locked;
+    }
+};
+
+// Flush a closed file's contents to stable storage (used before renaming a snapshot)
+inline bool syncFile(const string& filename) {
+    int fd = wal_detail::openFile(filename, false);
+    if (fd < 0) return false;
+    bool ok = wal_detail::syncFd(fd) == 0;
+    wal_detail::closeFile(fd);
+    return ok;
+}
+
+// Atomically replace target with source (rename() refuses to overwrite on Windows).
+// A reader that already opened or mapped target keeps reading the old file.
+inline bool replaceFile(const string& source, const string& target) {
+#ifdef _WIN32
+    return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(source.c_str(), target.c_str()) == 0;
+#endif
+}
+
+// Identity of a file's current contents. A long-lived reader keeps the stamp
+// of the version it loaded and compares it with a fresh one, without taking
+// any lock, to learn that a writer has replaced, extended or truncated it.
+struct FileStamp {
+    unsigned long long inode = 0;
+    long long size = -1;
+    long long modified = 0;  // Nanoseconds where the platform has them
+
+    bool operator==(const FileStamp& other) const {
+        return inode == other.inode && size == other.size && modified == other.modified;
+    }
+    bool operator!=(const FileStamp& other) const {
+        return !(*this == other);
+    }
+};
+
+// Stamp of a file; a missing file has size -1
+inline FileStamp fileStamp(const string& filename) {
+    FileStamp stamp;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(filename.c_str(), &st) != 0) return stamp;
+    stamp.size = static_cast<long long>(st.st_size);
+    stamp.modified = static_cast<long long>(st.st_mtime);
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return stamp;
+    stamp.inode = static_cast<unsigned long long>(st.st_ino);
+    stamp.size = static_cast<long long>(st.st_size);
+#if defined(__APPLE__)
+    stamp.modified = static_cast<long long>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    stamp.modified = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return stamp;
+}
+
+// Make a rename inside a directory durable (no-op on Windows)
+inline void syncParentDirectory(const string& filename) {
+#ifndef _WIN32
+    size_t slash = filename.find_last_of('/');
+    string dir = slash == string::npos ? "." : filename.substr(0, slash == 0 ? 1 : slash);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#else
+    (void)filename;
+#endif
+}
+
+class WriteAheadLog {
+private:
+    static constexpr char MAGIC[4] = {'A', 'W', 'A', 'L'};
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint64_t);
+    static constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+    static constexpr uint32_t MAX_RECORD_SIZE = 1 << 20;
+
+    string filename;
+    int fd;
+    uint64_t generation;
+    long long validEnd;   // End offset of the last intact record
+    string pending;       // Records appended but not yet written
+
+    bool writeHeader(uint64_t newGeneration) {
+        char header[HEADER_SIZE];
+        memcpy(header, MAGIC, sizeof(MAGIC));
+        memcpy(header + sizeof(MAGIC), &newGeneration, sizeof(uint64_t));
+        if (wal_detail::truncateFd(fd, 0) != 0 ||
+            !wal_detail::writeAll(fd, header, HEADER_SIZE, 0) ||
+            wal_detail::syncFd(fd) != 0) {
+            return false;
+        }
+        generation = newGeneration;
+        validEnd = HEADER_SIZE;
+        return limitDurable(filename, generation, validEnd);
+    }
+
+    // Record in <log>.sync that the log now ends at end, after it was cut back
+    // or restarted: a durable end past it (or from another generation, such as
+    // one left over from a deleted log) would otherwise cover the records
+    // written there next without an fsync
+    static bool limitDurable(const string& logFilename, uint64_t logGeneration, long long end) {
+        FileLock syncLock(logFilename + ".sync", true);
+        if (!syncLock.isLocked()) return false;
+        int syncFd = wal_detail::openFile(logFilename + ".sync", true);
+        if (syncFd < 0) return false;
+
+        uint64_t durable[2] = {0, 0};
+        wal_detail::readAt(syncFd, reinterpret_cast<char*>(durable), sizeof(durable), 0);
+        bool ok = true;
+        if (durable[0] != logGeneration || static_cast<long long>(durable[1]) > end) {
+            durable[1] = static_cast<uint64_t>(durable[0] == logGeneration ? end : static_cast<long long>(HEADER_SIZE));
+            durable[0] = logGeneration;
+            ok = wal_detail::writeAll(syncFd, reinterpret_cast<const char*>(durable), sizeof(durable), 0);
+        }
+        wal_detail::closeFile(syncFd);
+        return ok;
+    }
+
+public:
+    explicit WriteAheadLog(const string& logFilename)
+        : filename(logFilename), fd(-1), generation(0), validEnd(0) {}
+
+    ~WriteAheadLog() {
+        if (fd >= 0) wal_detail::closeFile(fd);
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Open the log and collect the payloads of every intact record, provided the
+    // log belongs to snapshotGeneration. A writable open creates a missing log,
+    // drops a torn tail, and restarts a log left over from an older generation.
+    bool open(uint64_t snapshotGeneration, vector<string>& records, bool writable) {
+        records.clear();
+        fd = writable ? wal_detail::openFile(filename, true) : wal_detail::openReadOnly(filename);
+        if (fd < 0) {
+            // A reader with no log simply has nothing to replay
+            return !writable;
+        }
+
+        string contents;
+        if (!wal_detail::readAll(fd, contents)) {
+            return false;
+        }
+
+        if (contents.size() < HEADER_SIZE || memcmp(contents.data(), MAGIC, sizeof(MAGIC)) != 0) {
+            return writable ? writeHeader(snapshotGeneration) : true;
+        }
+        memcpy(&generation, contents.data() + sizeof(MAGIC), sizeof(uint64_t));
+        if (generation != snapshotGeneration) {
+            // Older log: its records are already part of the snapshot
+            return writable ? writeHeader(snapshotGeneration) : true;
+        }
+
+        size_t offset = HEADER_SIZE;
+        while (offset + RECORD_HEADER_SIZE <= contents.size()) {
+            uint32_t length, checksum;
+            memcpy(&length, contents.data() + offset, sizeof(uint32_t));
+            memcpy(&checksum, contents.data() + offset + sizeof(uint32_t), sizeof(uint32_t));
+            if (length > MAX_RECORD_SIZE || offset + RECORD_HEADER_SIZE + length > contents.size()) break;
+
+            const char* payload = contents.data() + offset + RECORD_HEADER_SIZE;
+            if (wal_detail::crc32(payload, length) != checksum) break;
+
+            records.emplace_back(payload, length);
+            offset += RECORD_HEADER_SIZE + length;
+        }
+        validEnd = static_cast<long long>(offset);
+
+        if (writable && validEnd < static_cast<long long>(contents.size())) {
+            return wal_detail::truncateFd(fd, validEnd) == 0 && limitDurable(filename, generation, validEnd);
+        }
+        return true;
+    }
+
+    uint64_t getGeneration() const {
+        return generation;
+    }
+
+    // Bytes of intact log, header included
+    long long size() const {
+        return validEnd + static_cast<long long>(pending.size());
+    }
+
+    // Buffer one record; nothing reaches the file until flush()
+    void append(const string& payload) {
+        uint32_t length = static_cast<uint32_t>(payload.size());
+        uint32_t checksum = wal_detail::crc32(payload.data(), payload.size());
+        pending.append(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+        pending.append(reinterpret_cast<const char*>(&checksum), sizeof(uint32_t));
+        pending.append(payload);
+    }
+
+    // Write every buffered record with a single write
+    bool flush() {
+        if (pending.empty()) return true;
+        if (!wal_detail::writeAll(fd, pending.data(), pending.size(), validEnd)) {
+            return false;
+        }
+        validEnd += static_cast<long long>(pending.size());
+        pending.clear();
+        return true;
+    }
+
+    // Make the log durable up to the current end. Callers should release their
+    // write lock first so concurrent writers can share one fsync.
+    bool sync() {
+        return syncThrough(filename, generation, validEnd, fd);
+    }
+
+    // Make the log named logFilename durable up to end, an offset of the given
+    // generation that a writer read with getGeneration() and size() after its
+    // flush. Needs no WriteAheadLog object, so the writer may have released its
+    // lock, and another writer may have moved the log on, in the meantime: any
+    // fsync of the file covers the records, and a checkpoint that restarted the
+    // log made them durable in the snapshot first. logFd, if open, is used
+    // instead of opening the log again. Truncating or restarting the log
+    // lowers the recorded end first (limitDurable), so it never covers
+    // records written after that.
+    static bool syncThrough(const string& logFilename, uint64_t logGeneration, long long end, int logFd = -1) {
+        FileLock syncLock(logFilename + ".sync", true);
+        if (!syncLock.isLocked()) return false;
+
+        // <log>.sync holds (generation, durable end offset) of the last fsync
+        const string syncFilename = logFilename + ".sync";
+        int syncFd = wal_detail::openFile(syncFilename, true);
+        if (syncFd < 0) return false;
+
+        uint64_t durable[2] = {0, 0};
+        wal_detail::readAt(syncFd, reinterpret_cast<char*>(durable), sizeof(durable), 0);
+        bool covered = durable[0] == logGeneration && static_cast<long long>(durable[1]) >= end;
+
+        bool ok = true;
+        if (!covered) {
+            int fd = logFd >= 0 ? logFd : wal_detail::openFile(logFilename, false);
+            ok = fd >= 0;
+            if (ok) {
+                // Everything written to the log so far becomes durable with this fsync
+                long long written = wal_detail::fileSize(fd);
+                ok = wal_detail::syncFd(fd) == 0;
+                if (logFd < 0) wal_detail::closeFile(fd);
+                if (ok && durable[0] <= logGeneration) {
+                    durable[0] = logGeneration;
+                    durable[1] = static_cast<uint64_t>(written > end ? written : end);
+                    ok = wal_detail::writeAll(syncFd, reinterpret_cast<const char*>(durable), sizeof(durable), 0);
+                }
+            }
+        }
+        wal_detail::closeFile(syncFd);
+        return ok;
+    }
+
+    // Start an empty log for a new generation (after a snapshot has been made durable)
+    bool reset(uint64_t newGeneration) {
+        pending.clear();
+        if (fd >= 0) wal_detail::closeFile(fd);  // May have been opened read-only
+        fd = wal_detail::openFile(filename, true);
+        if (fd < 0) return false;
+        return writeHeader(newGeneration);
+    }
+};
+
+#endif // WRITE_AHEAD_LOG_H
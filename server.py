@@ -1,53 +1,84 @@
-from flask import Flask, request, jsonify
+from flask import Flask, request, jsonify, Response
 import pandas as pd
 import numpy as np
 import cv2
 import dlib
 import os
 import subprocess
+import io
 from flask_cors import CORS
+from attendance_lib import AttendanceLib, AttendanceError
+
+def drop_removed_students(df, students_csv):
+    """Leave out the rows removed students keep in students.csv until it is
+    compacted: <students.csv>.deleted lists them as 'row,student_id' lines
+    (see executable/cpp/face_gallery.h)"""
+    rows = []
+    try:
+        with open(students_csv + '.deleted') as tombstones:
+            for line in tombstones:
+                fields = line.strip().split(',')
+                if len(fields) != 2 or not fields[0].isdigit():
+                    continue
+                row = int(fields[0])
+                if row < len(df) and str(df.iloc[row]['student_id']) == fields[1]:
+                    rows.append(df.index[row])
+    except FileNotFoundError:
+        pass
+    return df.drop(index=rows)
 
 # Load data
-students_df = pd.read_csv('executable/data/students.csv')
+students_df = drop_removed_students(pd.read_csv('executable/data/students.csv'), 'executable/data/students.csv')
 attendance_df = pd.read_csv('executable/data/attendance.csv')
 
 # Ensure the executable path
-executable_path = './executable/create_avl'  # Path to your compiled C++ executable
+store_executable = './executable/attendance_store'  # Path to your compiled C++ executable
 output_folder = 'executable/serialized/'
+store_file = os.path.join(output_folder, 'attendance.store')
+events_dir = os.path.join(output_folder, 'events')
+avl_executable = './executable/create_avl'
+update_avl_executable = './executable/update_avl'
 trie_executable = './executable/create_trie'
-vector_distance = './executable/distance'
+
+# Subjects attendance is marked in; total_attendance only moves with them
+subjects = ['maths', 'english', 'chemistry', 'physics', 'datastructure']
 
 # Ensure the output folder exists
 os.makedirs(output_folder, exist_ok=True)
 
-# Function to create AVL tree for each subject
-def create_avl_tree_for_subject(subject):
-    # Drop NaN values for the subject
-    subject_data = attendance_df[['student_id', subject]].dropna()
-
-    # Path to save the .dat file
-    serialized_filename = os.path.join(output_folder, f"{subject}.dat")
-
-    # Command to run the executable with the .dat path as argument
-    command = [executable_path, serialized_filename]
-
-    # Prepare input string: "attendance student_id"
-    input_lines = [f"{row[subject]} {row['student_id']}\n" for _, row in subject_data.iterrows()]
-    input_str = ''.join(input_lines)
-
-    try:
-        # Run the executable and feed the input string via stdin
-        result = subprocess.run(command, input=input_str.encode(), check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-        print(f"[✓] AVL tree for '{subject}' saved as '{serialized_filename}'")
-    except subprocess.CalledProcessError as e:
-        print(f"[✗] Error creating AVL for '{subject}': {e.stderr.decode()}")
-    except Exception as e:
-        print(f"[✗] Unexpected error: {str(e)}")
+# The attendance store is the source of truth for attendance counters. Build it from
+# attendance.csv on first start; afterwards refresh the in-memory table (and the CSV
+# export) from the store, since marks no longer rewrite the CSV.
+try:
+    if not os.path.exists(store_file):
+        subprocess.run([store_executable, 'build', 'executable/data/attendance.csv', store_file],
+                       check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        print(f"[✓] Attendance store saved as '{store_file}'")
+    else:
+        result = subprocess.run([store_executable, 'export', store_file],
+                                check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        store_df = pd.read_csv(io.StringIO(result.stdout))
+        attendance_df = attendance_df[['student_id', 'name']].merge(store_df, on='student_id', how='inner')
+        attendance_df.to_csv('executable/data/attendance.csv', mode='w', index=False)
+        print(f"[✓] Attendance loaded from '{store_file}'")
+except subprocess.CalledProcessError as e:
+    print(f"[✗] Error preparing attendance store: {e.stderr}")
+except Exception as e:
+    print(f"[✗] Unexpected error: {str(e)}")
 
-# Iterate over the subjects and create AVL trees
-subjects = ['maths', 'english', 'chemistry', 'physics', 'datastructure', 'total_attendance']
-for subject in subjects:
-    create_avl_tree_for_subject(subject)
+# Export every per-subject index (.dat and .snap, read by the threshold tool) from
+# the CSV just refreshed from the store, in one process; create_avl scans the file
+# itself and builds subjects in parallel. They are a startup export: marks only go
+# to the store (which /threshold_attendance queries), so the files fall behind it
+# until the next restart.
+try:
+    subprocess.run([avl_executable, '--csv', 'executable/data/attendance.csv', output_folder],
+                   check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    print(f"[✓] Subject indexes saved in '{output_folder}'")
+except subprocess.CalledProcessError as e:
+    print(f"[✗] Error building subject indexes: {e.stderr}")
+except Exception as e:
+    print(f"[✗] Unexpected error building subject indexes: {str(e)}")
 
 # Now call the create_trie executable
 try:
@@ -58,6 +89,15 @@ except subprocess.CalledProcessError as e:
 except Exception as e:
     print(f"[✗] Unexpected error running create_trie: {str(e)}")
 
+# Open the matcher, the name trie, the attendance store and the event log once;
+# requests call into libattendance in-process instead of spawning a tool each
+attendance_lib = AttendanceLib('./executable')
+matcher = attendance_lib.open_matcher('executable/data/students.csv')
+name_trie = attendance_lib.open_trie(os.path.join(output_folder, 'name.dat'))
+store = attendance_lib.open_store(store_file)
+events = attendance_lib.open_events(events_dir)
+print("[✓] Attendance library loaded")
+
 app = Flask(__name__)
 CORS(app)
 
@@ -66,8 +106,8 @@ detector = dlib.get_frontal_face_detector()
 sp = dlib.shape_predictor("dat/shape_predictor_68_face_landmarks.dat")
 face_rec_model = dlib.face_recognition_model_v1("dat/dlib_face_recognition_resnet_model_v1.dat")
 
-def capture_face_vector():
-    """Capture an image from webcam and return the average face encoding vector after different poses"""
+def capture_face_vectors():
+    """Capture an image from webcam for each pose and return the face encoding vector of each"""
     instructions = [
         "Look Straight",
         "Look Left",
@@ -116,8 +156,11 @@ def capture_face_vector():
     if not vectors:
         raise Exception("Failed to capture any valid face vectors")
     
-    avg_vector = np.mean(vectors, axis=0)
-    return avg_vector
+    return vectors
+
+def capture_face_vector():
+    """Capture the poses and return their average face encoding vector, used as a probe"""
+    return np.mean(capture_face_vectors(), axis=0)
 
 @app.route('/add_student', methods=['POST'])
 def add_student():
@@ -133,29 +176,27 @@ def add_student():
         if student_id in students_df.index:
             return jsonify({'status': 'error', 'message': 'Student ID already exists'}), 400
 
-        # Capture facial vector
-        face_vector = capture_face_vector()
-
-        # Convert the face vector to a comma-separated string
-        face_vector_str = ','.join(map(str, face_vector))
+        # Capture one facial vector per pose; each is kept as a template of its own,
+        # so a turned head at verification still finds a close match
+        face_vectors = capture_face_vectors()
 
-        # Append to students_df
-        new_student_row = pd.DataFrame({
-            'student_id':[student_id],
-            'name': [name],
-            'rn': [rn],
-            'facial_vector': [face_vector_str]  # Store as comma-separated string
+        # The matcher appends one row per template to students.csv under the lock
+        # a removal's compaction takes (appending, since tombstones of removed
+        # students refer to row numbers), and matches the new faces at once
+        matcher.register(student_id, name, rn, face_vectors)
+        new_student_rows = pd.DataFrame({
+            'student_id': [student_id] * len(face_vectors),
+            'name': [name] * len(face_vectors),
+            'rn': [rn] * len(face_vectors),
+            'facial_vector': [','.join(map(str, v)) for v in face_vectors]
         })
-        students_df = pd.concat([students_df, new_student_row])
-        students_df.to_csv('executable/data/students.csv', mode='w', index=False)
-        try: 
-            subprocess.run(
-                ["./executable/insert_trie",name, student_id],
-                check=True
-            )
+        students_df = pd.concat([students_df, new_student_rows])
+        try:
+            name_trie.insert(name, student_id)
+            name_trie.flush()
             print(f"Student {name} added to Trie.")
-        except subprocess.CalledProcessError as e:
-            return jsonify({"error": "Failed to insert into Trie", "details": e.stderr}), 500
+        except AttendanceError as e:
+            return jsonify({"error": "Failed to insert into Trie", "details": str(e)}), 500
         # Initialize attendance
         new_attendance_row = pd.DataFrame({
             'student_id': [student_id],
@@ -169,55 +210,79 @@ def add_student():
         })
         attendance_df = pd.concat([attendance_df, new_attendance_row])
         attendance_df.to_csv('executable/data/attendance.csv', mode='w', index=False)
-        subject_list = ['maths', 'english', 'chemistry', 'physics', 'datastructure', 'total_attendance']
-        for subject in subject_list:  # e.g., ['Math', 'Science']
-            subprocess.run(
-                ["./executable/update_avl", f"./executable/serialized/{subject}.dat", 
-                "0", str(student_id)],
-                check=True
-            )
+        store.add_student(student_id)
         return jsonify({'status': 'success', 'message': 'Student added successfully'})
         attendance_df = pd.read_csv('executable/data/attendance.csv')
     except Exception as e:
         return jsonify({'status': 'error', 'message': str(e)}), 500
     
+@app.route('/remove_student', methods=['POST'])
+def remove_student():
+    global students_df, attendance_df
+    try:
+        student_id = int(request.form['student_id'])
+        rows = students_df[students_df['student_id'] == student_id]
+        if rows.empty:
+            return jsonify({'status': 'error', 'message': 'Student not found'}), 404
+
+        try:
+            # Tombstones the student's faces; students.csv is compacted once enough rows are tombstoned
+            matcher.remove(student_id)
+            for name in rows['name'].unique():
+                name_trie.remove(name, student_id)
+            name_trie.flush()
+            store.remove_student(student_id)
+        except AttendanceError as e:
+            return jsonify({"error": "Failed to remove student", "details": str(e)}), 500
+
+        # Drop the student from the exported per-subject indexes (.dat and .snap), so
+        # the threshold tool stops listing them before the next restart
+        try:
+            subprocess.run([update_avl_executable, '--delete', output_folder, str(student_id)],
+                           check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        except subprocess.CalledProcessError as e:
+            print(f"[✗] Error removing student from subject indexes: {e.stdout}{e.stderr}")
+
+        students_df = students_df[students_df['student_id'] != student_id]
+        attendance_df = attendance_df[attendance_df['student_id'] != student_id]
+        attendance_df.to_csv('executable/data/attendance.csv', mode='w', index=False)
+        return jsonify({'status': 'success', 'message': 'Student removed successfully'})
+    except Exception as e:
+        return jsonify({'status': 'error', 'message': str(e)}), 500
+
 @app.route('/verify',methods=['POST'])
 def verify():
     global students_df, attendance_df
     try:
-        subject = request.form['subject']
+        subject = request.form.get('subject', '')
+        if subject not in subjects:
+            return jsonify({
+                'status': 'error',
+                'message': f'Subject must be one of: {", ".join(subjects)}'
+            }), 400
         face_vector = capture_face_vector()
 
-        # Convert the face vector to a comma-separated string
-        face_vector_str = list(map(str, face_vector))
-        command = ['./executable/distance'] + face_vector_str
-        result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=True, text=True)
-        result_str = result.stdout.strip()
-        student_id = int(result_str) 
-        print("Executable returned integer:", student_id)
+        student_id = matcher.match(face_vector)
+        print("Matcher returned integer:", student_id)
         if(student_id != -1):
-            attendance_df.loc[attendance_df['student_id'] == student_id, subject] += 1
-            attendance_df.loc[attendance_df['student_id'] == student_id, 'total_attendance'] += 1
-            attendance_df.to_csv('executable/data/attendance.csv', mode='w', index=False)
-            row = attendance_df[attendance_df['student_id'] == student_id]
-            if row.empty:
+            try:
+                # The store increments the subject and the total together and returns the new values
+                values = store.update(subject, student_id, 1)
+            except AttendanceError as e:
+                return jsonify({"error": "Failed to update attendance store", "details": str(e)}), 500
+            if values is None:
                 return jsonify({'status': 'error', 'message': 'Student not found in attendance'}), 404
-            attendance_value = row.iloc[0][subject]
-            attendance_value1 = row.iloc[0]['total_attendance']
+            attendance_value, attendance_value1 = values
+            # Keep the timestamped mark for time-windowed queries; the store stays the
+            # source of truth for totals, so a failure here does not fail the mark
             try:
-                subprocess.run(
-                    ["./executable/update_avl", f"./executable/serialized/{subject}.dat", 
-                    str(attendance_value), str(student_id)],
-                    check=True
-                )
-                subprocess.run(
-                    ["./executable/update_avl", f"./executable/serialized/total_attendance.dat", 
-                    str(attendance_value1), str(student_id)],
-                    check=True
-                )
-                return jsonify({'status': 'success', 'message': 'Attendance marked successfully'})
-            except subprocess.CalledProcessError as e:
-                return jsonify({"error": "Failed to update AVL tree", "details": e.stderr}), 500
+                events.record(subject, student_id)
+            except AttendanceError as e:
+                print(f"[✗] Error recording attendance event: {e}")
+            # Mirror the store's values in memory; attendance.csv is only an export now
+            attendance_df.loc[attendance_df['student_id'] == student_id, subject] = attendance_value
+            attendance_df.loc[attendance_df['student_id'] == student_id, 'total_attendance'] = attendance_value1
+            return jsonify({'status': 'success', 'message': 'Attendance marked successfully'})
         else:
             print('No student found')
             return jsonify({'status': 'error', 'message': 'No student found'})
@@ -247,7 +312,7 @@ def get_attendance():
 def search_students():
     """
     Route to search students by name using the trie structure
-    Takes a string input, calls the trie executable, and returns attendance for matching students
+    Takes a string input, searches the name trie, and returns attendance for matching students
     """
     try:
         # Get search query from request
@@ -258,27 +323,17 @@ def search_students():
                 'message': 'Search query is required'
             }), 400
 
-        # Call the search_trie executable
+        # Search the name trie
         try:
-            result = subprocess.run(
-                ["./executable/search_trie", search_query],
-                check=True,
-                stdout=subprocess.PIPE,
-                stderr=subprocess.PIPE,
-                text=True
-            )
-            student_ids_str = result.stdout.strip()
+            student_ids = name_trie.search(search_query)
             
             # If no results found
-            if not student_ids_str:
+            if not student_ids:
                 return jsonify({
                     'status': 'success',
                     'data': []
                 })
             
-            # Parse student IDs from the output string
-            student_ids = [int(id_str) for id_str in student_ids_str.split()]
-            
             # Filter attendance data for these student IDs
             matching_records = attendance_df[attendance_df['student_id'].isin(student_ids)].to_dict(orient='records')
             
@@ -286,10 +341,10 @@ def search_students():
                 'status': 'success',
                 'data': matching_records
             })
-        except subprocess.CalledProcessError as e:
+        except AttendanceError as e:
             return jsonify({
                 'status': 'error',
-                'message': f"Trie search failed: {e.stderr}"
+                'message': f"Trie search failed: {e}"
             }), 500
     except Exception as e:
         return jsonify({
@@ -301,7 +356,7 @@ def search_students():
 def threshold_attendance():
     """
     Route to get students with attendance above/below a threshold for a specific subject
-    Takes a subject, threshold value, and direction, calls the threshold executable,
+    Takes a subject, threshold value, and direction, queries the attendance store,
     and returns attendance for matching students
     """
     try:
@@ -309,6 +364,7 @@ def threshold_attendance():
         subject = request.form.get('subject', '')
         threshold = request.form.get('threshold', '')
         direction = request.form.get('direction', '')
+        limit = request.form.get('limit', '0')
         
         # Validate inputs
         if not subject or not threshold or not direction:
@@ -318,7 +374,7 @@ def threshold_attendance():
             }), 400
         
         # Check if subject is valid
-        valid_subjects = ['maths', 'english', 'chemistry', 'physics', 'datastructure', 'total_attendance']
+        valid_subjects = subjects + ['total_attendance']
         if subject not in valid_subjects:
             return jsonify({
                 'status': 'error',
@@ -339,27 +395,27 @@ def threshold_attendance():
                 'message': 'Direction must be either -1 or 1'
             }), 400
         
-        # Call the threshold executable with the subject-specific AVL tree
         try:
-            result = subprocess.run(
-                ["./executable/threshold", f"./executable/serialized/{subject}.dat", str(threshold), direction],
-                check=True,
-                stdout=subprocess.PIPE,
-                stderr=subprocess.PIPE,
-                text=True
-            )
-            student_ids_str = result.stdout.strip()
+            limit = int(limit)
+            if limit < 0:
+                raise ValueError
+        except ValueError:
+            return jsonify({
+                'status': 'error',
+                'message': 'Limit must be a non-negative integer'
+            }), 400
+        
+        # Query the subject's ordered index in the attendance store
+        try:
+            student_ids = store.threshold(subject, threshold, int(direction), limit)
             
             # If no results found
-            if not student_ids_str:
+            if not student_ids:
                 return jsonify({
                     'status': 'success',
                     'data': []
                 })
             
-            # Parse student IDs from the output string
-            student_ids = [int(id_str) for id_str in student_ids_str.split()]
-            
             # Filter attendance data for these student IDs
             matching_records = attendance_df[attendance_df['student_id'].isin(student_ids)].to_dict(orient='records')
             
@@ -367,10 +423,10 @@ def threshold_attendance():
                 'status': 'success',
                 'data': matching_records
             })
-        except subprocess.CalledProcessError as e:
+        except AttendanceError as e:
             return jsonify({
                 'status': 'error',
-                'message': f"Threshold search failed: {e.stderr}"
+                'message': f"Threshold search failed: {e}"
             }), 500
     except Exception as e:
         return jsonify({
@@ -378,5 +434,19 @@ def threshold_attendance():
             'message': str(e)
         }), 500
 
+@app.route('/metrics', methods=['GET'])
+def metrics():
+    """
+    Route exposing per-call latency and counters of the in-process library
+    in the Prometheus text format
+    """
+    try:
+        return Response(attendance_lib.metrics('prometheus'), mimetype='text/plain; version=0.0.4')
+    except AttendanceError as e:
+        return jsonify({
+            'status': 'error',
+            'message': str(e)
+        }), 500
+
 if __name__ == '__main__':
     app.run(debug=True)
\ No newline at end of file